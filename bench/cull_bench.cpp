@@ -0,0 +1,99 @@
+// Times the sphere culling kernels over random spheres scattered around a
+// camera set up like VulkanEngine::UpdateDate, and checks that every kernel
+// keeps exactly the same objects.
+//
+// usage: cull_bench [iterations]
+#include <vk_culling.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace std;
+using bench_clock = chrono::steady_clock;
+
+namespace {
+	double median(vector<double> samples)
+	{
+		sort(samples.begin(), samples.end());
+		return samples[samples.size() / 2];
+	}
+
+	void make_spheres(size_t count, SphereSoA& spheres)
+	{
+		// fixed seed, every run and every kernel sees the same scene
+		mt19937 rng(1234);
+		uniform_real_distribution<float> position(-150.f, 150.f);
+		uniform_real_distribution<float> radius(0.1f, 2.f);
+		spheres.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			spheres.x[i] = position(rng);
+			spheres.y[i] = position(rng);
+			spheres.z[i] = position(rng);
+			spheres.radius[i] = radius(rng);
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 50;
+
+	glm::mat4 view = glm::translate(glm::mat4(1.f), glm::vec3(0.f, -6.f, -10.f));
+	glm::mat4 projection = glm::perspective(glm::radians(70.f), 1700.f / 900.f, 0.1f, 200.0f);
+	projection[1][1] *= -1;
+	Frustum frustum = culling::extract_frustum(projection * view);
+
+	vector<culling::Kernel> kernels = { culling::Kernel::Scalar };
+	if (culling::best_kernel() != culling::Kernel::Scalar)
+	{
+		kernels.push_back(culling::Kernel::SSE);
+	}
+	if (culling::best_kernel() == culling::Kernel::AVX2)
+	{
+		kernels.push_back(culling::Kernel::AVX2);
+	}
+
+	bool mismatch = false;
+	for (size_t count : { size_t(10000), size_t(100000), size_t(1000000) })
+	{
+		SphereSoA spheres;
+		make_spheres(count, spheres);
+		vector<uint32_t> reference(count);
+		size_t referenceVisible = culling::cull_spheres(frustum, spheres, reference.data(), culling::Kernel::Scalar);
+
+		cout << count << " spheres, " << referenceVisible << " visible" << endl;
+		double scalarMs = 0;
+		for (culling::Kernel kernel : kernels)
+		{
+			vector<uint32_t> visible(count);
+			size_t visibleCount = 0;
+			vector<double> samples;
+			for (int i = 0; i < iterations; i++)
+			{
+				auto start = bench_clock::now();
+				visibleCount = culling::cull_spheres(frustum, spheres, visible.data(), kernel);
+				samples.push_back(chrono::duration<double, milli>(bench_clock::now() - start).count());
+			}
+
+			bool same = visibleCount == referenceVisible &&
+				equal(visible.begin(), visible.begin() + visibleCount, reference.begin());
+			mismatch |= !same;
+
+			double ms = median(samples);
+			if (kernel == culling::Kernel::Scalar)
+			{
+				scalarMs = ms;
+			}
+			cout << "  " << culling::kernel_name(kernel) << ": " << ms << " ms, "
+				<< count / ms / 1000.0 << " M spheres/s, "
+				<< scalarMs / ms << "x scalar"
+				<< (same ? "" : "  MISMATCH") << endl;
+		}
+	}
+	return mismatch ? 1 : 0;
+}
@@ -0,0 +1,121 @@
+// Compares the obj text path with the binary mesh cache path.
+// Both paths end with the data packed in a staging sized buffer, which is what
+// VulkanEngine::load_mesh hands to the gpu copy.
+//
+// usage: mesh_cache_bench [iterations] [file.obj ...]
+#include <vk_mesh.h>
+#include <vk_mesh_cache.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <string>
+
+using namespace std;
+using bench_clock = chrono::steady_clock;
+
+namespace {
+	double ms_since(bench_clock::time_point start)
+	{
+		return chrono::duration<double, milli>(bench_clock::now() - start).count();
+	}
+
+	double median(vector<double> samples)
+	{
+		sort(samples.begin(), samples.end());
+		return samples[samples.size() / 2];
+	}
+
+	bool obj_path(const string& file, vector<char>& staging)
+	{
+		Mesh mesh;
+		if (!mesh.load_from_obj(file.c_str()))
+		{
+			return false;
+		}
+		staging.resize(mesh.vertex_bytes() + mesh.index_bytes());
+		memcpy(staging.data(), mesh._vertices.data(), mesh.vertex_bytes());
+		mesh.copy_indices(staging.data() + mesh.vertex_bytes());
+		return true;
+	}
+
+	bool cache_path(const string& file, vector<char>& staging)
+	{
+		Mesh mesh;
+		MappedFile mapping;
+		const MeshCacheHeader* header = mesh_cache::open(file, mapping, mesh);
+		if (!header)
+		{
+			return false;
+		}
+		staging.resize(mesh.vertex_bytes() + mesh.index_bytes());
+		memcpy(staging.data(), mesh_cache::vertex_data(header), mesh.vertex_bytes());
+		memcpy(staging.data() + mesh.vertex_bytes(), mesh_cache::index_data(header), mesh.index_bytes());
+		return true;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	int iterations = argc > 1 ? max(1, atoi(argv[1])) : 10;
+	vector<string> files;
+	for (int i = 2; i < argc; i++)
+	{
+		files.push_back(argv[i]);
+	}
+	if (files.empty())
+	{
+		for (const char* name : { "monkey_smooth.obj", "monkey_flat.obj", "Rayquaza.obj", "lost_empire.obj" })
+		{
+			files.push_back(string(BENCH_ASSET_DIR) + name);
+		}
+	}
+
+	vector<char> staging;
+	for (const string& file : files)
+	{
+		// the first obj load is the cold one, it also produces the cache
+		auto start = bench_clock::now();
+		if (!obj_path(file, staging))
+		{
+			cout << file << ": skipped, failed to load" << endl;
+			continue;
+		}
+		double obj_first = ms_since(start);
+
+		Mesh mesh;
+		mesh.load_from_obj(file.c_str());
+		remove(mesh_cache::cache_path(file).c_str());
+		if (!mesh_cache::write(file, mesh))
+		{
+			cout << file << ": skipped, failed to write cache" << endl;
+			continue;
+		}
+
+		start = bench_clock::now();
+		cache_path(file, staging);
+		double cache_first = ms_since(start);
+
+		vector<double> obj_samples, cache_samples;
+		for (int i = 0; i < iterations; i++)
+		{
+			start = bench_clock::now();
+			obj_path(file, staging);
+			obj_samples.push_back(ms_since(start));
+
+			start = bench_clock::now();
+			cache_path(file, staging);
+			cache_samples.push_back(ms_since(start));
+		}
+
+		double obj_median = median(obj_samples);
+		double cache_median = median(cache_samples);
+		cout << file << " (" << staging.size() << " staging bytes)" << endl
+			<< "  obj   first " << obj_first << " ms, median " << obj_median << " ms" << endl
+			<< "  cache first " << cache_first << " ms, median " << cache_median << " ms" << endl
+			<< "  speedup " << obj_median / cache_median << "x" << endl;
+	}
+	return 0;
+}
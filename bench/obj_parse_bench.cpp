@@ -0,0 +1,139 @@
+// Throughput of the chunked obj parser against tinyobj::LoadObj, with a check
+// that both produce identical attributes and indices.
+//
+// usage: obj_parse_bench [iterations] [file.obj ...]
+#include <vk_obj_parser.h>
+#include <vk_mapped_file.h>
+#include <tiny_obj_loader.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using bench_clock = chrono::steady_clock;
+
+namespace {
+	double median_ms(vector<double> samples)
+	{
+		sort(samples.begin(), samples.end());
+		return samples[samples.size() / 2];
+	}
+
+	bool tinyobj_parse(const string& text, ObjData& out)
+	{
+		tinyobj::attrib_t attrib;
+		vector<tinyobj::shape_t> shapes;
+		vector<tinyobj::material_t> materials;
+		string warn, err;
+		istringstream stream(text);
+		if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, &stream, nullptr))
+		{
+			return false;
+		}
+		out.vertices = attrib.vertices;
+		out.normals = attrib.normals;
+		out.texcoords = attrib.texcoords;
+		out.indices.clear();
+		for (const tinyobj::shape_t& shape : shapes)
+		{
+			for (const tinyobj::index_t& idx : shape.mesh.indices)
+			{
+				out.indices.push_back({ idx.vertex_index, idx.normal_index, idx.texcoord_index });
+			}
+		}
+		return true;
+	}
+
+	template <typename T>
+	bool same_bytes(const vector<T>& a, const vector<T>& b)
+	{
+		return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+	}
+
+	bool same(const ObjData& a, const ObjData& b)
+	{
+		return same_bytes(a.vertices, b.vertices) && same_bytes(a.normals, b.normals)
+			&& same_bytes(a.texcoords, b.texcoords) && same_bytes(a.indices, b.indices);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	int iterations = argc > 1 ? max(1, atoi(argv[1])) : 10;
+	vector<string> files;
+	for (int i = 2; i < argc; i++)
+	{
+		files.push_back(argv[i]);
+	}
+	if (files.empty())
+	{
+		for (const char* name : { "monkey_smooth.obj", "monkey_flat.obj", "Rayquaza.obj", "lost_empire.obj" })
+		{
+			files.push_back(string(BENCH_ASSET_DIR) + name);
+		}
+	}
+
+	unsigned max_threads = max(1u, thread::hardware_concurrency());
+	bool all_match = true;
+	for (const string& file : files)
+	{
+		MappedFile mapping;
+		if (!mapping.open(file))
+		{
+			cout << file << ": skipped, failed to open" << endl;
+			continue;
+		}
+		string text(reinterpret_cast<const char*>(mapping.data()), mapping.size());
+		double megabytes = text.size() / (1024.0 * 1024.0);
+
+		ObjData reference;
+		vector<double> samples;
+		for (int i = 0; i < iterations; i++)
+		{
+			auto start = bench_clock::now();
+			tinyobj_parse(text, reference);
+			samples.push_back(chrono::duration<double, milli>(bench_clock::now() - start).count());
+		}
+		double tinyobj_ms = median_ms(samples);
+		cout << file << " (" << text.size() << " bytes)" << endl
+			<< "  tinyobj    " << tinyobj_ms << " ms, " << megabytes / (tinyobj_ms / 1000.0) << " MB/s" << endl;
+
+		// powers of two, then every core when that is not one of them
+		vector<unsigned> thread_counts;
+		for (unsigned threads = 1; threads < max_threads; threads *= 2)
+		{
+			thread_counts.push_back(threads);
+		}
+		thread_counts.push_back(max_threads);
+
+		double single_ms = 0.0;
+		for (unsigned threads : thread_counts)
+		{
+			ObjData parsed;
+			samples.clear();
+			for (int i = 0; i < iterations; i++)
+			{
+				auto start = bench_clock::now();
+				obj_parser::parse(text.data(), text.size(), parsed, threads);
+				samples.push_back(chrono::duration<double, milli>(bench_clock::now() - start).count());
+			}
+			double ms = median_ms(samples);
+			if (threads == 1)
+			{
+				single_ms = ms;
+			}
+			bool match = same(parsed, reference);
+			all_match &= match;
+			cout << "  threads " << threads << "  " << ms << " ms, " << megabytes / (ms / 1000.0) << " MB/s"
+				<< ", speedup " << single_ms / ms << "x (" << tinyobj_ms / ms << "x vs tinyobj)"
+				<< (match ? "" : "  OUTPUT MISMATCH") << endl;
+		}
+	}
+	return all_match ? 0 : 1;
+}
@@ -0,0 +1,28 @@
+#version 460
+#extension GL_EXT_nonuniform_qualifier : require
+
+//shader input
+layout (location = 0) in vec3 inColor;
+layout (location = 1) in vec2 texCoord;
+layout (location = 2) flat in uint textureIndex;
+//output write
+layout (location = 0) out vec4 outFragColor;
+
+layout(set = 0, binding = 1) uniform  SceneData{
+    vec4 fogColor; // w is for exponent
+	vec4 fogDistances; //x for min, y for max, zw unused.
+	vec4 ambientColor;
+	vec4 sunlightDirection; //w for sun power
+	vec4 sunlightColor;
+} sceneData;
+
+// every loaded texture, the index comes from the object buffer
+layout(set = 1, binding = 0) uniform sampler textureSampler;
+layout(set = 1, binding = 1) uniform texture2D textures[];
+
+
+void main()
+{
+	vec3 color = texture(sampler2D(textures[nonuniformEXT(textureIndex)], textureSampler), texCoord).xyz;
+	outFragColor = vec4(color,1.0f);
+}
@@ -7,6 +7,7 @@ layout (location = 3) in vec2 vTexCoord;
 
 layout (location = 0) out vec3 outColor;
 layout (location = 1) out vec2 texCoord;
+layout (location = 2) flat out uint textureIndex;
 
 layout(set = 0, binding = 0) uniform  CameraBuffer{
 	mat4 view;
@@ -16,6 +17,8 @@ layout(set = 0, binding = 0) uniform  CameraBuffer{
 
 struct ObjectData{
 	mat4 model;
+	// x: slot in the bindless texture array
+	uvec4 params;
 };
 
 layout(std140,set = 0, binding = 2) readonly buffer ObjectBuffer
@@ -33,9 +36,11 @@ layout( push_constant ) uniform constants
 
 void main()
 {
-	mat4 modelMatrix = objectBuffer.objects[gl_BaseInstance].model;
+	// gl_InstanceIndex already includes firstInstance, the batch start in the object buffer
+	mat4 modelMatrix = objectBuffer.objects[gl_InstanceIndex].model;
 	mat4 transformMatrix = (cameraData.proj * cameraData.view * modelMatrix);
 	gl_Position = transformMatrix  * vec4(vPosition, 1.0f);
 	outColor = vColor;
 	texCoord = vTexCoord;
+	textureIndex = objectBuffer.objects[gl_InstanceIndex].params.x;
 }
\ No newline at end of file
@@ -1,9 +1,85 @@
 #include <vk_engine.h>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
 
 int main(int argc, char* argv[])
 {
 	VulkanEngine engine;
 
+	for (int i = 1; i < argc; i++)
+	{
+		// --stress N : add N triangles to the scene and draw everything
+		if (strcmp(argv[i], "--stress") == 0 && i + 1 < argc)
+		{
+			engine._stressObjectCount = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		// --gpu-cull : start with compute culling and indirect draws, when the device has them
+		else if (strcmp(argv[i], "--gpu-cull") == 0)
+		{
+			engine._gpuCulling = true;
+		}
+		// --bindless : textured materials sample one descriptor indexed texture array
+		else if (strcmp(argv[i], "--bindless") == 0)
+		{
+			engine._bindless = true;
+		}
+		// --png-textures : ignore the .ktx2 files and decode the pngs
+		else if (strcmp(argv[i], "--png-textures") == 0)
+		{
+			engine._compressedTextures = false;
+		}
+		// --texture-budget MB : cap the streamed textures below the heap budget
+		else if (strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc)
+		{
+			engine._textureBudget = static_cast<VkDeviceSize>(strtoull(argv[++i], nullptr, 10)) * 1024 * 1024;
+		}
+		// --no-streaming : upload every mip of every texture at load
+		else if (strcmp(argv[i], "--no-streaming") == 0)
+		{
+			engine._textureStreaming = false;
+		}
+		// --headless : no window, render offscreen and print frame timings,
+		// VK_ICD_FILENAMES=<lvp_icd.json> runs it on lavapipe
+		else if (strcmp(argv[i], "--headless") == 0)
+		{
+			engine._headless = true;
+		}
+		// --frames N : frames --headless times, after the warm up
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+		{
+			engine._headlessFrames = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		// --benchmark NAME : play that scene of json/benchmarks.json, then exit
+		else if (strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc)
+		{
+			engine._benchmarkName = argv[++i];
+		}
+		// --report PATH : the benchmark writes PATH.json and PATH.csv, benchmark_<scene> by default
+		else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc)
+		{
+			engine._benchmarkOutput = argv[++i];
+		}
+		// --present-mode fifo|fifo_relaxed|mailbox|immediate : falls back to fifo when the surface lacks it
+		else if (strcmp(argv[i], "--present-mode") == 0 && i + 1 < argc)
+		{
+			if (!frame_pacing::parse_present_mode(argv[++i], engine._presentMode))
+			{
+				std::cout << "unknown present mode " << argv[i] << ", using fifo" << std::endl;
+			}
+		}
+		// --fps-cap N : at most N frames per second, 0 uncapped, the refresh rate for mailbox by default
+		else if (strcmp(argv[i], "--fps-cap") == 0 && i + 1 < argc)
+		{
+			engine._fpsCap = atof(argv[++i]);
+		}
+		// --cpu-trace PATH : write the CPU zones of the whole run as a chrome trace
+		else if (strcmp(argv[i], "--cpu-trace") == 0 && i + 1 < argc)
+		{
+			engine._cpuTracePath = argv[++i];
+		}
+	}
+
 	engine.init();	
 	
 	engine.run();
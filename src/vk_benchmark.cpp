@@ -0,0 +1,386 @@
+#include <vk_benchmark.h>
+#include <prettywriter.h>
+#include <stringbuffer.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+	bool read_vec3(const rapidjson::Value& value, glm::vec3& out)
+	{
+		if (!value.IsArray() || value.Size() != 3)
+		{
+			return false;
+		}
+		for (rapidjson::SizeType i = 0; i < 3; i++)
+		{
+			if (!value[i].IsNumber())
+			{
+				return false;
+			}
+			out[i] = static_cast<float>(value[i].GetDouble());
+		}
+		return true;
+	}
+
+	bool read_track(const rapidjson::Value& scene, const char* member, std::vector<BenchmarkKey>& outTrack)
+	{
+		if (!scene.HasMember(member))
+		{
+			return true;
+		}
+		const rapidjson::Value& keys = scene[member];
+		if (!keys.IsArray())
+		{
+			return false;
+		}
+		for (rapidjson::SizeType i = 0; i < keys.Size(); i++)
+		{
+			const rapidjson::Value& entry = keys[i];
+			BenchmarkKey key;
+			if (!entry.IsObject() || !entry.HasMember("frame") || !entry["frame"].IsUint() ||
+				!entry.HasMember("value") || !read_vec3(entry["value"], key.value))
+			{
+				return false;
+			}
+			key.frame = entry["frame"].GetUint();
+			outTrack.push_back(key);
+		}
+		std::stable_sort(outTrack.begin(), outTrack.end(),
+			[](const BenchmarkKey& a, const BenchmarkKey& b) { return a.frame < b.frame; });
+		return true;
+	}
+
+	uint32_t read_uint(const rapidjson::Value& scene, const char* member, uint32_t fallback)
+	{
+		return scene.HasMember(member) && scene[member].IsUint() ? scene[member].GetUint() : fallback;
+	}
+
+	void write_summary(rapidjson::PrettyWriter<rapidjson::StringBuffer>& writer, const BenchmarkSummary& summary)
+	{
+		writer.StartObject();
+		writer.Key("min"); writer.Double(summary.min);
+		writer.Key("avg"); writer.Double(summary.avg);
+		writer.Key("p50"); writer.Double(summary.p50);
+		writer.Key("p90"); writer.Double(summary.p90);
+		writer.Key("p95"); writer.Double(summary.p95);
+		writer.Key("p99"); writer.Double(summary.p99);
+		writer.Key("max"); writer.Double(summary.max);
+		writer.Key("count"); writer.Uint64(summary.count);
+		writer.EndObject();
+	}
+}
+
+namespace benchmark {
+
+	const char* metric_name(Metric metric)
+	{
+		switch (metric)
+		{
+		case FrameMs: return "frame_ms";
+		case CpuMs: return "cpu_ms";
+		case GpuMs: return "gpu_ms";
+		case DrawCalls: return "draws";
+		case Triangles: return "triangles";
+		case PipelineBinds: return "pipeline_binds";
+		case MeshBinds: return "mesh_binds";
+		case Objects: return "objects";
+		case UploadBytes: return "upload_bytes";
+		default: return "";
+		}
+	}
+
+	double metric_value(const BenchmarkFrame& frame, Metric metric)
+	{
+		switch (metric)
+		{
+		case FrameMs: return frame.frameMs;
+		case CpuMs: return frame.cpuMs;
+		case GpuMs: return frame.gpuMs;
+		case DrawCalls: return frame.drawCalls;
+		case Triangles: return frame.triangles;
+		case PipelineBinds: return frame.pipelineBinds;
+		case MeshBinds: return frame.meshBinds;
+		case Objects: return frame.objects;
+		case UploadBytes: return static_cast<double>(frame.uploadBytes);
+		default: return 0;
+		}
+	}
+
+	bool parse_scene(const rapidjson::Document& document, const std::string& name, BenchmarkScene& outScene)
+	{
+		if (!document.IsObject() || !document.HasMember("scene") || !document["scene"].IsArray())
+		{
+			std::cout << "benchmark file has no \"scene\" array" << std::endl;
+			return false;
+		}
+		const rapidjson::Value& scenes = document["scene"];
+		for (rapidjson::SizeType i = 0; i < scenes.Size(); i++)
+		{
+			const rapidjson::Value& entry = scenes[i];
+			if (!entry.IsObject() || !entry.HasMember("name") || !entry["name"].IsString() || name != entry["name"].GetString())
+			{
+				continue;
+			}
+			BenchmarkScene scene;
+			scene.name = name;
+			if (entry.HasMember("model") && entry["model"].IsString())
+			{
+				scene.model = entry["model"].GetString();
+			}
+			scene.stressObjects = read_uint(entry, "stress", scene.stressObjects);
+			scene.seed = read_uint(entry, "seed", scene.seed);
+			scene.warmupFrames = read_uint(entry, "warmup", scene.warmupFrames);
+			scene.frames = read_uint(entry, "frames", scene.frames);
+			if (entry.HasMember("gpu_cull") && entry["gpu_cull"].IsBool())
+			{
+				scene.gpuCulling = entry["gpu_cull"].GetBool();
+			}
+			if (entry.HasMember("texture_streaming") && entry["texture_streaming"].IsBool())
+			{
+				scene.textureStreaming = entry["texture_streaming"].GetBool();
+			}
+			if (!read_track(entry, "camera", scene.camera) || !read_track(entry, "rotation", scene.rotation))
+			{
+				std::cout << "benchmark scene " << name << ": a track key needs \"frame\" and a 3 number \"value\"" << std::endl;
+				return false;
+			}
+			outScene = scene;
+			return true;
+		}
+		std::cout << "no benchmark scene called " << name << ", the file has:";
+		for (rapidjson::SizeType i = 0; i < scenes.Size(); i++)
+		{
+			if (scenes[i].IsObject() && scenes[i].HasMember("name") && scenes[i]["name"].IsString())
+			{
+				std::cout << " " << scenes[i]["name"].GetString();
+			}
+		}
+		std::cout << std::endl;
+		return false;
+	}
+
+	glm::vec3 sample_track(const std::vector<BenchmarkKey>& track, uint32_t frame, const glm::vec3& fallback)
+	{
+		if (track.empty())
+		{
+			return fallback;
+		}
+		if (frame <= track.front().frame)
+		{
+			return track.front().value;
+		}
+		for (size_t i = 1; i < track.size(); i++)
+		{
+			if (frame < track[i].frame)
+			{
+				const BenchmarkKey& a = track[i - 1];
+				const BenchmarkKey& b = track[i];
+				float t = static_cast<float>(frame - a.frame) / static_cast<float>(b.frame - a.frame);
+				return glm::mix(a.value, b.value, t);
+			}
+		}
+		return track.back().value;
+	}
+
+	BenchmarkSummary summarize(const std::vector<double>& samples)
+	{
+		std::vector<double> sorted;
+		sorted.reserve(samples.size());
+		double total = 0;
+		for (double sample : samples)
+		{
+			if (sample >= 0)
+			{
+				sorted.push_back(sample);
+				total += sample;
+			}
+		}
+		BenchmarkSummary summary;
+		summary.count = sorted.size();
+		if (sorted.empty())
+		{
+			return summary;
+		}
+		std::sort(sorted.begin(), sorted.end());
+		auto rank = [&](double p) {
+			size_t index = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+			return sorted[std::min(sorted.size(), std::max<size_t>(index, 1)) - 1];
+		};
+		summary.min = sorted.front();
+		summary.avg = total / sorted.size();
+		summary.p50 = rank(50);
+		summary.p90 = rank(90);
+		summary.p95 = rank(95);
+		summary.p99 = rank(99);
+		summary.max = sorted.back();
+		return summary;
+	}
+
+	void Report::begin(const BenchmarkScene& scene, const std::string& device, uint32_t width, uint32_t height)
+	{
+		_scene = scene;
+		_device = device;
+		_width = width;
+		_height = height;
+		_frames.clear();
+		_frames.reserve(scene.frames);
+		_scopeNames.clear();
+		_scopeMs.clear();
+	}
+
+	void Report::add(const BenchmarkFrame& frame)
+	{
+		_frames.push_back(frame);
+		for (std::vector<double>& scope : _scopeMs)
+		{
+			scope.push_back(-1);
+		}
+	}
+
+	void Report::set_gpu_ms(size_t frame, double ms)
+	{
+		if (frame < _frames.size())
+		{
+			_frames[frame].gpuMs = ms;
+		}
+	}
+
+	void Report::set_gpu_scope(size_t frame, const std::string& scope, double ms)
+	{
+		if (frame >= _frames.size())
+		{
+			return;
+		}
+		auto it = std::find(_scopeNames.begin(), _scopeNames.end(), scope);
+		size_t index = it - _scopeNames.begin();
+		if (it == _scopeNames.end())
+		{
+			_scopeNames.push_back(scope);
+			_scopeMs.emplace_back(_frames.size(), -1.0);
+		}
+		_scopeMs[index][frame] = ms;
+	}
+
+	std::string Report::column_name(size_t column) const
+	{
+		if (column < MetricCount)
+		{
+			return metric_name(static_cast<Metric>(column));
+		}
+		return "gpu_" + _scopeNames[column - MetricCount] + "_ms";
+	}
+
+	double Report::column_value(size_t frame, size_t column) const
+	{
+		if (column < MetricCount)
+		{
+			return metric_value(_frames[frame], static_cast<Metric>(column));
+		}
+		return _scopeMs[column - MetricCount][frame];
+	}
+
+	BenchmarkSummary Report::column_summary(size_t column) const
+	{
+		std::vector<double> samples;
+		samples.reserve(_frames.size());
+		for (size_t i = 0; i < _frames.size(); i++)
+		{
+			samples.push_back(column_value(i, column));
+		}
+		return summarize(samples);
+	}
+
+	BenchmarkSummary Report::summary(Metric metric) const
+	{
+		return column_summary(metric);
+	}
+
+	bool Report::write_json(const std::string& path) const
+	{
+		rapidjson::StringBuffer buffer;
+		rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(buffer);
+		writer.StartObject();
+		writer.Key("scene"); writer.String(_scene.name.c_str());
+		writer.Key("device"); writer.String(_device.c_str());
+		writer.Key("width"); writer.Uint(_width);
+		writer.Key("height"); writer.Uint(_height);
+		writer.Key("seed"); writer.Uint(_scene.seed);
+		writer.Key("warmup"); writer.Uint(_scene.warmupFrames);
+		writer.Key("texture_streaming"); writer.Bool(_scene.textureStreaming);
+		writer.Key("frames"); writer.Uint64(_frames.size());
+
+		writer.Key("summary");
+		writer.StartObject();
+		for (size_t c = 0; c < column_count(); c++)
+		{
+			BenchmarkSummary column = column_summary(c);
+			// no timestamps on this queue, a zero gpu time would compare as a win
+			if (column.count == 0)
+			{
+				continue;
+			}
+			writer.Key(column_name(c).c_str());
+			write_summary(writer, column);
+		}
+		writer.EndObject();
+
+		writer.Key("per_frame");
+		writer.StartArray();
+		for (size_t i = 0; i < _frames.size(); i++)
+		{
+			writer.StartObject();
+			for (size_t c = 0; c < column_count(); c++)
+			{
+				writer.Key(column_name(c).c_str());
+				writer.Double(column_value(i, c));
+			}
+			writer.EndObject();
+		}
+		writer.EndArray();
+		writer.EndObject();
+
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file.write(buffer.GetString(), buffer.GetSize());
+		return file.good();
+	}
+
+	bool Report::write_csv(const std::string& path) const
+	{
+		std::ofstream file(path, std::ios::trunc);
+		file << "frame";
+		for (size_t c = 0; c < column_count(); c++)
+		{
+			file << "," << column_name(c);
+		}
+		file << "\n";
+		for (size_t i = 0; i < _frames.size(); i++)
+		{
+			file << i;
+			for (size_t c = 0; c < column_count(); c++)
+			{
+				file << "," << column_value(i, c);
+			}
+			file << "\n";
+		}
+		return file.good();
+	}
+
+	void Report::print() const
+	{
+		std::cout << "benchmark " << _scene.name << ": " << _frames.size() << " frames at "
+			<< _width << "x" << _height << " on " << _device << std::endl;
+		for (size_t c = 0; c < column_count(); c++)
+		{
+			BenchmarkSummary s = column_summary(c);
+			if (s.count == 0)
+			{
+				continue;
+			}
+			std::cout << "  " << column_name(c) << ": min " << s.min << ", avg " << s.avg
+				<< ", p50 " << s.p50 << ", p95 " << s.p95 << ", p99 " << s.p99 << ", max " << s.max << std::endl;
+		}
+	}
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <document.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// key of a scripted track, the value between two keys is interpolated linearly
+// by frame index, so a run never depends on how long a frame took
+struct BenchmarkKey {
+	uint32_t frame;
+	glm::vec3 value;
+};
+
+// one "scene" entry of json/benchmarks.json
+struct BenchmarkScene {
+	std::string name;
+	// obj_name entry the model viewer draws, the stress scenes draw everything
+	std::string model;
+	uint32_t stressObjects{ 0 };
+	// 0 keeps the stress grid, anything else scatters the objects with this seed
+	uint32_t seed{ 0 };
+	bool gpuCulling{ false };
+	// off by default, swaps and evictions follow upload timing and would make
+	// draws, binds and upload_bytes differ between identical runs
+	bool textureStreaming{ false };
+	// drawn but not recorded, after every pipeline compiled and upload landed
+	uint32_t warmupFrames{ 30 };
+	uint32_t frames{ 600 };
+	// view translation, the camPos UpdateDate uses
+	std::vector<BenchmarkKey> camera;
+	// model rotation in degrees around x, y then z, ignored by the stress scenes
+	std::vector<BenchmarkKey> rotation;
+};
+
+// numbers of one recorded frame
+struct BenchmarkFrame {
+	// wall clock from the previous frame
+	double frameMs{ 0 };
+	// draw() from after the fence wait to the submit
+	double cpuMs{ 0 };
+	// timestamps around the command buffer, negative when the queue has none
+	double gpuMs{ -1 };
+	uint32_t drawCalls{ 0 };
+	uint32_t triangles{ 0 };
+	uint32_t pipelineBinds{ 0 };
+	uint32_t meshBinds{ 0 };
+	uint32_t objects{ 0 };
+	uint64_t uploadBytes{ 0 };
+};
+
+struct BenchmarkSummary {
+	double min{ 0 };
+	double avg{ 0 };
+	double p50{ 0 };
+	double p90{ 0 };
+	double p95{ 0 };
+	double p99{ 0 };
+	double max{ 0 };
+	size_t count{ 0 };
+};
+
+namespace benchmark {
+
+	// columns of the reports, in the csv order
+	enum Metric {
+		FrameMs, CpuMs, GpuMs, DrawCalls, Triangles, PipelineBinds, MeshBinds, Objects, UploadBytes,
+		MetricCount
+	};
+	const char* metric_name(Metric metric);
+	double metric_value(const BenchmarkFrame& frame, Metric metric);
+
+	// false (and a message on cout) when the document has no scene called name
+	bool parse_scene(const rapidjson::Document& document, const std::string& name, BenchmarkScene& outScene);
+	glm::vec3 sample_track(const std::vector<BenchmarkKey>& track, uint32_t frame, const glm::vec3& fallback);
+
+	// nearest rank percentile of the non negative samples, the others are missing values
+	BenchmarkSummary summarize(const std::vector<double>& samples);
+
+	// per frame numbers of one run, written as json (summary and frames) and csv (frames),
+	// gpu scopes become extra gpu_<scope>_ms columns after the metrics
+	class Report {
+	public:
+		void begin(const BenchmarkScene& scene, const std::string& device, uint32_t width, uint32_t height);
+		void add(const BenchmarkFrame& frame);
+		// gpu times arrive once the frame's fence signaled, frames behind add
+		void set_gpu_ms(size_t frame, double ms);
+		void set_gpu_scope(size_t frame, const std::string& scope, double ms);
+
+		bool write_json(const std::string& path) const;
+		bool write_csv(const std::string& path) const;
+		void print() const;
+
+		const std::vector<BenchmarkFrame>& frames() const { return _frames; }
+		BenchmarkSummary summary(Metric metric) const;
+
+	private:
+		size_t column_count() const { return MetricCount + _scopeNames.size(); }
+		std::string column_name(size_t column) const;
+		// negative when the frame has no value
+		double column_value(size_t frame, size_t column) const;
+		BenchmarkSummary column_summary(size_t column) const;
+
+		BenchmarkScene _scene;
+		std::string _device;
+		uint32_t _width{ 0 };
+		uint32_t _height{ 0 };
+		std::vector<BenchmarkFrame> _frames;
+		std::vector<std::string> _scopeNames;
+		// [scope][frame]
+		std::vector<std::vector<double>> _scopeMs;
+	};
+}
@@ -0,0 +1,154 @@
+#include <vk_cpu_profiler.h>
+#include <writer.h>
+#include <stringbuffer.h>
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+	struct Event {
+		const char* name;
+		uint64_t begin;
+		uint64_t end;
+	};
+
+	// written by its thread only, head counts every zone ever recorded
+	struct ThreadRing {
+		std::atomic<uint64_t> head{ 0 };
+		Event events[cpu_profiler::RING_SIZE];
+		uint32_t tid{ 0 };
+		std::string name;
+	};
+
+	// rings outlive their threads, a finished worker still shows up in the trace
+	std::mutex g_registryLock;
+	std::vector<std::unique_ptr<ThreadRing>> g_rings;
+	std::unordered_set<std::string> g_names;
+
+	std::chrono::steady_clock::time_point g_startTime;
+	uint64_t g_startTicks{ 0 };
+
+	thread_local ThreadRing* t_ring = nullptr;
+
+	ThreadRing* thread_ring()
+	{
+		if (!t_ring)
+		{
+			std::lock_guard<std::mutex> lock(g_registryLock);
+			g_rings.push_back(std::make_unique<ThreadRing>());
+			t_ring = g_rings.back().get();
+			t_ring->tid = static_cast<uint32_t>(g_rings.size());
+		}
+		return t_ring;
+	}
+}
+
+namespace cpu_profiler {
+
+	std::atomic<bool> g_capturing{ false };
+
+	void start()
+	{
+		g_startTime = std::chrono::steady_clock::now();
+		g_startTicks = now();
+		g_capturing.store(true, std::memory_order_relaxed);
+	}
+
+	void stop()
+	{
+		g_capturing.store(false, std::memory_order_relaxed);
+	}
+
+	void set_thread_name(const char* name)
+	{
+		ThreadRing* ring = thread_ring();
+		std::lock_guard<std::mutex> lock(g_registryLock);
+		ring->name = name;
+	}
+
+	const char* intern(const std::string& name)
+	{
+		std::lock_guard<std::mutex> lock(g_registryLock);
+		return g_names.insert(name).first->c_str();
+	}
+
+	void record(const char* name, uint64_t begin, uint64_t end)
+	{
+		ThreadRing* ring = thread_ring();
+		uint64_t head = ring->head.load(std::memory_order_relaxed);
+		ring->events[head & (RING_SIZE - 1)] = { name, begin, end };
+		ring->head.store(head + 1, std::memory_order_release);
+	}
+
+	bool write_trace(const std::string& path)
+	{
+		// ticks to microseconds, measured over the whole capture
+		double elapsed_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - g_startTime).count();
+		uint64_t elapsed_ticks = now() - g_startTicks;
+		double us_per_tick = elapsed_ticks > 0 ? elapsed_us / elapsed_ticks : 0.0;
+
+		rapidjson::StringBuffer buffer;
+		rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+		writer.StartObject();
+		writer.Key("displayTimeUnit"); writer.String("ms");
+		writer.Key("traceEvents");
+		writer.StartArray();
+
+		std::lock_guard<std::mutex> lock(g_registryLock);
+		std::vector<Event> events;
+		for (const std::unique_ptr<ThreadRing>& ring : g_rings)
+		{
+			std::string name = ring->name.empty() ? "thread " + std::to_string(ring->tid) : ring->name;
+			writer.StartObject();
+			writer.Key("name"); writer.String("thread_name");
+			writer.Key("ph"); writer.String("M");
+			writer.Key("pid"); writer.Uint(1);
+			writer.Key("tid"); writer.Uint(ring->tid);
+			writer.Key("args");
+			writer.StartObject();
+			writer.Key("name"); writer.String(name.c_str());
+			writer.EndObject();
+			writer.EndObject();
+
+			uint64_t head = ring->head.load(std::memory_order_acquire);
+			uint64_t first = head > RING_SIZE ? head - RING_SIZE : 0;
+			events.clear();
+			for (uint64_t i = first; i < head; i++)
+			{
+				events.push_back(ring->events[i & (RING_SIZE - 1)]);
+			}
+			// zones the thread overwrote while they were copied are dropped
+			uint64_t after = ring->head.load(std::memory_order_acquire);
+			uint64_t overwritten = after > first + RING_SIZE ? after - RING_SIZE - first : 0;
+			size_t skip = static_cast<size_t>(std::min<uint64_t>(overwritten, events.size()));
+
+			for (size_t i = skip; i < events.size(); i++)
+			{
+				const Event& event = events[i];
+				// zones that began before start
+				if (event.begin < g_startTicks)
+				{
+					continue;
+				}
+				writer.StartObject();
+				writer.Key("name"); writer.String(event.name);
+				writer.Key("ph"); writer.String("X");
+				writer.Key("pid"); writer.Uint(1);
+				writer.Key("tid"); writer.Uint(ring->tid);
+				writer.Key("ts"); writer.Double((event.begin - g_startTicks) * us_per_tick);
+				writer.Key("dur"); writer.Double((event.end - event.begin) * us_per_tick);
+				writer.EndObject();
+			}
+		}
+		writer.EndArray();
+		writer.EndObject();
+
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file.write(buffer.GetString(), buffer.GetSize());
+		return file.good();
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// 0 compiles every CPU_ZONE away, set by the CPU_PROFILER cmake option
+#ifndef CPU_PROFILER
+#define CPU_PROFILER 1
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define CPU_PROFILER_RDTSC 1
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define CPU_PROFILER_RDTSC 1
+#endif
+
+// Scoped CPU zones for chrome://tracing and Perfetto.
+// Every thread writes its zones into its own ring of RING_SIZE entries, the
+// only shared state on that path is the capturing flag, so a zone costs two
+// timestamp reads and one store while capturing and one relaxed load when not.
+// The rings keep the newest zones, write_trace converts them to trace-event json.
+namespace cpu_profiler {
+
+	constexpr size_t RING_SIZE = 1 << 16;
+
+	extern std::atomic<bool> g_capturing;
+
+	// rdtsc where available (invariant on every x86 this runs on), else steady_clock ns,
+	// write_trace converts with a rate measured between start and now
+	inline uint64_t now()
+	{
+#if CPU_PROFILER_RDTSC
+		return __rdtsc();
+#else
+		return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+	}
+
+	inline bool capturing() { return g_capturing.load(std::memory_order_relaxed); }
+
+	// zones only record between start and stop, the trace time 0 is start
+	void start();
+	void stop();
+
+	// the calling thread shows up under this name
+	void set_thread_name(const char* name);
+	// zone names are kept as pointers, a runtime string needs a stable copy
+	const char* intern(const std::string& name);
+
+	void record(const char* name, uint64_t begin, uint64_t end);
+	// meant after stop, a ring that wraps during the copy loses its overwritten zones
+	bool write_trace(const std::string& path);
+
+	class Zone {
+	public:
+		explicit Zone(const char* name) : _name(name), _begin(name && capturing() ? now() : 0) {}
+		~Zone()
+		{
+			if (_begin != 0)
+			{
+				record(_name, _begin, now());
+			}
+		}
+		Zone(const Zone&) = delete;
+		Zone& operator=(const Zone&) = delete;
+
+	private:
+		const char* _name;
+		uint64_t _begin;
+	};
+}
+
+#if CPU_PROFILER
+#define CPU_ZONE_CONCAT_(a, b) a##b
+#define CPU_ZONE_CONCAT(a, b) CPU_ZONE_CONCAT_(a, b)
+// name is a string literal
+#define CPU_ZONE(name) cpu_profiler::Zone CPU_ZONE_CONCAT(cpu_zone_, __LINE__)(name)
+// name is a std::string, only copied while capturing
+#define CPU_ZONE_DYNAMIC(name) cpu_profiler::Zone CPU_ZONE_CONCAT(cpu_zone_, __LINE__)( \
+	cpu_profiler::capturing() ? cpu_profiler::intern(name) : nullptr)
+#define CPU_THREAD_NAME(name) cpu_profiler::set_thread_name(name)
+#else
+#define CPU_ZONE(name) ((void)0)
+#define CPU_ZONE_DYNAMIC(name) ((void)0)
+#define CPU_THREAD_NAME(name) ((void)0)
+#endif
@@ -0,0 +1,252 @@
+#include <vk_culling.h>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CULL_SSE 1
+#define CULL_AVX2 1
+#define CULL_TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <immintrin.h>
+#include <intrin.h>
+#define CULL_SSE 1
+#define CULL_AVX2 1
+#define CULL_TARGET_AVX2
+#endif
+
+void SphereSoA::resize(size_t count)
+{
+	x.resize(count);
+	y.resize(count);
+	z.resize(count);
+	radius.resize(count);
+}
+
+namespace {
+
+	size_t cull_scalar(const Frustum& frustum, const SphereSoA& spheres, size_t begin, uint32_t* visible, size_t count)
+	{
+		for (size_t i = begin; i < spheres.size(); i++)
+		{
+			bool inside = true;
+			for (const glm::vec4& plane : frustum.planes)
+			{
+				float distance = plane.x * spheres.x[i] + plane.y * spheres.y[i] + plane.z * spheres.z[i] + plane.w;
+				if (distance < -spheres.radius[i])
+				{
+					inside = false;
+					break;
+				}
+			}
+			if (inside)
+			{
+				visible[count++] = static_cast<uint32_t>(i);
+			}
+		}
+		return count;
+	}
+
+#if CULL_SSE
+	size_t cull_sse(const Frustum& frustum, const SphereSoA& spheres, uint32_t* visible)
+	{
+		__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (int p = 0; p < 6; p++)
+		{
+			planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+			planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+			planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+			planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+		}
+		const __m128 zero = _mm_setzero_ps();
+
+		size_t count = 0;
+		size_t i = 0;
+		size_t n = spheres.size();
+		for (; i + 4 <= n; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(&spheres.x[i]);
+			__m128 y = _mm_loadu_ps(&spheres.y[i]);
+			__m128 z = _mm_loadu_ps(&spheres.z[i]);
+			__m128 negRadius = _mm_sub_ps(zero, _mm_loadu_ps(&spheres.radius[i]));
+
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (int p = 0; p < 6; p++)
+			{
+				// same operation order as the scalar loop, the kernels agree bit for bit
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)),
+					_mm_mul_ps(planeZ[p], z)), planeW[p]);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+			}
+
+			int bits = _mm_movemask_ps(inside);
+			while (bits)
+			{
+				int lane = 0;
+				while (!(bits & (1 << lane)))
+				{
+					lane++;
+				}
+				visible[count++] = static_cast<uint32_t>(i + lane);
+				bits &= bits - 1;
+			}
+		}
+		return cull_scalar(frustum, spheres, i, visible, count);
+	}
+#endif
+
+#if CULL_AVX2
+	CULL_TARGET_AVX2
+	size_t cull_avx2(const Frustum& frustum, const SphereSoA& spheres, uint32_t* visible)
+	{
+		__m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (int p = 0; p < 6; p++)
+		{
+			planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+			planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+			planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+			planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+		}
+		const __m256 zero = _mm256_setzero_ps();
+
+		size_t count = 0;
+		size_t i = 0;
+		size_t n = spheres.size();
+		for (; i + 8 <= n; i += 8)
+		{
+			__m256 x = _mm256_loadu_ps(&spheres.x[i]);
+			__m256 y = _mm256_loadu_ps(&spheres.y[i]);
+			__m256 z = _mm256_loadu_ps(&spheres.z[i]);
+			__m256 negRadius = _mm256_sub_ps(zero, _mm256_loadu_ps(&spheres.radius[i]));
+
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (int p = 0; p < 6; p++)
+			{
+				// no fma, it would round differently from the scalar and sse paths
+				__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+					_mm256_mul_ps(planeX[p], x), _mm256_mul_ps(planeY[p], y)),
+					_mm256_mul_ps(planeZ[p], z)), planeW[p]);
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+			}
+
+			int bits = _mm256_movemask_ps(inside);
+			while (bits)
+			{
+				int lane = 0;
+				while (!(bits & (1 << lane)))
+				{
+					lane++;
+				}
+				visible[count++] = static_cast<uint32_t>(i + lane);
+				bits &= bits - 1;
+			}
+		}
+		return cull_scalar(frustum, spheres, i, visible, count);
+	}
+
+	bool cpu_has_avx2()
+	{
+#if defined(__GNUC__)
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#else
+		int info[4];
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		// the os has to save the ymm registers too
+		if (!osxsave || (_xgetbv(0) & 6) != 6)
+		{
+			return false;
+		}
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#endif
+	}
+#endif
+}
+
+namespace culling {
+
+	Frustum extract_frustum(const glm::mat4& viewproj)
+	{
+		// glm is column major, m[c][r]
+		glm::vec4 row0(viewproj[0][0], viewproj[1][0], viewproj[2][0], viewproj[3][0]);
+		glm::vec4 row1(viewproj[0][1], viewproj[1][1], viewproj[2][1], viewproj[3][1]);
+		glm::vec4 row2(viewproj[0][2], viewproj[1][2], viewproj[2][2], viewproj[3][2]);
+		glm::vec4 row3(viewproj[0][3], viewproj[1][3], viewproj[2][3], viewproj[3][3]);
+
+		Frustum frustum;
+		frustum.planes[0] = row3 + row0;	// left
+		frustum.planes[1] = row3 - row0;	// right
+		frustum.planes[2] = row3 + row1;	// bottom (top with the flipped y)
+		frustum.planes[3] = row3 - row1;	// top
+		frustum.planes[4] = row3 + row2;	// near
+		frustum.planes[5] = row3 - row2;	// far
+		for (glm::vec4& plane : frustum.planes)
+		{
+			plane /= glm::length(glm::vec3(plane));
+		}
+		return frustum;
+	}
+
+	void transform_sphere(const glm::mat4& model, const glm::vec3& origin, float radius,
+		float& outX, float& outY, float& outZ, float& outRadius)
+	{
+		glm::vec4 center = model * glm::vec4(origin, 1.f);
+		float scale2 = std::max(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+			std::max(glm::dot(glm::vec3(model[1]), glm::vec3(model[1])),
+				glm::dot(glm::vec3(model[2]), glm::vec3(model[2]))));
+		outX = center.x;
+		outY = center.y;
+		outZ = center.z;
+		outRadius = radius * std::sqrt(scale2);
+	}
+
+	Kernel best_kernel()
+	{
+#if CULL_AVX2
+		static const Kernel best = cpu_has_avx2() ? Kernel::AVX2 : Kernel::SSE;
+		return best;
+#elif CULL_SSE
+		return Kernel::SSE;
+#else
+		return Kernel::Scalar;
+#endif
+	}
+
+	const char* kernel_name(Kernel kernel)
+	{
+		switch (kernel)
+		{
+		case Kernel::AVX2:
+			return "avx2";
+		case Kernel::SSE:
+			return "sse";
+		default:
+			return "scalar";
+		}
+	}
+
+	size_t cull_spheres(const Frustum& frustum, const SphereSoA& spheres, uint32_t* visible)
+	{
+		return cull_spheres(frustum, spheres, visible, best_kernel());
+	}
+
+	size_t cull_spheres(const Frustum& frustum, const SphereSoA& spheres, uint32_t* visible, Kernel kernel)
+	{
+		switch (kernel)
+		{
+#if CULL_AVX2
+		case Kernel::AVX2:
+			return cull_avx2(frustum, spheres, visible);
+#endif
+#if CULL_SSE
+		case Kernel::SSE:
+			return cull_sse(frustum, spheres, visible);
+#endif
+		default:
+			return cull_scalar(frustum, spheres, 0, visible, 0);
+		}
+	}
+}
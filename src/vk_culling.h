@@ -0,0 +1,47 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// six planes (xyz normal, w distance), normalized and pointing inside
+struct Frustum
+{
+	glm::vec4 planes[6];
+};
+
+// world space bounding spheres, one array per component so the kernels
+// can load 4 or 8 objects with a single instruction
+struct SphereSoA
+{
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> z;
+	std::vector<float> radius;
+
+	void resize(size_t count);
+	size_t size() const { return x.size(); }
+};
+
+namespace culling {
+
+	enum class Kernel { Scalar, SSE, AVX2 };
+
+	// Gribb/Hartmann plane extraction from projection * view. With the GL depth
+	// range glm::perspective uses the near plane is slightly conservative for
+	// Vulkan, which only ever keeps extra objects.
+	Frustum extract_frustum(const glm::mat4& viewproj);
+
+	// sphere of a mesh moved by model, the radius grows with the largest axis scale
+	void transform_sphere(const glm::mat4& model, const glm::vec3& origin, float radius,
+		float& outX, float& outY, float& outZ, float& outRadius);
+
+	// fastest kernel this cpu runs, checked once
+	Kernel best_kernel();
+	const char* kernel_name(Kernel kernel);
+
+	// writes the index of every sphere touching the frustum into visible
+	// (room for spheres.size() entries), returns how many were written
+	size_t cull_spheres(const Frustum& frustum, const SphereSoA& spheres, uint32_t* visible);
+	size_t cull_spheres(const Frustum& frustum, const SphereSoA& spheres, uint32_t* visible, Kernel kernel);
+}
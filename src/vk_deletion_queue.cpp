@@ -0,0 +1,82 @@
+#include <vk_deletion_queue.h>
+
+namespace {
+	template<typename T>
+	T as(uint64_t handle)
+	{
+		T typed;
+		memcpy(&typed, &handle, sizeof(T));
+		return typed;
+	}
+}
+
+void DeletionQueue::push_function(std::function<void()>&& function)
+{
+	push(Type::Function, static_cast<uint64_t>(_functions.size()));
+	_functions.push_back(std::move(function));
+}
+
+void DeletionQueue::flush(VkDevice device, VmaAllocator allocator)
+{
+	// reverse order, later objects may depend on earlier ones
+	for (auto it = _entries.rbegin(); it != _entries.rend(); it++)
+	{
+		uint64_t handle = it->handle;
+		switch (it->type)
+		{
+		case Type::Buffer:
+			vmaDestroyBuffer(allocator, as<VkBuffer>(handle), it->allocation);
+			break;
+		case Type::Image:
+			vmaDestroyImage(allocator, as<VkImage>(handle), it->allocation);
+			break;
+		case Type::ImageView:
+			vkDestroyImageView(device, as<VkImageView>(handle), nullptr);
+			break;
+		case Type::Sampler:
+			vkDestroySampler(device, as<VkSampler>(handle), nullptr);
+			break;
+		case Type::Pipeline:
+			vkDestroyPipeline(device, as<VkPipeline>(handle), nullptr);
+			break;
+		case Type::PipelineLayout:
+			vkDestroyPipelineLayout(device, as<VkPipelineLayout>(handle), nullptr);
+			break;
+		case Type::DescriptorSetLayout:
+			vkDestroyDescriptorSetLayout(device, as<VkDescriptorSetLayout>(handle), nullptr);
+			break;
+		case Type::DescriptorPool:
+			vkDestroyDescriptorPool(device, as<VkDescriptorPool>(handle), nullptr);
+			break;
+		case Type::ShaderModule:
+			vkDestroyShaderModule(device, as<VkShaderModule>(handle), nullptr);
+			break;
+		case Type::Framebuffer:
+			vkDestroyFramebuffer(device, as<VkFramebuffer>(handle), nullptr);
+			break;
+		case Type::RenderPass:
+			vkDestroyRenderPass(device, as<VkRenderPass>(handle), nullptr);
+			break;
+		case Type::Swapchain:
+			vkDestroySwapchainKHR(device, as<VkSwapchainKHR>(handle), nullptr);
+			break;
+		case Type::CommandPool:
+			vkDestroyCommandPool(device, as<VkCommandPool>(handle), nullptr);
+			break;
+		case Type::Fence:
+			vkDestroyFence(device, as<VkFence>(handle), nullptr);
+			break;
+		case Type::Semaphore:
+			vkDestroySemaphore(device, as<VkSemaphore>(handle), nullptr);
+			break;
+		case Type::QueryPool:
+			vkDestroyQueryPool(device, as<VkQueryPool>(handle), nullptr);
+			break;
+		case Type::Function:
+			_functions[handle]();
+			break;
+		}
+	}
+	_entries.clear();
+	_functions.clear();
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <vk_types.h>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+// Vulkan objects (and their VMA allocations) destroyed in reverse push order.
+// Entries are a handle type, the handle and an allocation in one array, so
+// pushing never allocates once the array reached its working size. The
+// engine keeps one queue for its lifetime and one per FrameData, flushed
+// when that frame's fence signaled.
+class DeletionQueue
+{
+public:
+	void push_buffer(VkBuffer buffer, VmaAllocation allocation) { push(Type::Buffer, buffer, allocation); }
+	void push_image(VkImage image, VmaAllocation allocation) { push(Type::Image, image, allocation); }
+	void push_image_view(VkImageView view) { push(Type::ImageView, view); }
+	void push_sampler(VkSampler sampler) { push(Type::Sampler, sampler); }
+	void push_pipeline(VkPipeline pipeline) { push(Type::Pipeline, pipeline); }
+	void push_pipeline_layout(VkPipelineLayout layout) { push(Type::PipelineLayout, layout); }
+	void push_descriptor_set_layout(VkDescriptorSetLayout layout) { push(Type::DescriptorSetLayout, layout); }
+	void push_descriptor_pool(VkDescriptorPool pool) { push(Type::DescriptorPool, pool); }
+	void push_shader_module(VkShaderModule module) { push(Type::ShaderModule, module); }
+	void push_framebuffer(VkFramebuffer framebuffer) { push(Type::Framebuffer, framebuffer); }
+	void push_render_pass(VkRenderPass renderPass) { push(Type::RenderPass, renderPass); }
+	void push_swapchain(VkSwapchainKHR swapchain) { push(Type::Swapchain, swapchain); }
+	void push_command_pool(VkCommandPool pool) { push(Type::CommandPool, pool); }
+	void push_fence(VkFence fence) { push(Type::Fence, fence); }
+	void push_semaphore(VkSemaphore semaphore) { push(Type::Semaphore, semaphore); }
+	void push_query_pool(VkQueryPool pool) { push(Type::QueryPool, pool); }
+
+	// cleanup that is not one handle (the allocator, other modules), these
+	// keep the std::function allocation and are meant for init time
+	void push_function(std::function<void()>&& function);
+
+	// destroys everything in reverse order, the arrays keep their capacity
+	void flush(VkDevice device, VmaAllocator allocator);
+
+	size_t size() const { return _entries.size(); }
+
+private:
+	enum class Type : uint8_t {
+		Buffer, Image, ImageView, Sampler, Pipeline, PipelineLayout, DescriptorSetLayout,
+		DescriptorPool, ShaderModule, Framebuffer, RenderPass, Swapchain, CommandPool,
+		Fence, Semaphore, QueryPool, Function
+	};
+
+	struct Entry {
+		// non dispatchable handles are pointers or uint64_t depending on the platform
+		uint64_t handle;
+		VmaAllocation allocation;
+		Type type;
+	};
+
+	template<typename T>
+	void push(Type type, T handle, VmaAllocation allocation = VK_NULL_HANDLE)
+	{
+		static_assert(sizeof(T) <= sizeof(uint64_t), "not a vulkan handle");
+		Entry entry{ 0, allocation, type };
+		memcpy(&entry.handle, &handle, sizeof(T));
+		_entries.push_back(entry);
+	}
+
+	std::vector<Entry> _entries;
+	// Type::Function entries index into this
+	std::vector<std::function<void()>> _functions;
+};
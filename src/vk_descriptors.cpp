@@ -0,0 +1,164 @@
+#include <vk_descriptors.h>
+#include <vk_mapped_file.h>
+#include <algorithm>
+#include <chrono>
+
+void DescriptorAllocator::init(VkDevice device)
+{
+	_device = device;
+}
+
+void DescriptorAllocator::cleanup()
+{
+	for (VkDescriptorPool pool : _freePools)
+	{
+		vkDestroyDescriptorPool(_device, pool, nullptr);
+	}
+	for (VkDescriptorPool pool : _usedPools)
+	{
+		vkDestroyDescriptorPool(_device, pool, nullptr);
+	}
+	_freePools.clear();
+	_usedPools.clear();
+	_currentPool = VK_NULL_HANDLE;
+}
+
+void DescriptorAllocator::reset_pools()
+{
+	for (VkDescriptorPool pool : _usedPools)
+	{
+		vkResetDescriptorPool(_device, pool, 0);
+		_freePools.push_back(pool);
+	}
+	_usedPools.clear();
+	_currentPool = VK_NULL_HANDLE;
+}
+
+VkDescriptorPool DescriptorAllocator::grab_pool()
+{
+	if (!_freePools.empty())
+	{
+		VkDescriptorPool pool = _freePools.back();
+		_freePools.pop_back();
+		return pool;
+	}
+
+	std::vector<VkDescriptorPoolSize> sizes;
+	sizes.reserve(_sizes.sizes.size());
+	for (auto& size : _sizes.sizes)
+	{
+		sizes.push_back({ size.first, static_cast<uint32_t>(size.second * SETS_PER_POOL) });
+	}
+	VkDescriptorPoolCreateInfo pool_info = {};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.pNext = nullptr;
+	pool_info.flags = 0;
+	pool_info.maxSets = SETS_PER_POOL;
+	pool_info.poolSizeCount = static_cast<uint32_t>(sizes.size());
+	pool_info.pPoolSizes = sizes.data();
+
+	VkDescriptorPool pool;
+	VK_CHECK(vkCreateDescriptorPool(_device, &pool_info, nullptr, &pool));
+	return pool;
+}
+
+bool DescriptorAllocator::allocate(VkDescriptorSet* set, VkDescriptorSetLayout layout)
+{
+	auto start = std::chrono::steady_clock::now();
+	if (_currentPool == VK_NULL_HANDLE)
+	{
+		_currentPool = grab_pool();
+		_usedPools.push_back(_currentPool);
+	}
+
+	VkDescriptorSetAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.pNext = nullptr;
+	alloc_info.descriptorPool = _currentPool;
+	alloc_info.descriptorSetCount = 1;
+	alloc_info.pSetLayouts = &layout;
+
+	VkResult result = vkAllocateDescriptorSets(_device, &alloc_info, set);
+	if (result == VK_ERROR_FRAGMENTED_POOL || result == VK_ERROR_OUT_OF_POOL_MEMORY)
+	{
+		// this pool is full, the next one takes over
+		_currentPool = grab_pool();
+		_usedPools.push_back(_currentPool);
+		alloc_info.descriptorPool = _currentPool;
+		result = vkAllocateDescriptorSets(_device, &alloc_info, set);
+	}
+
+	_allocations++;
+	_allocationNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	return result == VK_SUCCESS;
+}
+
+void DescriptorLayoutCache::init(VkDevice device)
+{
+	_device = device;
+}
+
+void DescriptorLayoutCache::cleanup()
+{
+	for (auto& layout : _layouts)
+	{
+		vkDestroyDescriptorSetLayout(_device, layout.second, nullptr);
+	}
+	_layouts.clear();
+}
+
+VkDescriptorSetLayout DescriptorLayoutCache::create_descriptor_layout(const VkDescriptorSetLayoutCreateInfo* info)
+{
+	DescriptorLayoutInfo layoutInfo;
+	layoutInfo.flags = info->flags;
+	layoutInfo.bindings.assign(info->pBindings, info->pBindings + info->bindingCount);
+	std::sort(layoutInfo.bindings.begin(), layoutInfo.bindings.end(),
+		[](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) {
+			return a.binding < b.binding;
+		});
+
+	auto it = _layouts.find(layoutInfo);
+	if (it != _layouts.end())
+	{
+		_hits++;
+		return it->second;
+	}
+	_misses++;
+
+	VkDescriptorSetLayout layout;
+	VK_CHECK(vkCreateDescriptorSetLayout(_device, info, nullptr, &layout));
+	_layouts[layoutInfo] = layout;
+	return layout;
+}
+
+bool DescriptorLayoutCache::DescriptorLayoutInfo::operator==(const DescriptorLayoutInfo& other) const
+{
+	if (flags != other.flags || bindings.size() != other.bindings.size())
+	{
+		return false;
+	}
+	for (size_t i = 0; i < bindings.size(); i++)
+	{
+		// immutable samplers are not used, the pointer is ignored
+		if (bindings[i].binding != other.bindings[i].binding ||
+			bindings[i].descriptorType != other.bindings[i].descriptorType ||
+			bindings[i].descriptorCount != other.bindings[i].descriptorCount ||
+			bindings[i].stageFlags != other.bindings[i].stageFlags)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+size_t DescriptorLayoutCache::DescriptorLayoutInfo::hash() const
+{
+	uint64_t hash = file_box::hash_bytes(&flags, sizeof(flags));
+	for (const VkDescriptorSetLayoutBinding& binding : bindings)
+	{
+		uint32_t packed[4] = { binding.binding, static_cast<uint32_t>(binding.descriptorType),
+			binding.descriptorCount, binding.stageFlags };
+		hash = file_box::hash_bytes(packed, sizeof(packed), hash);
+	}
+	return static_cast<size_t>(hash);
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <vk_types.h>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Descriptor sets from a growing list of pools. A pool that runs out is
+// retired and a fresh one (or one recycled by reset_pools) takes over, so
+// allocation never fails because of fixed pool sizes. Main thread only.
+class DescriptorAllocator {
+public:
+	// descriptors of each type per pool, as a multiple of SETS_PER_POOL
+	struct PoolSizes {
+		std::vector<std::pair<VkDescriptorType, float>> sizes = {
+			{ VK_DESCRIPTOR_TYPE_SAMPLER, 0.5f },
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.f },
+			{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 4.f },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.f },
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.f },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.f },
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 2.f },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 2.f }
+		};
+	};
+	static constexpr uint32_t SETS_PER_POOL = 256;
+
+	void init(VkDevice device);
+	void cleanup();
+
+	// every pool handed out so far goes back to the free list, the sets
+	// allocated from them are invalid afterwards
+	void reset_pools();
+	bool allocate(VkDescriptorSet* set, VkDescriptorSetLayout layout);
+
+	size_t pool_count() const { return _usedPools.size() + _freePools.size(); }
+	size_t used_pool_count() const { return _usedPools.size(); }
+	uint64_t allocations() const { return _allocations; }
+	// average cpu time of allocate, pool creation included
+	double average_allocation_us() const { return _allocations ? _allocationNs / 1000.0 / _allocations : 0.0; }
+
+private:
+	VkDescriptorPool grab_pool();
+
+	VkDevice _device{ VK_NULL_HANDLE };
+	PoolSizes _sizes;
+	VkDescriptorPool _currentPool{ VK_NULL_HANDLE };
+	std::vector<VkDescriptorPool> _usedPools;
+	std::vector<VkDescriptorPool> _freePools;
+	uint64_t _allocations{ 0 };
+	uint64_t _allocationNs{ 0 };
+};
+
+// One VkDescriptorSetLayout per distinct set of bindings, the cache owns them.
+class DescriptorLayoutCache {
+public:
+	void init(VkDevice device);
+	void cleanup();
+
+	VkDescriptorSetLayout create_descriptor_layout(const VkDescriptorSetLayoutCreateInfo* info);
+
+	size_t layout_count() const { return _layouts.size(); }
+	uint32_t hits() const { return _hits; }
+	uint32_t misses() const { return _misses; }
+
+	struct DescriptorLayoutInfo {
+		// sorted by binding
+		std::vector<VkDescriptorSetLayoutBinding> bindings;
+		VkDescriptorSetLayoutCreateFlags flags{ 0 };
+
+		bool operator==(const DescriptorLayoutInfo& other) const;
+		size_t hash() const;
+	};
+
+private:
+	struct DescriptorLayoutHash {
+		size_t operator()(const DescriptorLayoutInfo& info) const { return info.hash(); }
+	};
+
+	VkDevice _device{ VK_NULL_HANDLE };
+	std::unordered_map<DescriptorLayoutInfo, VkDescriptorSetLayout, DescriptorLayoutHash> _layouts;
+	uint32_t _hits{ 0 };
+	uint32_t _misses{ 0 };
+};
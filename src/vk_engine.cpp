@@ -6,10 +6,20 @@
 
 #include <vk_types.h>
 #include <vk_initializers.h>
+#include <vk_mesh_cache.h>
+#include <vk_culling.h>
+#include <vk_ktx2.h>
+#include <vk_cpu_profiler.h>
 #include <VkBootstrap.h>
 #include <iostream>
 #include <fstream>
 #include <glm/gtx/transform.hpp>
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <random>
+#include <cstdio>
 #define VMA_IMPLEMENTATION
 #include "vk_mem_alloc.h"
 #include "imgui.h"
@@ -18,46 +28,111 @@
 #include "imgui_internal.h"
 
 using namespace std;
-#define VK_CHECK(x)												\
-	do															\
-	{															\
-		VkResult err = x;										\
-		if (err)												\
-		{														\
-			cout << "Detect Vulkan Error: " << err << endl;		\
-			abort();											\
-		}														\
-	}while(0)
 
 void VulkanEngine::init_vulkan()
 {
+	CPU_ZONE("init_vulkan");
 	vkb::InstanceBuilder builder;
 	auto inst_ret = builder.set_app_name("GTX Team Vulkan Lesson")
 		.request_validation_layers(true)
 		.require_api_version(1, 2, 0)
 		.use_default_debug_messenger()
+		.set_headless(_headless)
 		.build();
 	
 	vkb::Instance vkb_inst = inst_ret.value();
 	_instances = vkb_inst.instance;
 	_debug_Message = vkb_inst.debug_messenger;
 
-	SDL_Vulkan_CreateSurface(_window, _instances, &_surface);
+	// headless needs no present support, any device with a graphics queue
+	// works, a software one like lavapipe included
 	vkb::PhysicalDeviceSelector selector{ vkb_inst };
+	selector.set_minimum_version(1, 2);
+	if (_headless)
+	{
+		selector.require_present(false);
+	}
+	else
+	{
+		SDL_Vulkan_CreateSurface(_window, _instances, &_surface);
+		selector.set_surface(_surface);
+	}
 	vkb::PhysicalDevice vkb_physicalDevice = selector
-		.set_minimum_version(1, 1)
-		.set_surface(_surface)
 		.select()
 		.value();
 
+	// gpu culling needs firstInstance in indirect commands, optional,
+	// without it draw_object keeps culling on the cpu
+	VkPhysicalDeviceVulkan12Features supported12 = {};
+	supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	VkPhysicalDeviceFeatures2 supported = {};
+	supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	supported.pNext = &supported12;
+	vkGetPhysicalDeviceFeatures2(vkb_physicalDevice.physical_device, &supported);
+	_gpuCullSupported = supported.features.drawIndirectFirstInstance;
+
+	// descriptor indexing is core in 1.2 but each part of it stays optional
+	bool bindlessSupported = supported12.runtimeDescriptorArray && supported12.descriptorBindingPartiallyBound
+		&& supported12.descriptorBindingSampledImageUpdateAfterBind && supported12.shaderSampledImageArrayNonUniformIndexing;
+	if (_bindless && !bindlessSupported)
+	{
+		cout << "The GPU lacks descriptor indexing, --bindless is ignored" << endl;
+		_bindless = false;
+	}
+
+	bool anisotropySupported = supported.features.samplerAnisotropy;
+	_textureCompressionBC = supported.features.textureCompressionBC;
+
+	// with a features2 in the chain vk-bootstrap leaves pEnabledFeatures empty,
+	// core features are enabled here from now on
+	VkPhysicalDeviceFeatures2 features = {};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.features.drawIndirectFirstInstance = _gpuCullSupported;
+	features.features.samplerAnisotropy = anisotropySupported;
+	features.features.textureCompressionBC = _textureCompressionBC;
+
+	// timeline semaphores are core (and mandatory) in 1.2, the upload manager needs them
+	VkPhysicalDeviceVulkan12Features features12 = {};
+	features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	features12.timelineSemaphore = VK_TRUE;
+	features12.runtimeDescriptorArray = _bindless;
+	features12.descriptorBindingPartiallyBound = _bindless;
+	features12.descriptorBindingSampledImageUpdateAfterBind = _bindless;
+	features12.shaderSampledImageArrayNonUniformIndexing = _bindless;
+
 	vkb::DeviceBuilder deviceBuilder{ vkb_physicalDevice };
-	vkb::Device vkb_device = deviceBuilder.build().value();
+	vkb::Device vkb_device = deviceBuilder
+		.add_pNext(&features)
+		.add_pNext(&features12)
+		.build()
+		.value();
 	_device = vkb_device.device;
 	_choseGPU = vkb_physicalDevice.physical_device;
 
 	_graphicsQueue = vkb_device.get_queue(vkb::QueueType::graphics).value();
 	_graphicsQueueFamily = vkb_device.get_queue_index(vkb::QueueType::graphics).value();
 
+	// timestamps wrap at timestampValidBits, 0 bits means the queue has none
+	uint32_t family_count = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(vkb_physicalDevice.physical_device, &family_count, nullptr);
+	vector<VkQueueFamilyProperties> families(family_count);
+	vkGetPhysicalDeviceQueueFamilyProperties(vkb_physicalDevice.physical_device, &family_count, families.data());
+	uint32_t timestamp_bits = families[_graphicsQueueFamily].timestampValidBits;
+	_timestampMask = timestamp_bits >= 64 ? ~0ull : (1ull << timestamp_bits) - 1;
+
+	// prefer a transfer only family (the copy engine), uploads then run beside rendering
+	auto transfer_queue = vkb_device.get_dedicated_queue(vkb::QueueType::transfer);
+	if (transfer_queue)
+	{
+		_transferQueue = transfer_queue.value();
+		_transferQueueFamily = vkb_device.get_dedicated_queue_index(vkb::QueueType::transfer).value();
+	}
+	else
+	{
+		_transferQueue = _graphicsQueue;
+		_transferQueueFamily = _graphicsQueueFamily;
+	}
+
 	VmaAllocatorCreateInfo allocator_info = {};
 	allocator_info.instance = _instances;
 	allocator_info.device = _device;
@@ -68,20 +143,86 @@ void VulkanEngine::init_vulkan()
 		});
 
 	vkGetPhysicalDeviceProperties(_choseGPU, &_gpuProperties);
+	_timestampPeriod = _gpuProperties.limits.timestampPeriod;
 	cout << "The GPU has a minimum buffer alignment of " << _gpuProperties.limits.minUniformBufferOffsetAlignment << endl;
-	// Test;
+	if (anisotropySupported)
+	{
+		_maxAnisotropy = min(MAX_ANISOTROPY, _gpuProperties.limits.maxSamplerAnisotropy);
+	}
+
+	_upload.init(_device, _allocator, _transferQueue, _transferQueueFamily, _graphicsQueueFamily, UPLOAD_RING_SIZE);
+	_mainDeletionQueue.push_function([=]() {
+		_upload.cleanup();
+		});
+	cout << "Uploads use " << (_upload.dedicated_transfer() ? "a dedicated transfer queue" : "the graphics queue") << endl;
+	cout << "GPU culling " << (_gpuCullSupported ? "available" : "not supported, culling stays on the cpu") << endl;
+
+	_pipelineCache.init(_device, _gpuProperties, PIPELINE_CACHE_PATH);
+	_mainDeletionQueue.push_function([=]() {
+		_pipelineCache.cleanup();
+		});
+}
+
+void VulkanEngine::load_config()
+{
+	CPU_ZONE("load_config");
 	rapidjson::Document object_json;
 	VK_CHECK(file_box::readfile(object_json, "shader_config.json"));
-	vkinit::shadername_get(shader_name, shader_index, obj_name, texture_name, object_json);
+	vkinit::config_get(material_config, obj_name, obj_material, obj_texture, texture_name, object_json);
+
+	if (_benchmarkName.empty())
+	{
+		return;
+	}
+	// the scene replaces the command line stress, culling and streaming settings
+	rapidjson::Document benchmark_json;
+	VK_CHECK(file_box::readfile(benchmark_json, "benchmarks.json"));
+	if (!benchmark::parse_scene(benchmark_json, _benchmarkName, _benchmarkScene))
+	{
+		abort();
+	}
+	_stressObjectCount = _benchmarkScene.stressObjects;
+	_stressSeed = _benchmarkScene.seed;
+	_gpuCulling = _benchmarkScene.gpuCulling;
+	_textureStreaming = _textureStreaming && _benchmarkScene.textureStreaming;
+	_selectedShader = 0;
+	if (!_benchmarkScene.model.empty())
+	{
+		auto model = find(obj_name.begin(), obj_name.end(), _benchmarkScene.model);
+		if (model == obj_name.end())
+		{
+			cout << "benchmark scene " << _benchmarkScene.name << " draws " << _benchmarkScene.model
+				<< ", which shader_config.json does not load" << endl;
+			abort();
+		}
+		_selectedShader = static_cast<int>(model - obj_name.begin());
+	}
+	if (_benchmarkOutput.empty())
+	{
+		_benchmarkOutput = "benchmark_" + _benchmarkScene.name;
+	}
 }
 
 void VulkanEngine::init_swapchain()
 {
+	CPU_ZONE("init_swapchain");
+	if (_headless)
+	{
+		init_offscreen_targets();
+		return;
+	}
+	VkPresentModeKHR wanted = _presentMode;
+	_presentMode = frame_pacing::choose_present_mode(_choseGPU, _surface, wanted);
+	if (_presentMode != wanted)
+	{
+		cout << "present mode " << frame_pacing::present_mode_name(wanted) << " is not supported, using fifo" << endl;
+	}
+
 	vkb::SwapchainBuilder swapchainBuiler{ _choseGPU, _device, _surface };
 
 	vkb::Swapchain vkb_swapchain = swapchainBuiler
 		.use_default_format_selection()
-		.set_desired_present_mode(VK_PRESENT_MODE_FIFO_KHR)
+		.set_desired_present_mode(_presentMode)
 		.set_desired_extent(_windowExtent.width, _windowExtent.height)
 		.build()
 		.value();
@@ -92,23 +233,76 @@ void VulkanEngine::init_swapchain()
 
 	_swapchainImageFormat = vkb_swapchain.image_format;
 
-	_mainDeletionQueue.push_function([=]() {
-		vkDestroySwapchainKHR(_device, _swapchain, nullptr);
-		});
+	_mainDeletionQueue.push_swapchain(_swapchain);
+	init_depth_image();
+
+	if (_fpsCap < 0)
+	{
+		// fifo already blocks at the refresh rate, mailbox would render frames
+		// that get replaced before scanout, immediate stays uncapped for the lowest latency
+		_fpsCap = 0;
+		SDL_DisplayMode display_mode;
+		if (_presentMode == VK_PRESENT_MODE_MAILBOX_KHR && SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(_window), &display_mode) == 0)
+		{
+			_fpsCap = display_mode.refresh_rate;
+		}
+	}
+	_pacer.set_fps_cap(_fpsCap);
+	cout << "present mode " << frame_pacing::present_mode_name(_presentMode) << ", fps cap ";
+	if (_fpsCap > 0)
+	{
+		cout << _fpsCap << endl;
+	}
+	else
+	{
+		cout << "none" << endl;
+	}
+}
+
+void VulkanEngine::init_offscreen_targets()
+{
+	CPU_ZONE("init_offscreen_targets");
+	// stand in for the swapchain images, one per frame in flight so a frame
+	// never renders into an image the previous one still writes
+	VkExtent3D extent = {
+		_windowExtent.width,
+		_windowExtent.height,
+		1
+	};
+	_swapchainImageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+	VkImageCreateInfo image_info = vkinit::image_create_info(_swapchainImageFormat,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, extent);
+	VmaAllocationCreateInfo image_alloc_info = {};
+	image_alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+	_offscreenImages.resize(FRAME_OVERLAP);
+	for (AllocatedImage& image : _offscreenImages)
+	{
+		VK_CHECK(vmaCreateImage(_allocator, &image_info, &image_alloc_info,
+			&image._image, &image._allocation, nullptr));
+		_mainDeletionQueue.push_image(image._image, image._allocation);
+
+		VkImageViewCreateInfo view_info = vkinit::imageview_create_info(_swapchainImageFormat,
+			image._image, VK_IMAGE_ASPECT_COLOR_BIT);
+		VkImageView view;
+		VK_CHECK(vkCreateImageView(_device, &view_info, nullptr, &view));
+		// init_framebuffers destroys the views like the swapchain ones
+		_swapchainImages.push_back(image._image);
+		_swapchainImageViews.push_back(view);
+	}
 	init_depth_image();
 }
 
 void VulkanEngine::init_commands()
 {
+	CPU_ZONE("init_commands");
 	VkCommandPoolCreateInfo commandPoolInfo = 
 		vkinit::command_pool_create_info(_graphicsQueueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 	VkCommandPoolCreateInfo uploadCommandPoolInfo = 
 		vkinit::command_pool_create_info(_graphicsQueueFamily);
 	VK_CHECK(vkCreateCommandPool(_device, &uploadCommandPoolInfo, nullptr, &_uploadContext._commandPool));
 
-	_mainDeletionQueue.push_function([=]() {
-		vkDestroyCommandPool(_device, _uploadContext._commandPool, nullptr);
-		});
+	_mainDeletionQueue.push_command_pool(_uploadContext._commandPool);
 
 	for (int i = 0; i < FRAME_OVERLAP; i++)
 	{
@@ -118,14 +312,19 @@ void VulkanEngine::init_commands()
 			vkinit::command_buffer_allocate_info(_frames[i]._commandPool, 1);
 		VK_CHECK(vkAllocateCommandBuffers(_device, &cmbAllocateInfo, &_frames[i]._commandBuffer));
 
-		_mainDeletionQueue.push_function([=]() {
-			vkDestroyCommandPool(_device, _frames[i]._commandPool, nullptr);
-			});
+		_mainDeletionQueue.push_command_pool(_frames[i]._commandPool);
+
+		_frames[i]._gpuProfiler.init(_device, _timestampPeriod, _timestampMask);
+		if (_frames[i]._gpuProfiler.enabled())
+		{
+			_mainDeletionQueue.push_query_pool(_frames[i]._gpuProfiler.pool());
+		}
 	}
 }
 
 void VulkanEngine::init_default_renderpass()
 {
+	CPU_ZONE("init_default_renderpass");
 	VkAttachmentDescription color_attathment = {};
 	color_attathment.format = _swapchainImageFormat;
 	color_attathment.samples = VK_SAMPLE_COUNT_1_BIT;
@@ -134,7 +333,8 @@ void VulkanEngine::init_default_renderpass()
 	color_attathment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	color_attathment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	color_attathment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	color_attathment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	// PRESENT_SRC needs the swapchain extension, offscreen images end ready for a readback
+	color_attathment.finalLayout = _headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
 	VkAttachmentReference color_attachment_ref = {};
 	color_attachment_ref.attachment = 0;
@@ -173,13 +373,12 @@ void VulkanEngine::init_default_renderpass()
 
 	VK_CHECK(vkCreateRenderPass(_device, &render_pass_info, nullptr, &_renderPass));
 
-	_mainDeletionQueue.push_function([=]() {
-		vkDestroyRenderPass(_device, _renderPass, nullptr);
-		});
+	_mainDeletionQueue.push_render_pass(_renderPass);
 }
 
 void VulkanEngine::init_framebuffers()
 {
+	CPU_ZONE("init_framebuffers");
 	VkFramebufferCreateInfo framebuffer_info = vkinit::framebuffer_create_info(
 												_renderPass,
 												_windowExtent);
@@ -194,15 +393,14 @@ void VulkanEngine::init_framebuffers()
 		framebuffer_info.pAttachments = attachments;
 		VK_CHECK(vkCreateFramebuffer(_device, &framebuffer_info, nullptr, &_framebuffers[i]));
 		
-		_mainDeletionQueue.push_function([=]() {
-			vkDestroyFramebuffer(_device, _framebuffers[i], nullptr);
-			vkDestroyImageView(_device, _swapchainImageViews[i], nullptr);
-			});
+		_mainDeletionQueue.push_image_view(_swapchainImageViews[i]);
+		_mainDeletionQueue.push_framebuffer(_framebuffers[i]);
 	}
 }
 
 void VulkanEngine::init_sync_struct()
 {
+	CPU_ZONE("init_sync_struct");
 	//create syncronization structures
 	//one fence to control when the gpu has finished rendering the frame,
 	//and 2 semaphores to syncronize rendering with swapchain
@@ -213,26 +411,20 @@ void VulkanEngine::init_sync_struct()
 	VkSemaphoreCreateInfo sem_info = vkinit::semaphore_create_info();
 	
 	VK_CHECK(vkCreateFence(_device, &uploadFenceCreateInfo, nullptr, &_uploadContext._uploadFence));
-	_mainDeletionQueue.push_function([=]() {
-		vkDestroyFence(_device, _uploadContext._uploadFence, nullptr);
-		});
+	_mainDeletionQueue.push_fence(_uploadContext._uploadFence);
 
 	for (int i = 0; i < FRAME_OVERLAP; i++)
 	{
 		VK_CHECK(vkCreateFence(_device, &fence_info, nullptr, &_frames[i]._renderFence));
 
-		_mainDeletionQueue.push_function([=]() {
-			vkDestroyFence(_device, _frames[i]._renderFence, nullptr);
-			});
+		_mainDeletionQueue.push_fence(_frames[i]._renderFence);
 
 
 		VK_CHECK(vkCreateSemaphore(_device, &sem_info, nullptr, &_frames[i]._presentSem));
 		VK_CHECK(vkCreateSemaphore(_device, &sem_info, nullptr, &_frames[i]._renderSem));
 
-		_mainDeletionQueue.push_function([=]() {
-			vkDestroySemaphore(_device, _frames[i]._presentSem, nullptr);
-			vkDestroySemaphore(_device, _frames[i]._renderSem, nullptr);
-			});
+		_mainDeletionQueue.push_semaphore(_frames[i]._renderSem);
+		_mainDeletionQueue.push_semaphore(_frames[i]._presentSem);
 	}
 }
 
@@ -265,71 +457,9 @@ bool VulkanEngine::load_shader_module(const char* filePath, VkShaderModule* outS
 	return true;
 }
 
-bool VulkanEngine::shader_perpare(PipelineBuilder* pipelineBuilder)
-{
-	VkPipeline _trianglePipelines;
-	uint8_t shader_count = static_cast<uint8_t> (shader_index.size());
-	vector<VkShaderModule> targetShader(shader_count);
-	VertexInputDescription vertexDescription = Vertex::get_vertex_description();
-	for (uint16_t i = 0, j = 0; i < shader_count; i++)
-	{
-		int flag_build = i % 2;
-		string pathfile = "../../shaders/";
-		pathfile = pathfile + shader_name[shader_index[i]];
-		
-		pipelineBuilder->_vertexInputInfo.pVertexAttributeDescriptions = vertexDescription.attributes.data();
-		pipelineBuilder->_vertexInputInfo.vertexAttributeDescriptionCount = vertexDescription.attributes.size();
-		pipelineBuilder->_vertexInputInfo.pVertexBindingDescriptions = vertexDescription.bindings.data();
-		pipelineBuilder->_vertexInputInfo.vertexBindingDescriptionCount = vertexDescription.bindings.size();
-		
-		if (i < 6)
-		{
-			pipelineBuilder->_pipelineLayout = _meshPipelineLayout;
-		}
-		else
-		{
-			pipelineBuilder->_pipelineLayout = _texturedPipeLayout;
-		}
-		
-		if (!load_shader_module(pathfile.c_str(), &targetShader[i]))
-		{
-			cout << "Error when building the shader module" << endl;
-		}
-		else {
-			cout << "Triangle fragment shader successfully loaded" << endl;
-		}
-		VkShaderStageFlagBits flag = VK_SHADER_STAGE_VERTEX_BIT;
-		
-		if (flag_build){
-			flag = VK_SHADER_STAGE_FRAGMENT_BIT;
-		}
-		pipelineBuilder->_shaderStages.push_back(vkinit::pipeline_shader_stage_create_info(flag, targetShader[i]));
-
-		if (flag_build){
-			pipelineBuilder->_depthStencil = vkinit::depth_stencil_create_info(true, true, VK_COMPARE_OP_LESS_OR_EQUAL);
-			_trianglePipelines = pipelineBuilder->build_pipline(_device, _renderPass);
-			if (i == 7)
-			{
-				create_material(_trianglePipelines, _texturedPipeLayout, "texturedmesh");
-			}
-			else
-				create_material(_trianglePipelines, _meshPipelineLayout, "defaultmesh");
-			pipelineBuilder->_shaderStages.clear();
-
-			_mainDeletionQueue.push_function([=]() {
-				vkDestroyPipeline(_device, _trianglePipelines, nullptr);
-				});
-
-			vkDestroyShaderModule(_device, targetShader[i], nullptr);
-			vkDestroyShaderModule(_device, targetShader[i-1], nullptr);
-		}
-		
-	}
-	return VK_TRUE;
-}
-
 void VulkanEngine::init_pipelines()
 {
+	CPU_ZONE("init_pipelines");
 	VkPipelineLayoutCreateInfo mesh_pipeline_layout_info = vkinit::pipeline_layout_create_info();
 
 	vector<VkPushConstantRange> push_constant;
@@ -352,32 +482,298 @@ void VulkanEngine::init_pipelines()
 	textured_pipeline_layout_info.setLayoutCount = 2;
 	VK_CHECK(vkCreatePipelineLayout(_device, &textured_pipeline_layout_info, nullptr, &_texturedPipeLayout));
 
-	PipelineBuilder pipelineBuilder;
-	pipelineBuilder._vertexInputInfo = vkinit::vertex_input_state_create_info();
-	pipelineBuilder._inputAssmbly = vkinit::input_assembly_create_info(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+	_mainDeletionQueue.push_pipeline_layout(_texturedPipeLayout);
+	_mainDeletionQueue.push_pipeline_layout(_meshPipelineLayout);
+
+	// the "layout" of a material entry
+	_pipelineLayouts = {
+		{ "mesh", _meshPipelineLayout },
+		{ "textured", _texturedPipeLayout }
+	};
+
+	if (_bindless)
+	{
+		VkPipelineLayoutCreateInfo bindless_pipeline_layout_info = mesh_pipeline_layout_info;
+		VkDescriptorSetLayout bindlessLayouts[] = { _globalSetLayout, _bindlessSetLayout };
+		bindless_pipeline_layout_info.pSetLayouts = bindlessLayouts;
+		bindless_pipeline_layout_info.setLayoutCount = 2;
+		VK_CHECK(vkCreatePipelineLayout(_device, &bindless_pipeline_layout_info, nullptr, &_bindlessPipelineLayout));
+		_mainDeletionQueue.push_pipeline_layout(_bindlessPipelineLayout);
+		_pipelineLayouts["bindless"] = _bindlessPipelineLayout;
+	}
+
+	// every spv file is loaded once, however many materials share it
+	for (const MaterialConfig& config : material_config)
+	{
+		_shaderModules.emplace(config.vertexShader, VK_NULL_HANDLE);
+		_shaderModules.emplace(config.fragmentShader, VK_NULL_HANDLE);
+	}
+	JobCounter shaderJobs;
+	for (auto& module : _shaderModules)
+	{
+		_jobs.run(shaderJobs, [this, &module]() {
+			string pathfile = "../../shaders/" + module.first;
+			if (!load_shader_module(pathfile.c_str(), &module.second))
+			{
+				module.second = VK_NULL_HANDLE;
+			}
+			});
+	}
+	_jobs.wait(shaderJobs);
+	for (auto& module : _shaderModules)
+	{
+		if (module.second == VK_NULL_HANDLE)
+		{
+			cout << "Error when building the shader module " << module.first << endl;
+		}
+	}
+	// pipelines may still compile from them until cleanup
+	_mainDeletionQueue.push_function([=]() {
+		for (auto& module : _shaderModules)
+		{
+			vkDestroyShaderModule(_device, module.second, nullptr);
+		}
+		});
+
+	// state shared by every material, each compile copies it into its own builder
+	_vertexDescription = Vertex::get_vertex_description();
+	_basePipelineBuilder._vertexInputInfo = vkinit::vertex_input_state_create_info();
+	_basePipelineBuilder._vertexInputInfo.pVertexAttributeDescriptions = _vertexDescription.attributes.data();
+	_basePipelineBuilder._vertexInputInfo.vertexAttributeDescriptionCount = _vertexDescription.attributes.size();
+	_basePipelineBuilder._vertexInputInfo.pVertexBindingDescriptions = _vertexDescription.bindings.data();
+	_basePipelineBuilder._vertexInputInfo.vertexBindingDescriptionCount = _vertexDescription.bindings.size();
+	_basePipelineBuilder._inputAssmbly = vkinit::input_assembly_create_info(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
 	
-	VK_CHECK(vkinit::pipeline_get_viewport(&pipelineBuilder, _windowExtent););
+	VK_CHECK(vkinit::pipeline_get_viewport(&_basePipelineBuilder, _windowExtent););
 
 	VkRect2D scissor_set;
 	scissor_set.offset = { 0, 0 };
 	scissor_set.extent = _windowExtent;
-	VK_CHECK(vkinit::pipeline_get_scissor(&pipelineBuilder, scissor_set));
+	VK_CHECK(vkinit::pipeline_get_scissor(&_basePipelineBuilder, scissor_set));
 
-	pipelineBuilder._rasterier = vkinit::rasterization_state_create_info(VK_POLYGON_MODE_FILL);
-	pipelineBuilder._mulsampling = vkinit::multisampling_state_create_info();
-	pipelineBuilder._colorBlendAttachment = vkinit::color_blend_attachment_state();
+	_basePipelineBuilder._mulsampling = vkinit::multisampling_state_create_info();
 
-	// load all shader module
-	shader_perpare(&pipelineBuilder);
-	
+	// _pipelineStates owns every graphics pipeline, shared ones are destroyed once
 	_mainDeletionQueue.push_function([=]() {
-		vkDestroyPipelineLayout(_device, _meshPipelineLayout, nullptr);
-		vkDestroyPipelineLayout(_device, _texturedPipeLayout, nullptr);
+		for (auto& state : _pipelineStates)
+		{
+			vkDestroyPipeline(_device, state.second, nullptr);
+		}
+		_pipelineStates.clear();
+		});
+
+	// every material exists right away without a pipeline, get_material queues
+	// its compile and draws use the fallback until it is published
+	for (size_t i = 0; i < material_config.size(); i++)
+	{
+		const MaterialConfig& config = material_config[i];
+		auto layout = _pipelineLayouts.find(config.layout);
+		_pipelineJobs.push_back(make_unique<PipelineJob>());
+		if (layout == _pipelineLayouts.end())
+		{
+			// the bindless materials without --bindless, never compiled
+			_pipelineJobs.back()->state.store(PipelineState::Published);
+			continue;
+		}
+		Material* material = create_material(VK_NULL_HANDLE, layout->second, config.name);
+		material->config = static_cast<int>(i);
+	}
+
+	// the fallback is the only pipeline startup waits for
+	_fallbackMaterial = get_material(FALLBACK_MATERIAL);
+	if (_fallbackMaterial)
+	{
+		_jobs.wait(_pipelineCompiles);
+		publish_pipelines();
+	}
+	if (!_fallbackMaterial || _fallbackMaterial->pipeline == VK_NULL_HANDLE)
+	{
+		cout << "the fallback material " << FALLBACK_MATERIAL << " did not build, unready materials are skipped" << endl;
+	}
+}
+
+VkPipeline VulkanEngine::build_material_pipeline(size_t index)
+{
+	CPU_ZONE("build_material_pipeline");
+	const MaterialConfig& config = material_config[index];
+	auto layout = _pipelineLayouts.find(config.layout);
+	VkShaderModule vertexShader = _shaderModules.at(config.vertexShader);
+	VkShaderModule fragmentShader = _shaderModules.at(config.fragmentShader);
+	if (layout == _pipelineLayouts.end() || vertexShader == VK_NULL_HANDLE || fragmentShader == VK_NULL_HANDLE)
+	{
+		return VK_NULL_HANDLE;
+	}
+
+	PipelineBuilder pipelineBuilder = _basePipelineBuilder;
+	pipelineBuilder._shaderStages.push_back(vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_VERTEX_BIT, vertexShader));
+	pipelineBuilder._shaderStages.push_back(vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_FRAGMENT_BIT, fragmentShader));
+	pipelineBuilder._pipelineLayout = layout->second;
+	pipelineBuilder._rasterier = vkinit::rasterization_state_create_info(config.polygonMode);
+	pipelineBuilder._rasterier.cullMode = config.cullMode;
+	pipelineBuilder._depthStencil = vkinit::depth_stencil_create_info(config.depthTest, config.depthWrite, config.depthCompare);
+	pipelineBuilder._colorBlendAttachment = vkinit::color_blend_attachment_state();
+	if (config.blend)
+	{
+		// straight alpha
+		pipelineBuilder._colorBlendAttachment.blendEnable = VK_TRUE;
+		pipelineBuilder._colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+		pipelineBuilder._colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		pipelineBuilder._colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+		pipelineBuilder._colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		pipelineBuilder._colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+		pipelineBuilder._colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+	}
+	return get_pipeline(pipelineBuilder);
+}
+
+VkPipeline VulkanEngine::get_pipeline(const PipelineBuilder& builder)
+{
+	PipelineKey key = builder.key(_renderPass);
+	{
+		lock_guard<mutex> lock(_pipelineStatesLock);
+		auto it = _pipelineStates.find(key);
+		if (it != _pipelineStates.end())
+		{
+			_pipelineHits++;
+			return it->second;
+		}
+	}
+	_pipelineMisses++;
+
+	// compiled outside the lock, an identical compile racing this one loses and is dropped
+	VkPipeline pipeline = builder.build_pipline(_device, _renderPass, _pipelineCache.cache());
+	if (pipeline == VK_NULL_HANDLE)
+	{
+		return VK_NULL_HANDLE;
+	}
+	lock_guard<mutex> lock(_pipelineStatesLock);
+	auto inserted = _pipelineStates.emplace(move(key), pipeline);
+	if (!inserted.second)
+	{
+		vkDestroyPipeline(_device, pipeline, nullptr);
+	}
+	return inserted.first->second;
+}
+
+void VulkanEngine::request_pipeline(int index)
+{
+	if (index < 0 || index >= static_cast<int>(_pipelineJobs.size()))
+	{
+		return;
+	}
+	PipelineJob* job = _pipelineJobs[index].get();
+	PipelineState idle = PipelineState::Idle;
+	if (!job->state.compare_exchange_strong(idle, PipelineState::Compiling))
+	{
+		return;
+	}
+	// the driver compiles inside vkCreateGraphicsPipelines, off the main thread
+	_jobs.run(_pipelineCompiles, [this, job, index]() {
+		job->pipeline = build_material_pipeline(index);
+		job->state.store(job->pipeline != VK_NULL_HANDLE ? PipelineState::Ready : PipelineState::Failed,
+			memory_order_release);
 		});
+}
+
+void VulkanEngine::request_all_pipelines()
+{
+	for (size_t i = 0; i < _pipelineJobs.size(); i++)
+	{
+		request_pipeline(static_cast<int>(i));
+	}
+}
+
+void VulkanEngine::publish_pipelines()
+{
+	uint32_t pending = 0;
+	for (size_t i = 0; i < _pipelineJobs.size(); i++)
+	{
+		PipelineJob* job = _pipelineJobs[i].get();
+		PipelineState state = job->state.load(memory_order_acquire);
+		if (state == PipelineState::Ready)
+		{
+			const MaterialConfig& config = material_config[i];
+			get_material(config.name)->pipeline = job->pipeline;
+			job->state.store(PipelineState::Published);
+		}
+		else if (state == PipelineState::Failed)
+		{
+			const MaterialConfig& config = material_config[i];
+			cout << "Error when building the pipeline of material " << config.name << " ("
+				<< config.vertexShader << ", " << config.fragmentShader << ", layout " << config.layout << ")" << endl;
+			job->state.store(PipelineState::Published);
+		}
+		else if (state != PipelineState::Published)
+		{
+			pending++;
+		}
+	}
+	_stats.pendingPipelines = pending;
+}
+
+namespace {
+	template<typename T>
+	void append_key(std::vector<uint8_t>& bytes, const T& value)
+	{
+		const uint8_t* data = reinterpret_cast<const uint8_t*>(&value);
+		bytes.insert(bytes.end(), data, data + sizeof(T));
+	}
+}
 
+PipelineKey PipelineBuilder::key(VkRenderPass renderpass) const
+{
+	// field by field, the create info structs carry pNext pointers and padding
+	PipelineKey key;
+	vector<uint8_t>& bytes = key.bytes;
+	for (const VkPipelineShaderStageCreateInfo& stage : _shaderStages)
+	{
+		append_key(bytes, stage.stage);
+		append_key(bytes, stage.module);
+	}
+	for (uint32_t i = 0; i < _vertexInputInfo.vertexBindingDescriptionCount; i++)
+	{
+		append_key(bytes, _vertexInputInfo.pVertexBindingDescriptions[i]);
+	}
+	for (uint32_t i = 0; i < _vertexInputInfo.vertexAttributeDescriptionCount; i++)
+	{
+		append_key(bytes, _vertexInputInfo.pVertexAttributeDescriptions[i]);
+	}
+	append_key(bytes, _inputAssmbly.topology);
+	append_key(bytes, _inputAssmbly.primitiveRestartEnable);
+	append_key(bytes, _viewport);
+	append_key(bytes, _scissor);
+	append_key(bytes, _rasterier.depthClampEnable);
+	append_key(bytes, _rasterier.rasterizerDiscardEnable);
+	append_key(bytes, _rasterier.polygonMode);
+	append_key(bytes, _rasterier.cullMode);
+	append_key(bytes, _rasterier.frontFace);
+	append_key(bytes, _rasterier.depthBiasEnable);
+	append_key(bytes, _rasterier.depthBiasConstantFactor);
+	append_key(bytes, _rasterier.depthBiasClamp);
+	append_key(bytes, _rasterier.depthBiasSlopeFactor);
+	append_key(bytes, _rasterier.lineWidth);
+	append_key(bytes, _colorBlendAttachment);
+	append_key(bytes, _depthStencil.depthTestEnable);
+	append_key(bytes, _depthStencil.depthWriteEnable);
+	append_key(bytes, _depthStencil.depthCompareOp);
+	append_key(bytes, _depthStencil.depthBoundsTestEnable);
+	append_key(bytes, _depthStencil.stencilTestEnable);
+	append_key(bytes, _depthStencil.front);
+	append_key(bytes, _depthStencil.back);
+	append_key(bytes, _depthStencil.minDepthBounds);
+	append_key(bytes, _depthStencil.maxDepthBounds);
+	append_key(bytes, _mulsampling.rasterizationSamples);
+	append_key(bytes, _mulsampling.sampleShadingEnable);
+	append_key(bytes, _mulsampling.minSampleShading);
+	append_key(bytes, _mulsampling.alphaToCoverageEnable);
+	append_key(bytes, _mulsampling.alphaToOneEnable);
+	append_key(bytes, _pipelineLayout);
+	append_key(bytes, renderpass);
+	key.hash = file_box::hash_bytes(bytes.data(), bytes.size());
+	return key;
 }
 
-VkPipeline PipelineBuilder::build_pipline(VkDevice device, VkRenderPass renderpass)
+VkPipeline PipelineBuilder::build_pipline(VkDevice device, VkRenderPass renderpass, VkPipelineCache cache)
 {
 	VkPipelineViewportStateCreateInfo viewportState = {};
 	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
@@ -418,7 +814,7 @@ VkPipeline PipelineBuilder::build_pipline(VkDevice device, VkRenderPass renderpa
 
 	VkPipeline newPipeline;
 	if (vkCreateGraphicsPipelines(
-		device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &newPipeline) != VK_SUCCESS) {
+		device, cache, 1, &pipeline_info, nullptr, &newPipeline) != VK_SUCCESS) {
 		cout << "failed to create pipeline\n";
 		return VK_NULL_HANDLE; // failed to create graphics pipeline
 	}
@@ -432,6 +828,7 @@ VkPipeline PipelineBuilder::build_pipline(VkDevice device, VkRenderPass renderpa
 
 void VulkanEngine::init_depth_image()
 {
+	CPU_ZONE("init_depth_image");
 	VkExtent3D depthImageExtent = {
 		_windowExtent.width,
 		_windowExtent.height,
@@ -451,10 +848,8 @@ void VulkanEngine::init_depth_image()
 		_depthImage._image, VK_IMAGE_ASPECT_DEPTH_BIT);
 
 	VK_CHECK(vkCreateImageView(_device, &depthview_info, nullptr, &_depthImageView));
-	_mainDeletionQueue.push_function([=]() {
-		vkDestroyImageView(_device, _depthImageView, nullptr);
-		vmaDestroyImage(_allocator, _depthImage._image, _depthImage._allocation);
-		});
+	_mainDeletionQueue.push_image(_depthImage._image, _depthImage._allocation);
+	_mainDeletionQueue.push_image_view(_depthImageView);
 }
 
 void VulkanEngine::immediate_submit(std::function<void(VkCommandBuffer cmd)>&& function)
@@ -492,37 +887,29 @@ void VulkanEngine::immediate_submit(std::function<void(VkCommandBuffer cmd)>&& f
 
 void VulkanEngine::upload_mesh(Mesh& mesh)
 {
-	VkBufferCreateInfo staging_info = vkinit::buffer_create_info(
-										VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-										VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-										mesh._vertices.size() * sizeof(Vertex)
-									);
-	// allocation not allocator
-	VmaAllocationCreateInfo vmaalloc_info = {};
-	vmaalloc_info.usage = VMA_MEMORY_USAGE_CPU_ONLY;
-	AllocatedBuffer stagingBuffer;
-
-	VK_CHECK(vmaCreateBuffer(_allocator,
-		&staging_info,
-		&vmaalloc_info,
-		&stagingBuffer._buffer,
-		&stagingBuffer._allocation,
-		nullptr));
+	upload_mesh(mesh, [&](char* data) {
+		memcpy(data, mesh._vertices.data(), mesh.vertex_bytes());
+		mesh.copy_indices(data + mesh.vertex_bytes());
+		});
+}
 
+void VulkanEngine::upload_mesh(Mesh& mesh, std::function<void(char* staging)>&& write_staging)
+{
+	const size_t vertex_bytes = mesh.vertex_bytes();
+	const size_t index_bytes = mesh.index_bytes();
+	// vertices and indices share one staging region, indices start right after the vertices
+	StagingRegion staging = _upload.stage(vertex_bytes + index_bytes);
+	write_staging(staging.data);
 
-	
-	void* data;
-	vmaMapMemory(_allocator, stagingBuffer._allocation, &data);
-	memcpy(data, mesh._vertices.data(), mesh._vertices.size() * sizeof(Vertex));
-	vmaUnmapMemory(_allocator, stagingBuffer._allocation);
+	VmaAllocationCreateInfo vmaalloc_info = {};
+	vmaalloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
 
 	VkBufferCreateInfo buffer_info = vkinit::buffer_create_info(
 										VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
 										VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-										mesh._vertices.size() * sizeof(Vertex)
+										vertex_bytes
 									);
-
-	vmaalloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	_upload.share(buffer_info);
 
 	VK_CHECK(vmaCreateBuffer(_allocator,
 		&buffer_info,
@@ -531,72 +918,514 @@ void VulkanEngine::upload_mesh(Mesh& mesh)
 		&mesh._vertexBuffer._allocation,
 		nullptr));
 
-	immediate_submit([=](VkCommandBuffer cmd) {
-		VkBufferCopy copy;
-		copy.dstOffset = 0;
-		copy.srcOffset = 0;
-		copy.size = mesh._vertices.size() * sizeof(Vertex);
-		vkCmdCopyBuffer(cmd, stagingBuffer._buffer, mesh._vertexBuffer._buffer, 1, &copy);
-		});
-	_mainDeletionQueue.push_function([=]() {
-		vmaDestroyBuffer(_allocator, mesh._vertexBuffer._buffer, mesh._vertexBuffer._allocation);
-		});
+	VkBufferCreateInfo index_info = vkinit::buffer_create_info(
+										VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+										VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+										index_bytes
+									);
+	_upload.share(index_info);
 
-	vmaDestroyBuffer(_allocator, stagingBuffer._buffer, stagingBuffer._allocation);
-}
+	VK_CHECK(vmaCreateBuffer(_allocator,
+		&index_info,
+		&vmaalloc_info,
+		&mesh._indexBuffer._buffer,
+		&mesh._indexBuffer._allocation,
+		nullptr));
 
-void VulkanEngine::load_images()
-{
-	Texture texture_object;
-	for (string textureName : texture_name)
-	{
-		string Path = "../../assets/" + textureName;
-		file_box::load_image_from_file(*this, Path.c_str(), texture_object.image);
-		VkImageViewCreateInfo imageinfo = vkinit::imageview_create_info(
-											VK_FORMAT_R8G8B8A8_SRGB, 
-											texture_object.image._image, 
-											VK_IMAGE_ASPECT_COLOR_BIT
-											);
-		vkCreateImageView(_device, &imageinfo, nullptr, &texture_object.imageView);
-		_mainDeletionQueue.push_function([=]() {
-			vkDestroyImageView(_device, texture_object.imageView, nullptr);
-		});
-		_loadedTextures[textureName] = texture_object;
-	}
+	_upload.copy_buffer(staging, 0, mesh._vertexBuffer._buffer, 0, vertex_bytes);
+	_upload.copy_buffer(staging, vertex_bytes, mesh._indexBuffer._buffer, 0, index_bytes);
+	mesh._uploadToken = _upload.token();
 
+	AllocatedBuffer vertexBuffer = mesh._vertexBuffer;
+	AllocatedBuffer indexBuffer = mesh._indexBuffer;
+	_mainDeletionQueue.push_buffer(indexBuffer._buffer, indexBuffer._allocation);
+	_mainDeletionQueue.push_buffer(vertexBuffer._buffer, vertexBuffer._allocation);
 }
 
-void VulkanEngine::load_mesh()
+void VulkanEngine::kick_asset_loading()
 {
-	////make the array 3 vertices long
-	//_triangleMesh._vertices.resize(3);
-
-	////vertex positions
-	//_triangleMesh._vertices[0].position = { 1.f, 1.f, 0.0f };
-	//_triangleMesh._vertices[1].position = { -1.f, 1.f, 0.0f };
-	//_triangleMesh._vertices[2].position = { 0.f,-1.f, 0.0f };
-
-	////vertex colors, all green
-	//_triangleMesh._vertices[0].color = { 0.f, 1.f, 0.0f }; //pure green
-	//_triangleMesh._vertices[1].color = { 0.f, 1.f, 0.0f }; //pure green
-	//_triangleMesh._vertices[2].color = { 0.f, 1.f, 0.0f }; //pure green
-
-	//we don't care about the vertex normals
-	string file_path = "../../assets/";
-	for (string objname: obj_name)
+	CPU_ZONE("kick_asset_loading");
+	// decode and parse on the workers while the main thread creates the vulkan objects,
+	// load_images/load_mesh only wait for the results and record the uploads
+	_pendingTextures.resize(texture_name.size());
+	for (size_t i = 0; i < texture_name.size(); i++)
 	{
-		Mesh mesh_each;
-		string file = file_path + objname;
-		mesh_each.load_from_obj(file.c_str());
-		upload_mesh(mesh_each);
-		_meshSet[objname] = mesh_each;
+		_jobs.run(_assetJobs, [this, i]() {
+			CPU_ZONE_DYNAMIC("load " + texture_name[i]);
+			auto start = chrono::steady_clock::now();
+			string Path = "../../assets/" + texture_name[i];
+			DecodedImage& decoded = _pendingTextures[i];
+			if (file_box::decode_image(Path.c_str(), decoded, _compressedTextures) != VK_SUCCESS)
+			{
+				cout << "failed to load texture " << texture_name[i] << endl;
+			}
+			_startup.record((decoded.file ? "map " : "decode ") + texture_name[i], start, chrono::steady_clock::now());
+			});
 	}
-}
-
-FrameData& VulkanEngine::get_current_frame()
-{
-	return _frames[_frameNumber % FRAME_OVERLAP];
-}
+
+	// several files are parsed at once, so each parse gets a share of the cores
+	unsigned parse_threads = max(1u, (_jobs.worker_count() + 1) / max<unsigned>(1u, static_cast<unsigned>(obj_name.size())));
+	for (const string& objname : obj_name)
+	{
+		_pendingMeshes.push_back(make_unique<PendingMesh>());
+		PendingMesh* pending = _pendingMeshes.back().get();
+		pending->name = objname;
+		_jobs.run(_assetJobs, [this, pending, parse_threads]() {
+			CPU_ZONE_DYNAMIC("load " + pending->name);
+			auto start = chrono::steady_clock::now();
+			string file = "../../assets/" + pending->name;
+
+			// fast path: the upload copies the cached blobs straight from the mapping
+			pending->cache = mesh_cache::open(file, pending->cacheFile, pending->mesh);
+			if (pending->cache)
+			{
+				pending->loaded = true;
+				_startup.record("map " + mesh_cache::cache_path(pending->name), start, chrono::steady_clock::now());
+				return;
+			}
+
+			pending->loaded = pending->mesh.load_from_obj(file.c_str(), parse_threads);
+			if (pending->loaded && !mesh_cache::write(file, pending->mesh))
+			{
+				cout << pending->name << ": failed to write " << mesh_cache::cache_path(pending->name) << endl;
+			}
+			_startup.record("parse " + pending->name, start, chrono::steady_clock::now());
+			});
+	}
+}
+
+void VulkanEngine::load_images()
+{
+	CPU_ZONE("load_images");
+	_jobs.wait(_assetJobs);
+	// the bindless array slots are written once, those textures stay fully resident
+	_textureStreaming = _textureStreaming && !_bindless;
+	Texture texture_object;
+	for (size_t i = 0; i < texture_name.size(); i++)
+	{
+		const string& textureName = texture_name[i];
+		DecodedImage& decoded = _pendingTextures[i];
+		if (ktx2::is_block_compressed(decoded.format) && !_textureCompressionBC)
+		{
+			// the workers ran before the device was picked
+			cout << textureName << ": no BC support, decoding the png" << endl;
+			file_box::free_image(decoded);
+			string Path = "../../assets/" + textureName;
+			file_box::decode_image(Path.c_str(), decoded);
+		}
+		if (decoded.levels.empty())
+		{
+			continue;
+		}
+		cout << textureName << ": " << ktx2::format_name(decoded.format) << " " << decoded.width << "x" << decoded.height
+			<< ", " << decoded.mip_levels() << " levels, " << decoded.byte_size() / 1024 << " KiB" << endl;
+		// past the device limit a texture falls back to slot 0, an unwritten slot is undefined to read
+		bool bindlessSlot = _bindless && _bindlessTextureCount < _bindlessCapacity;
+		texture_object.bindlessIndex = bindlessSlot ? _bindlessTextureCount : 0;
+		if (_bindless && !bindlessSlot)
+		{
+			cout << textureName << ": all " << _bindlessCapacity << " bindless slots are taken, drawn with slot 0" << endl;
+		}
+
+		if (_textureStreaming)
+		{
+			// only the small mips now, update_texture_streaming brings in the rest
+			StreamedTexture streamed;
+			streamed.name = textureName;
+			streamed.source = move(decoded);
+			uint32_t first = 0;
+			while (first + 1 < streamed.source.mip_levels()
+				&& max(streamed.source.levels[first].width, streamed.source.levels[first].height) > STREAMING_FIRST_SIZE)
+			{
+				first++;
+			}
+			texture_object.streamIndex = static_cast<int>(_streamedTextures.size());
+			_loadedTextures[textureName] = texture_object;
+			_streamedTextures.push_back(move(streamed));
+			start_texture_load(_streamedTextures.back(), first);
+			swap_streamed_texture(static_cast<int>(_streamedTextures.size()) - 1);
+			texture_object = _loadedTextures[textureName];
+		}
+		else
+		{
+			texture_object.upload = file_box::upload_image(*this, decoded, texture_object.image);
+			texture_object.mipLevels = decoded.mip_levels();
+			VkFormat textureFormat = decoded.format;
+			file_box::free_image(decoded);
+
+			VkImageViewCreateInfo imageinfo = vkinit::imageview_create_info(
+												textureFormat, 
+												texture_object.image._image, 
+												VK_IMAGE_ASPECT_COLOR_BIT
+												);
+			imageinfo.subresourceRange.levelCount = texture_object.mipLevels;
+			vkCreateImageView(_device, &imageinfo, nullptr, &texture_object.imageView);
+			_mainDeletionQueue.push_image(texture_object.image._image, texture_object.image._allocation);
+			_mainDeletionQueue.push_image_view(texture_object.imageView);
+			_loadedTextures[textureName] = texture_object;
+		}
+
+		if (bindlessSlot)
+		{
+			// update after bind, the slot could be filled even while the set is in use
+			VkDescriptorImageInfo image_info = {};
+			image_info.sampler = VK_NULL_HANDLE;
+			image_info.imageView = texture_object.imageView;
+			image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			VkWriteDescriptorSet textureWrite = vkinit::write_descriptor_image(
+												VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, _bindlessSet, &image_info, 1);
+			textureWrite.dstArrayElement = _bindlessTextureCount;
+			vkUpdateDescriptorSets(_device, 1, &textureWrite, 0, nullptr);
+			// tokens grow monotonically, the last one completing means all did
+			_bindlessUpload = texture_object.upload;
+			_bindlessTextureCount++;
+		}
+	}
+	_pendingTextures.clear();
+
+	if (_textureStreaming)
+	{
+		_mainDeletionQueue.push_function([=]() {
+			for (StreamedTexture& streamed : _streamedTextures)
+			{
+				destroy_texture(_loadedTextures[streamed.name]);
+				if (streamed.loading)
+				{
+					destroy_texture(streamed.loadingTexture);
+				}
+			}
+			_streamedTextures.clear();
+			});
+	}
+}
+
+void VulkanEngine::destroy_texture(const Texture& texture)
+{
+	vkDestroyImageView(_device, texture.imageView, nullptr);
+	vmaDestroyImage(_allocator, texture.image._image, texture.image._allocation);
+}
+
+void VulkanEngine::start_texture_load(StreamedTexture& streamed, uint32_t level)
+{
+	Texture& texture = streamed.loadingTexture;
+	texture.upload = file_box::upload_image(*this, streamed.source, texture.image, level);
+	texture.mipLevels = streamed.source.mip_levels() - level;
+
+	VkImageViewCreateInfo imageinfo = vkinit::imageview_create_info(
+										streamed.source.format, 
+										texture.image._image, 
+										VK_IMAGE_ASPECT_COLOR_BIT
+										);
+	imageinfo.subresourceRange.levelCount = texture.mipLevels;
+	VK_CHECK(vkCreateImageView(_device, &imageinfo, nullptr, &texture.imageView));
+
+	VmaAllocationInfo allocation_info;
+	vmaGetAllocationInfo(_allocator, texture.image._allocation, &allocation_info);
+	streamed.loading = true;
+	streamed.loadingLevel = level;
+	streamed.loadingBytes = allocation_info.size;
+
+	const VkPhysicalDeviceMemoryProperties* memory_properties;
+	vmaGetMemoryProperties(_allocator, &memory_properties);
+	_textureHeap = memory_properties->memoryTypes[allocation_info.memoryType].heapIndex;
+}
+
+void VulkanEngine::swap_streamed_texture(int index)
+{
+	StreamedTexture& streamed = _streamedTextures[index];
+	Texture& current = _loadedTextures[streamed.name];
+	if (streamed.residentBytes > 0)
+	{
+		// flushed when this frame slot is reused, every frame up to this one is done by then,
+		// so this must run after draw() flushed the queue
+		get_current_frame()._deletionQueue.push_image(current.image._image, current.image._allocation);
+		get_current_frame()._deletionQueue.push_image_view(current.imageView);
+		streamed.settledFrame = _frameNumber + static_cast<int>(FRAME_OVERLAP);
+	}
+
+	Texture texture = streamed.loadingTexture;
+	texture.bindlessIndex = current.bindlessIndex;
+	texture.streamIndex = index;
+	current = texture;
+	streamed.residentLevel = streamed.loadingLevel;
+	streamed.residentBytes = streamed.loadingBytes;
+	streamed.loading = false;
+
+	// the other set was last used before the previous swap, no frame in flight has it
+	for (TextureBinding& binding : _textureBindings)
+	{
+		if (binding.streamedTexture != index)
+		{
+			continue;
+		}
+		binding.current = (binding.current + 1) % 2;
+		VkDescriptorImageInfo image_info;
+		image_info.sampler = binding.sampler;
+		image_info.imageView = texture.imageView;
+		image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		VkWriteDescriptorSet textureWrite = vkinit::write_descriptor_image(
+											VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+											binding.sets[binding.current], &image_info, 0);
+		vkUpdateDescriptorSets(_device, 1, &textureWrite, 0, nullptr);
+		binding.material->textureSet = binding.sets[binding.current];
+		binding.material->textureUpload = texture.upload;
+	}
+}
+
+void VulkanEngine::bind_texture(Material* material, const string& name, VkSampler sampler)
+{
+	auto texture = _loadedTextures.find(name);
+	if (texture == _loadedTextures.end())
+	{
+		cout << "no texture " << name << " to bind" << endl;
+		return;
+	}
+
+	TextureBinding binding;
+	binding.material = material;
+	binding.streamedTexture = texture->second.streamIndex;
+	binding.sampler = sampler;
+	// a fixed texture only ever uses the first set
+	uint32_t set_count = binding.streamedTexture >= 0 ? 2 : 1;
+	for (uint32_t i = 0; i < set_count; i++)
+	{
+		if (!_descriptorAllocator.allocate(&binding.sets[i], _singleTextureSetLayout))
+		{
+			cout << "failed to allocate the texture descriptor set" << endl;
+			return;
+		}
+	}
+
+	VkDescriptorImageInfo image_info;
+	image_info.sampler = sampler;
+	image_info.imageView = texture->second.imageView;
+	image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	VkWriteDescriptorSet textureWrite = vkinit::write_descriptor_image(
+										VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 
+										binding.sets[0], 
+										&image_info, 0
+									);
+	vkUpdateDescriptorSets(_device, 1, &textureWrite, 0, nullptr);
+	material->textureSet = binding.sets[0];
+	material->textureUpload = texture->second.upload;
+	if (binding.streamedTexture >= 0)
+	{
+		_textureBindings.push_back(binding);
+	}
+}
+
+void VulkanEngine::update_texture_streaming()
+{
+	CPU_ZONE("update_texture_streaming");
+	if (!_textureStreaming || _streamedTextures.empty())
+	{
+		return;
+	}
+
+	// swap in finished uploads
+	VkDeviceSize residentBytes = 0;
+	for (size_t i = 0; i < _streamedTextures.size(); i++)
+	{
+		StreamedTexture& streamed = _streamedTextures[i];
+		// one swap at a time per texture, the binding sets alternate
+		if (streamed.loading && _frameNumber >= streamed.settledFrame && _upload.is_complete(streamed.loadingTexture.upload))
+		{
+			if (streamed.loadingLevel < streamed.residentLevel)
+			{
+				_stats.textureSwaps++;
+			}
+			else
+			{
+				_stats.textureEvictions++;
+			}
+			swap_streamed_texture(static_cast<int>(i));
+		}
+		streamed.screenSize = 0.f;
+		residentBytes += streamed.residentBytes;
+	}
+
+	// on-screen diameter of the bounding sphere of every drawn textured object
+	float focal = (_windowExtent.height * 0.5f) / tan(glm::radians(70.f) * 0.5f);
+	auto measure = [&](const RenderObject& object) {
+		if (object.streamedTexture < 0)
+		{
+			return;
+		}
+		StreamedTexture& streamed = _streamedTextures[object.streamedTexture];
+		float x, y, z, radius;
+		culling::transform_sphere(object.transformMatrix, object.mesh->_bounds.origin, object.mesh->_bounds.radius,
+			x, y, z, radius);
+		float distance = glm::length(glm::vec3(x, y, z) - _cameraPosition);
+		// inside the sphere the object can fill the screen
+		float size = distance <= radius ? numeric_limits<float>::max() : 2.f * radius * focal / sqrt(distance * distance - radius * radius);
+		streamed.screenSize = max(streamed.screenSize, size);
+	};
+	if (_stressObjectCount > 0)
+	{
+		for (const RenderObject& object : _renderObject)
+		{
+			measure(object);
+		}
+	}
+	else
+	{
+		measure(_renderObject[_selectedShader]);
+	}
+
+	// a texture spread over its object once needs about one texel per pixel
+	vector<uint32_t> target(_streamedTextures.size());
+	VkDeviceSize targetBytes = 0;
+	auto level_bytes = [&](const StreamedTexture& streamed, uint32_t level) {
+		VkDeviceSize bytes = 0;
+		for (uint32_t l = level; l < streamed.source.mip_levels(); l++)
+		{
+			bytes += streamed.source.levels[l].size;
+		}
+		return bytes;
+	};
+	for (size_t i = 0; i < _streamedTextures.size(); i++)
+	{
+		StreamedTexture& streamed = _streamedTextures[i];
+		uint32_t last = streamed.source.mip_levels() - 1;
+		uint32_t level = last;
+		while (level > 0 && max(streamed.source.levels[level].width, streamed.source.levels[level].height) < streamed.screenSize)
+		{
+			level--;
+		}
+		streamed.wantedLevel = level;
+		target[i] = level;
+		targetBytes += level_bytes(streamed, level);
+	}
+
+	// what the heap has left once everything that is not a streamed texture is counted
+	VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+	vmaGetBudget(_allocator, budgets);
+	const VmaBudget& heap = budgets[_textureHeap];
+	VkDeviceSize others = heap.usage > residentBytes ? heap.usage - residentBytes : 0;
+	VkDeviceSize budget = heap.budget > others
+		? static_cast<VkDeviceSize>((heap.budget - others) * STREAMING_BUDGET_SHARE) : 0;
+	if (_textureBudget > 0)
+	{
+		budget = min(budget, _textureBudget);
+	}
+	_stats.textureBytes = residentBytes;
+	_stats.textureBudget = budget;
+
+	// over budget the least visible textures give up their finest level first
+	while (targetBytes > budget)
+	{
+		int victim = -1;
+		for (size_t i = 0; i < _streamedTextures.size(); i++)
+		{
+			if (target[i] + 1 < _streamedTextures[i].source.mip_levels()
+				&& (victim < 0 || _streamedTextures[i].screenSize < _streamedTextures[victim].screenSize))
+			{
+				victim = static_cast<int>(i);
+			}
+		}
+		if (victim < 0)
+		{
+			break;
+		}
+		targetBytes -= level_bytes(_streamedTextures[victim], target[victim]);
+		target[victim]++;
+		targetBytes += level_bytes(_streamedTextures[victim], target[victim]);
+	}
+
+	// evictions go straight to the target, loads step one level per upload so
+	// a single frame never stages more than one new level
+	bool loadStarted = false;
+	bool overBudget = residentBytes > budget;
+	for (size_t i = 0; i < _streamedTextures.size(); i++)
+	{
+		StreamedTexture& streamed = _streamedTextures[i];
+		if (streamed.loading || target[i] == streamed.residentLevel)
+		{
+			continue;
+		}
+		if (target[i] > streamed.residentLevel)
+		{
+			// one level of slack, a camera moving back and forth does not thrash
+			if (overBudget || target[i] > streamed.residentLevel + 1)
+			{
+				start_texture_load(streamed, target[i]);
+			}
+		}
+		else if (!loadStarted && residentBytes - streamed.residentBytes + level_bytes(streamed, streamed.residentLevel - 1) <= budget)
+		{
+			start_texture_load(streamed, streamed.residentLevel - 1);
+			loadStarted = true;
+		}
+	}
+}
+
+void VulkanEngine::load_mesh()
+{
+	CPU_ZONE("load_mesh");
+	//make the array 3 vertices long, the stress scene is built from it
+	Mesh triangleMesh;
+	triangleMesh._vertices.resize(3);
+
+	//vertex positions
+	triangleMesh._vertices[0].position = { 1.f, 1.f, 0.0f };
+	triangleMesh._vertices[1].position = { -1.f, 1.f, 0.0f };
+	triangleMesh._vertices[2].position = { 0.f,-1.f, 0.0f };
+
+	//vertex colors, all green
+	triangleMesh._vertices[0].color = { 0.f, 1.f, 0.0f }; //pure green
+	triangleMesh._vertices[1].color = { 0.f, 1.f, 0.0f }; //pure green
+	triangleMesh._vertices[2].color = { 0.f, 1.f, 0.0f }; //pure green
+
+	//we don't care about the vertex normals
+	triangleMesh._indices = { 0, 1, 2 };
+	triangleMesh._vertexCount = 3;
+	triangleMesh._indexCount = 3;
+	triangleMesh._indexType = VK_INDEX_TYPE_UINT16;
+	triangleMesh.compute_bounds();
+	upload_mesh(triangleMesh);
+	_meshSet["triangle"] = triangleMesh;
+
+	_jobs.wait(_assetJobs);
+	for (auto& pending : _pendingMeshes)
+	{
+		if (!pending->loaded)
+		{
+			continue;
+		}
+		Mesh& mesh_each = pending->mesh;
+		const MeshCacheHeader* cache = pending->cache;
+		if (cache)
+		{
+			cout << pending->name << ": loaded from " << mesh_cache::cache_path(pending->name) << endl;
+			upload_mesh(mesh_each, [&](char* data) {
+				memcpy(data, mesh_cache::vertex_data(cache), mesh_each.vertex_bytes());
+				memcpy(data + mesh_each.vertex_bytes(), mesh_cache::index_data(cache), mesh_each.index_bytes());
+				});
+		}
+		else
+		{
+			// before: one vertex per face corner, after: welded vertices plus the index buffer
+			cout << pending->name << ": vertices " << mesh_each._sourceVertexCount
+				<< " -> " << mesh_each._vertexCount
+				<< ", upload bytes " << mesh_each._sourceVertexCount * sizeof(Vertex)
+				<< " -> " << mesh_each.vertex_bytes() + mesh_each.index_bytes()
+				<< (mesh_each._indexType == VK_INDEX_TYPE_UINT16 ? " (16 bit indices)" : " (32 bit indices)")
+				<< endl;
+			upload_mesh(mesh_each, [&](char* data) {
+				memcpy(data, mesh_each._vertices.data(), mesh_each.vertex_bytes());
+				mesh_each.copy_indices(data + mesh_each.vertex_bytes());
+				});
+		}
+		_meshSet[pending->name] = mesh_each;
+	}
+	// the staging copies are done, the mappings and cpu vertices can go
+	_pendingMeshes.clear();
+}
+
+FrameData& VulkanEngine::get_current_frame()
+{
+	return _frames[_frameNumber % FRAME_OVERLAP];
+}
 
 void VulkanEngine::UpdateDate(int obj_index)
 {
@@ -605,11 +1434,15 @@ void VulkanEngine::UpdateDate(int obj_index)
 	_movestatus.camPos = { 0.f, 0.f, 0.f };
 
 	glm::mat4 view = glm::translate(glm::mat4(1.f), camPos);
+	_cameraPosition = -camPos;
 	//camera projection
 	glm::mat4 projection = glm::perspective(glm::radians(70.f), 1700.f / 900.f, 0.1f, 200.0f);
 	projection[1][1] *= -1;
-	//model rotation
-	_renderObject[obj_index].transformMatrix = _movestatus.transformMatrix;
+	//model rotation, the stress scene keeps its generated transforms
+	if (_stressObjectCount == 0)
+	{
+		_renderObject[obj_index].transformMatrix = _movestatus.transformMatrix;
+	}
 	//_renderObject[_selectedShader].transformMatrix = model;
 	//_movestatus.transformMatrix = glm::mat4{ 1.f };
 
@@ -617,39 +1450,52 @@ void VulkanEngine::UpdateDate(int obj_index)
 	GPUCameraData camData;
 	camData.projection = projection;
 	camData.view = view;
-	
-	// Cam Data
-	char* camdata;
-	int frameIndex = _frameNumber % FRAME_OVERLAP;
+	camData.viewproj = projection * view;
+	_viewProj = camData.viewproj;
+
+	// everything lands in this frame's arena window, the descriptor set stays
+	// the same and only the dynamic offsets change
+	FrameData& frame = get_current_frame();
 
-	vmaMapMemory(_allocator, _all_allcated_buffer._cameraBuffer._allocation, (void**)&camdata);
-	camdata += pad_uniform_buffer_size(sizeof(GPUCameraData)) * frameIndex;
-	memcpy(camdata, &camData, sizeof(GPUCameraData));
-	vmaUnmapMemory(_allocator, _all_allcated_buffer._cameraBuffer._allocation);
+	// Cam Data
+	LinearAllocation camera = alloc_frame_uniform(sizeof(GPUCameraData));
+	memcpy(camera.data, &camData, sizeof(GPUCameraData));
 
 	// Scene Data
 	float framed = (_frameNumber / 120.f);
 	_senceParameters.ambientColor = { sin(framed),0,cos(framed),1 };
 
-	char* sceneData;
-	vmaMapMemory(_allocator, _all_allcated_buffer._senneParameterBuffer._allocation, (void**)&sceneData);
-	//int frameIndex = _frameNumber % FRAME_OVERLAP;
-
-	sceneData += pad_uniform_buffer_size(sizeof(GPUSenceData)) * frameIndex;
-	memcpy(sceneData, &_senceParameters, sizeof(GPUSenceData));
-	vmaUnmapMemory(_allocator, _all_allcated_buffer._senneParameterBuffer._allocation);
-
-	//Object Data
-	void* objectData;
-	vmaMapMemory(_allocator, _all_allcated_buffer._objectBuffer._allocation, &objectData);
-	GPUObjectData* objectSSBO = (GPUObjectData*)objectData;
+	LinearAllocation scene = alloc_frame_uniform(sizeof(GPUSenceData));
+	memcpy(scene.data, &_senceParameters, sizeof(GPUSenceData));
 
-	RenderObject& object = _renderObject[_selectedShader];
-	objectSSBO[frameIndex].modelMatrix = object.transformMatrix;
+	// the object data offset is filled by draw_object, it writes in draw order
+	frame._globalOffsets[0] = camera.offset;
+	frame._globalOffsets[1] = scene.offset;
+	return;
+}
 
-	vmaUnmapMemory(_allocator, _all_allcated_buffer._objectBuffer._allocation);
+LinearAllocation VulkanEngine::alloc_frame_uniform(size_t size)
+{
+	LinearAllocation allocation = get_current_frame()._frameAllocator.alloc(
+		size, _gpuProperties.limits.minUniformBufferOffsetAlignment);
+	if (!allocation.data)
+	{
+		cout << "frame arena exhausted, raise FRAME_ARENA_SIZE" << endl;
+		abort();
+	}
+	return allocation;
+}
 
-	return;
+LinearAllocation VulkanEngine::alloc_frame_storage(size_t size)
+{
+	LinearAllocation allocation = get_current_frame()._frameAllocator.alloc(
+		size, _gpuProperties.limits.minStorageBufferOffsetAlignment);
+	if (!allocation.data)
+	{
+		cout << "frame arena exhausted, raise FRAME_ARENA_SIZE" << endl;
+		abort();
+	}
+	return allocation;
 }
 
 Material* VulkanEngine::create_material(VkPipeline pipeline, VkPipelineLayout layout, const string& name)
@@ -670,6 +1516,11 @@ Material* VulkanEngine::get_material(const std::string& name)
 	}
 	else
 	{
+		// first use queues the compile, the material is returned either way
+		if ((*it).second.pipeline == VK_NULL_HANDLE)
+		{
+			request_pipeline((*it).second.config);
+		}
 		return &(*it).second;
 	}
 }
@@ -686,127 +1537,463 @@ Mesh* VulkanEngine::getMesh(const std::string& name)
 		return &(*it).second;
 	}
 }
-void VulkanEngine::draw_object(VkCommandBuffer cmd, RenderObject* first, int count)
+void VulkanEngine::prepare_objects(VkCommandBuffer cmd, RenderObject* first, int count)
 {
-	//glm::vec3 camPos = { 0.f ,-6.f, -10.f };
-	//glm::mat4 view = glm::translate(glm::mat4(1.f), camPos);
-	//glm::mat4 projection = glm::perspective(glm::radians(70.f), 1700.f / 900.f, 0.1f, 200.0f);
-	//projection[1][1] *= -1;
+	auto update_start = chrono::steady_clock::now();
+	UpdateDate(_selectedShader);
 
-	//Mesh* lastMesh = nullptr;
-	//Material* lastMaterial = nullptr;
-	//for (int i = 0; i < count; i++)
-	//{
-	//	RenderObject& obj = first[i];
-	//	if (obj.material != lastMaterial)
-	//	{
-	//		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, obj.material->pipeline);
-	//		lastMaterial = obj.material;
-	//	}
-	//	glm::mat4 model = obj.transformMatrix;
-	//	glm::mat4 mvp_Matrix = projection* view * model;
-
-	//	MeshPushConstants constant;
-	//	constant.render_matrix = mvp_Matrix;
-	//	vkCmdPushConstants(cmd, obj.material->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstants),&constant);
-	//	if (obj.mesh != lastMesh) {
-	//		//bind the mesh vertex buffer with offset 0
-	//		VkDeviceSize offset = 0;
-	//		vkCmdBindVertexBuffers(cmd, 0, 1, &obj.mesh->_vertexBuffer._buffer, &offset);
-	//		lastMesh = obj.mesh;
-	//	}
-	//	vkCmdDraw(cmd, obj.mesh->_vertices.size(), 1, 0, 0);
-	//}
-	ImGui::Render();
+	// only rebuilt when the scene or the drawn range changes
+	if (_drawOrderDirty || first != _drawRangeFirst || count != _drawRangeCount)
+	{
+		build_draw_batches(first, count);
+	}
 
-	UpdateDate(_selectedShader);
-	uint32_t uniform_offset = pad_uniform_buffer_size(sizeof(GPUSenceData)) * (_frameNumber % FRAME_OVERLAP);
+	FrameData& frame = get_current_frame();
+	bool gpu = _gpuCulling && _cullPipeline != VK_NULL_HANDLE && _drawBatches.size() <= MAX_DRAW_BATCHES;
+	if (gpu)
+	{
+		// the cpu result is only used to check the gpu one
+		frame._cpuBatchVisible.clear();
+		_stats.cullMs = 0;
+		if (_gpuCullVerify)
+		{
+			size_t visible_count = cull_objects_cpu();
+			frame._cpuBatchVisible.assign(_drawBatches.size(), 0);
+			for (size_t i = 0; i < visible_count; i++)
+			{
+				frame._cpuBatchVisible[_drawOrderBatch[_visibleObjects[i]]]++;
+			}
+		}
+		record_gpu_culling(cmd, frame);
+		_stats.visible = _stats.gpuVisible;
+		_stats.culled = static_cast<uint32_t>(_drawOrder.size()) - min<uint32_t>(_stats.gpuVisible, static_cast<uint32_t>(_drawOrder.size()));
+	}
+	else
+	{
+		frame._gpuBatchCount = 0;
+		size_t visible_count = _cullingEnabled ? cull_objects_cpu() : _drawOrder.size();
+		_stats.visible = static_cast<uint32_t>(visible_count);
+		_stats.culled = static_cast<uint32_t>(_drawOrder.size() - visible_count);
+
+		//Object Data of the visible objects in draw order, gl_InstanceIndex is the position in the buffer
+		size_t object_count = min<size_t>(visible_count, MAX_OBJECTS);
+		LinearAllocation objects = alloc_frame_storage(sizeof(GPUObjectData) * MAX_OBJECTS);
+		GPUObjectData* objectSSBO = (GPUObjectData*)objects.data;
+		// the culled runs of a batch are still contiguous, so instancing survives culling
+		_visibleBatches.clear();
+		uint32_t last_batch = UINT32_MAX;
+		for (size_t i = 0; i < object_count; i++)
+		{
+			uint32_t index = _cullingEnabled ? _visibleObjects[i] : static_cast<uint32_t>(i);
+			objectSSBO[i].modelMatrix = _drawOrder[index]->transformMatrix;
+			objectSSBO[i].params = glm::uvec4(_drawOrder[index]->textureIndex, 0, 0, 0);
+
+			uint32_t batch = _drawOrderBatch[index];
+			if (batch != last_batch)
+			{
+				const DrawBatch& source = _drawBatches[batch];
+				_visibleBatches.push_back({ source.material, source.mesh, static_cast<uint32_t>(i), 0 });
+				last_batch = batch;
+			}
+			_visibleBatches.back().count++;
+		}
+		frame._globalOffsets[2] = objects.offset;
+	}
+	_stats.uniformUpdateMs = chrono::duration<double, milli>(chrono::steady_clock::now() - update_start).count();
+	_stats.frameArenaBytes = frame._frameAllocator.used();
+}
 
-	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _renderObject[_selectedShader].material->pipeline);
+size_t VulkanEngine::cull_objects_cpu()
+{
+	// bounding spheres against the camera frustum, before anything is recorded
+	auto cull_start = chrono::steady_clock::now();
+	_cullSpheres.resize(_drawOrder.size());
+	for (size_t i = 0; i < _drawOrder.size(); i++)
+	{
+		const RenderObject* object = _drawOrder[i];
+		culling::transform_sphere(object->transformMatrix, object->mesh->_bounds.origin, object->mesh->_bounds.radius,
+			_cullSpheres.x[i], _cullSpheres.y[i], _cullSpheres.z[i], _cullSpheres.radius[i]);
+	}
+	_visibleObjects.resize(_drawOrder.size());
+	size_t visible_count = culling::cull_spheres(culling::extract_frustum(_viewProj), _cullSpheres, _visibleObjects.data());
+	_stats.cullMs = chrono::duration<double, milli>(chrono::steady_clock::now() - cull_start).count();
+	return visible_count;
+}
 
-	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-		_renderObject[_selectedShader].material->pipelineLayout, 0, 1,
-		&_globalDescriptor, 1, &uniform_offset);
+void VulkanEngine::record_gpu_culling(VkCommandBuffer cmd, FrameData& frame)
+{
+	uint32_t object_count = static_cast<uint32_t>(min<size_t>(_drawOrder.size(), MAX_OBJECTS));
+	uint32_t batch_count = static_cast<uint32_t>(_drawBatches.size());
+	frame._gpuBatchCount = batch_count;
+	frame._globalOffsets[2] = 0;
+	if (batch_count == 0)
+	{
+		return;
+	}
 
-	if (_selectedShader == 3) {
-		//texture descriptor
-		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _renderObject[_selectedShader].material->pipelineLayout, 1, 1, &_renderObject[_selectedShader].material->textureSet, 0, nullptr);
+	// inputs go through the frame arena like the cpu path, every object in draw order
+	LinearAllocation objects = alloc_frame_storage(sizeof(GPUObjectData) * MAX_OBJECTS);
+	LinearAllocation cull = alloc_frame_storage(sizeof(GPUCullData) * MAX_OBJECTS);
+	LinearAllocation commands = alloc_frame_storage(sizeof(VkDrawIndexedIndirectCommand) * batch_count);
+	GPUObjectData* objectSSBO = (GPUObjectData*)objects.data;
+	GPUCullData* cullSSBO = (GPUCullData*)cull.data;
+	for (uint32_t i = 0; i < object_count; i++)
+	{
+		const RenderObject* object = _drawOrder[i];
+		objectSSBO[i].modelMatrix = object->transformMatrix;
+		objectSSBO[i].params = glm::uvec4(object->textureIndex, 0, 0, 0);
+		cullSSBO[i].sphere = glm::vec4(object->mesh->_bounds.origin, object->mesh->_bounds.radius);
+		cullSSBO[i].batch = _drawOrderBatch[i];
 	}
 
-	VkDeviceSize offset = 0;
-	vkCmdBindVertexBuffers(cmd, 0, 1, &_renderObject[_selectedShader].mesh->_vertexBuffer._buffer, &offset);
-	MeshPushConstants constants;
-	constants.render_matrix = _renderObject[_selectedShader].transformMatrix;
-	//upload the matrix to the GPU via push constants
-	vkCmdPushConstants(cmd, _renderObject[_selectedShader].material->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstants), &constants);
-	//we can now draw
-	
-	vkCmdDraw(cmd, _renderObject[_selectedShader].mesh->_vertices.size(), 1, 0, 0);
-	ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd);
+	// no instances yet, cull.comp appends from the batch start in draw order
+	VkDrawIndexedIndirectCommand* initial = (VkDrawIndexedIndirectCommand*)commands.data;
+	for (uint32_t b = 0; b < batch_count; b++)
+	{
+		initial[b].indexCount = _drawBatches[b].mesh->_indexCount;
+		initial[b].instanceCount = 0;
+		initial[b].firstIndex = 0;
+		initial[b].vertexOffset = 0;
+		initial[b].firstInstance = _drawBatches[b].first;
+	}
+	VkBufferCopy copy = { commands.offset, 0, sizeof(VkDrawIndexedIndirectCommand) * batch_count };
+	vkCmdCopyBuffer(cmd, _frameArena._buffer, frame._drawCommands._buffer, 1, &copy);
+
+	VkMemoryBarrier reset_barrier = {};
+	reset_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	reset_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	reset_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &reset_barrier, 0, nullptr, 0, nullptr);
+
+	// same planes as the cpu kernels
+	Frustum frustum = culling::extract_frustum(_viewProj);
+	GPUCullConstants constants;
+	for (int p = 0; p < 6; p++)
+	{
+		constants.planes[p] = frustum.planes[p];
+	}
+	constants.objectCount = object_count;
+
+	uint32_t cullOffsets[2] = { objects.offset, cull.offset };
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipelineLayout, 0, 1,
+		&frame._cullDescriptor, 2, cullOffsets);
+	vkCmdPushConstants(cmd, _cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GPUCullConstants), &constants);
+	vkCmdDispatch(cmd, (object_count + 63) / 64, 1, 1);
+
+	// the indirect draws and the vertex shader read what the dispatch wrote,
+	// and so does the copy the host reads the instance counts from after _renderFence
+	VkMemoryBarrier cull_barrier = {};
+	cull_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	cull_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	cull_barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 1, &cull_barrier, 0, nullptr, 0, nullptr);
+
+	// a few bytes per batch, the draws keep reading the device local commands
+	VkBufferCopy readback = { 0, 0, sizeof(VkDrawIndexedIndirectCommand) * batch_count };
+	vkCmdCopyBuffer(cmd, frame._drawCommands._buffer, frame._drawCommandsReadback._buffer, 1, &readback);
+	VkMemoryBarrier readback_barrier = {};
+	readback_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	readback_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	readback_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+		0, 1, &readback_barrier, 0, nullptr, 0, nullptr);
+}
+
+void VulkanEngine::check_gpu_culling(FrameData& frame)
+{
+	if (frame._gpuBatchCount == 0)
+	{
+		return;
+	}
+	VK_CHECK(vmaInvalidateAllocation(_allocator, frame._drawCommandsReadback._allocation, 0, VK_WHOLE_SIZE));
+
+	uint32_t visible = 0;
+	uint32_t triangles = 0;
+	uint32_t mismatches = 0;
+	for (uint32_t b = 0; b < frame._gpuBatchCount; b++)
+	{
+		uint32_t instances = frame._drawCommandsData[b].instanceCount;
+		visible += instances;
+		triangles += frame._drawCommandsData[b].indexCount / 3 * instances;
+		if (b < frame._cpuBatchVisible.size() && frame._cpuBatchVisible[b] != instances)
+		{
+			mismatches++;
+		}
+	}
+	_stats.gpuVisible = visible;
+	_stats.gpuTriangles = triangles;
+	if (!frame._cpuBatchVisible.empty())
+	{
+		_stats.gpuMismatches = mismatches;
+	}
+	frame._gpuBatchCount = 0;
+}
+
+bool VulkanEngine::bind_batch(VkCommandBuffer cmd, const DrawBatch& batch, VkDescriptorSet globalSet,
+	Material*& lastMaterial, Mesh*& lastMesh)
+{
+	if (!_upload.is_complete(batch.mesh->_uploadToken) ||
+		!_upload.is_complete(batch.material->textureUpload))
+	{
+		// still streaming in
+		return false;
+	}
+
+	// still compiling, drawn with the fallback meanwhile
+	Material* material = batch.material;
+	if (material->pipeline == VK_NULL_HANDLE)
+	{
+		material = _fallbackMaterial;
+		if (!material || material->pipeline == VK_NULL_HANDLE)
+		{
+			return false;
+		}
+		_usedFallback = true;
+	}
+
+	if (material != lastMaterial)
+	{
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, material->pipeline);
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+			material->pipelineLayout, 0, 1,
+			&globalSet, 3, get_current_frame()._globalOffsets);
+		if (material->textureSet != VK_NULL_HANDLE) {
+			//texture descriptor
+			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, material->pipelineLayout, 1, 1, &material->textureSet, 0, nullptr);
+		}
+		lastMaterial = material;
+		_stats.pipelineBinds++;
+	}
+
+	if (batch.mesh != lastMesh)
+	{
+		VkDeviceSize offset = 0;
+		vkCmdBindVertexBuffers(cmd, 0, 1, &batch.mesh->_vertexBuffer._buffer, &offset);
+		vkCmdBindIndexBuffer(cmd, batch.mesh->_indexBuffer._buffer, 0, batch.mesh->_indexType);
+		lastMesh = batch.mesh;
+		_stats.meshBinds++;
+	}
+	return true;
+}
+
+void VulkanEngine::draw_object(VkCommandBuffer cmd)
+{
+	CPU_ZONE("draw_object");
+	if (!_headless)
+	{
+		ImGui::Render();
+	}
+
+	FrameData& frame = get_current_frame();
+	uint32_t scene_scope = frame._gpuProfiler.begin_scope(cmd, "scene");
+	_stats.objects = 0;
+	_stats.drawCalls = 0;
+	_stats.triangles = 0;
+	_stats.pipelineBinds = 0;
+	_stats.meshBinds = 0;
+
+	Material* lastMaterial = nullptr;
+	Mesh* lastMesh = nullptr;
+	_usedFallback = false;
+	if (frame._gpuBatchCount > 0)
+	{
+		// batches are distinct mesh/material pairs and every mesh has its own vertex
+		// buffer, so one indirect draw per batch, with 0 instances when cull.comp kept
+		// nothing of it
+		for (uint32_t b = 0; b < frame._gpuBatchCount; b++)
+		{
+			if (!bind_batch(cmd, _drawBatches[b], frame._gpuGlobalDescriptor, lastMaterial, lastMesh))
+			{
+				continue;
+			}
+			vkCmdDrawIndexedIndirect(cmd, frame._drawCommands._buffer, b * sizeof(VkDrawIndexedIndirectCommand),
+				1, sizeof(VkDrawIndexedIndirectCommand));
+			_stats.drawCalls++;
+		}
+		_stats.objects = _stats.gpuVisible;
+		_stats.triangles = _stats.gpuTriangles;
+	}
+	else
+	{
+		for (const DrawBatch& batch : _visibleBatches)
+		{
+			if (!bind_batch(cmd, batch, _globalDescriptor, lastMaterial, lastMesh))
+			{
+				continue;
+			}
+			//we can now draw, one instance per object, the model matrix comes from the object buffer
+			vkCmdDrawIndexed(cmd, batch.mesh->_indexCount, batch.count, 0, 0, batch.first);
+			_stats.drawCalls++;
+			_stats.objects += batch.count;
+			_stats.triangles += batch.mesh->_indexCount / 3 * batch.count;
+		}
+	}
+	if (_usedFallback)
+	{
+		_stats.fallbackFrames++;
+	}
+	frame._gpuProfiler.end_scope(cmd, scene_scope);
+	if (!_headless)
+	{
+		GpuScope scope(frame._gpuProfiler, cmd, "imgui");
+		ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd);
+	}
 	return;
 }
 
+void VulkanEngine::build_draw_batches(RenderObject* first, int count)
+{
+	// sorted by material, then mesh, so pipeline and vertex buffer binds only
+	// happen on a change and equal pairs end up next to each other
+	_drawOrder.clear();
+	for (int i = 0; i < count; i++)
+	{
+		if (first[i].mesh && first[i].material)
+		{
+			_drawOrder.push_back(&first[i]);
+		}
+	}
+	sort(_drawOrder.begin(), _drawOrder.end(), [](const RenderObject* a, const RenderObject* b) {
+		if (a->material != b->material)
+		{
+			return less<Material*>()(a->material, b->material);
+		}
+		return less<Mesh*>()(a->mesh, b->mesh);
+		});
+
+	// every run of the same mesh/material pair becomes one instanced draw
+	_drawBatches.clear();
+	_drawOrderBatch.resize(_drawOrder.size());
+	for (uint32_t i = 0; i < _drawOrder.size(); i++)
+	{
+		RenderObject* object = _drawOrder[i];
+		if (_drawBatches.empty() ||
+			_drawBatches.back().material != object->material ||
+			_drawBatches.back().mesh != object->mesh)
+		{
+			_drawBatches.push_back({ object->material, object->mesh, i, 0 });
+		}
+		_drawBatches.back().count++;
+		_drawOrderBatch[i] = static_cast<uint32_t>(_drawBatches.size() - 1);
+	}
+
+	_drawOrderDirty = false;
+	_drawRangeFirst = first;
+	_drawRangeCount = count;
+}
+
 void VulkanEngine::init_scene()
 {
-	for ( auto name: obj_name)
+	CPU_ZONE("init_scene");
+	for (size_t i = 0; i < obj_name.size(); i++)
 	{
 		RenderObject mesh_obj;
-		mesh_obj.mesh = getMesh(name);
-		if (name == "lost_empire.obj")
+		mesh_obj.mesh = getMesh(obj_name[i]);
+		string material = obj_material[i];
+		if (_bindless)
 		{
-			mesh_obj.material = get_material("texturedmesh");
+			for (const MaterialConfig& config : material_config)
+			{
+				if (config.name == material && !config.bindlessVariant.empty())
+				{
+					material = config.bindlessVariant;
+					break;
+				}
+			}
 		}
-		else
+		mesh_obj.material = get_material(material);
+		auto texture = _loadedTextures.find(obj_texture[i]);
+		if (texture != _loadedTextures.end())
 		{
-			mesh_obj.material = get_material("defaultmesh");
+			mesh_obj.textureIndex = texture->second.bindlessIndex;
+			mesh_obj.streamedTexture = texture->second.streamIndex;
 		}
 		mesh_obj.transformMatrix = glm::mat4{ 1.0f };
 		mesh_obj.camPos = { 0.f,0.f ,-2.f };
 		_renderObject.push_back(mesh_obj);
 	}
-	//_renderObject.push_back(monkey);
-	//for (int x = -20; x <= 20; x++) {
-	//	for (int y = -20; y <= 20; y++) {
-
-	//		RenderObject tri;
-	//		tri.mesh = getMesh("triangle");
-	//		tri.material = get_material("defaultmesh");
-	//		glm::mat4 translation = glm::translate(glm::mat4{ 1.0 }, glm::vec3(x, 0, y));
-	//		glm::mat4 scale = glm::scale(glm::mat4{ 1.0 }, glm::vec3(0.2, 0.2, 0.2));
-	//		tri.transformMatrix = translation * scale;
-
-	//		_renderObject.push_back(tri);
-	//	}
-	//}
+	if (_stressObjectCount > 0)
+	{
+		build_stress_scene(_stressObjectCount);
+	}
+	_drawOrderDirty = true;
 
 		//create a sampler for the texture
-	VkSamplerCreateInfo samplerInfo = vkinit::sampler_create_info(VK_FILTER_NEAREST);
+	// trilinear over the mip chain, the atlas is mostly seen at grazing angles.
+	// Magnification stays nearest so the pixel art keeps its hard edges up close
+	VkSamplerCreateInfo samplerInfo = vkinit::sampler_create_info(
+		VK_FILTER_NEAREST, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT, VK_SAMPLER_MIPMAP_MODE_LINEAR, _maxAnisotropy);
 	VkSampler blockySampler;
 	vkCreateSampler(_device, &samplerInfo, nullptr, &blockySampler);
 
-	Material* texturedMat = get_material("texturedmesh");
+	// the streamer rewrites the set whenever the resident mips change
+	bind_texture(get_material("texturedmesh"), "lost_empire-RGBA.png", blockySampler);
 
-	//allocate the descriptor set for single-texture to use on the material
-	VkDescriptorSetAllocateInfo allocInfo = vkinit::descriptorset_allocate_info(_descriptorPool, 1, _singleTextureSetLayout);
-	VK_CHECK(vkAllocateDescriptorSets(_device, &allocInfo, &texturedMat->textureSet));
+	// all bindless materials share the one texture array
+	if (_bindless)
+	{
+		for (auto& material : _material)
+		{
+			if (material.second.pipelineLayout == _bindlessPipelineLayout)
+			{
+				material.second.textureSet = _bindlessSet;
+				material.second.textureUpload = _bindlessUpload;
+			}
+		}
+	}
 
-	//write to the descriptor set so that it points to our empire_diffuse texture
-	VkDescriptorImageInfo imageBufferInfo;
-	imageBufferInfo.sampler = blockySampler;
-	imageBufferInfo.imageView = _loadedTextures["lost_empire-RGBA.png"].imageView;
-	imageBufferInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	_mainDeletionQueue.push_sampler(blockySampler);
+}
 
-	VkWriteDescriptorSet texture1 = vkinit::write_descriptor_image(
-										VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 
-										texturedMat->textureSet, 
-										&imageBufferInfo, 0
-									);
+void VulkanEngine::build_stress_scene(uint32_t count)
+{
+	CPU_ZONE("build_stress_scene");
+	// the 41x41 triangle grid of the tutorial, grown to a square of count triangles
+	count = min(count, MAX_OBJECTS - static_cast<uint32_t>(_renderObject.size()));
+	int side = static_cast<int>(ceil(sqrt(static_cast<double>(count))));
+	int half = side / 2;
+	glm::mat4 scale = glm::scale(glm::mat4{ 1.0 }, glm::vec3(0.2, 0.2, 0.2));
+	// the camera follows the selected object, pull it back for every object
+	for (RenderObject& object : _renderObject)
+	{
+		object.camPos = { 0.f, -6.f, -10.f };
+	}
+
+	// a seed scatters the same count over the same square, every run with it
+	// gets the same scene
+	mt19937 rng(_stressSeed);
+	uniform_real_distribution<float> position(-static_cast<float>(half), static_cast<float>(side - half));
+	uniform_real_distribution<float> yaw(0.f, glm::two_pi<float>());
 
-	vkUpdateDescriptorSets(_device, 1, &texture1, 0, nullptr);
+	_renderObject.reserve(_renderObject.size() + count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		RenderObject tri;
+		tri.mesh = getMesh("triangle");
+		tri.material = get_material("defaultmesh");
+		if (_stressSeed == 0)
+		{
+			int x = static_cast<int>(i % side) - half;
+			int y = static_cast<int>(i / side) - half;
+			tri.transformMatrix = glm::translate(glm::mat4{ 1.0 }, glm::vec3(x, 0, y)) * scale;
+		}
+		else
+		{
+			float x = position(rng);
+			float y = position(rng);
+			tri.transformMatrix = glm::translate(glm::mat4{ 1.0 }, glm::vec3(x, 0, y))
+				* glm::rotate(glm::mat4{ 1.0 }, yaw(rng), glm::vec3(0, 1, 0)) * scale;
+		}
+		tri.camPos = { 0.f, -6.f, -10.f };
 
-	_mainDeletionQueue.push_function([=]() {
-		vkDestroySampler(_device, blockySampler, nullptr);
-		});
+		_renderObject.push_back(tri);
+	}
+	cout << "stress scene: " << count << " objects " << (_stressSeed == 0 ? "in" : "scattered over")
+		<< " a " << side << "x" << side << " grid" << endl;
 }
 
 AllocatedBuffer VulkanEngine::create_buffer(
@@ -833,23 +2020,24 @@ AllocatedBuffer VulkanEngine::create_buffer(
 		&newBuffer._allocation,
 		nullptr));
 
-	_mainDeletionQueue.push_function([=]() {
-		vmaDestroyBuffer(_allocator, newBuffer._buffer, newBuffer._allocation);
-		});
+	_mainDeletionQueue.push_buffer(newBuffer._buffer, newBuffer._allocation);
 	return newBuffer;
 }
 void VulkanEngine::init_descriptors()
 {
-	std::vector<VkDescriptorPoolSize> sizes =
-	{
-		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 10 },
-		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 10 },
-		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 10},
-		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 10}
-	};
+	CPU_ZONE("init_descriptors");
+	// every set lives as long as the engine, the per frame data is reached
+	// through dynamic offsets into the frame arena
+	_descriptorAllocator.init(_device);
+	_descriptorLayoutCache.init(_device);
+	_mainDeletionQueue.push_function([=]() {
+		_descriptorAllocator.cleanup();
+		_descriptorLayoutCache.cleanup();
+		});
+
 	//information about the binding.
 	VkDescriptorSetLayoutBinding camBufferBinding = vkinit::descriptor_setlayout_binding(
-				/* it's a uniform buffer binding*/		0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+				/* it's a uniform buffer binding*/		0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
 			/* we use it from the vertex shader*/		1, VK_SHADER_STAGE_VERTEX_BIT
 														);
 
@@ -859,7 +2047,7 @@ void VulkanEngine::init_descriptors()
 														);
 
 	VkDescriptorSetLayoutBinding objectBufferBinding = vkinit::descriptor_setlayout_binding(
-														2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+														2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
 														1, VK_SHADER_STAGE_VERTEX_BIT
 														);
 
@@ -871,99 +2059,256 @@ void VulkanEngine::init_descriptors()
 	VkDescriptorSetLayoutBinding bindings[] = { camBufferBinding, senceBufferBinding, objectBufferBinding};
 	VkDescriptorSetLayoutCreateInfo setInfo = vkinit::descriptor_setlayout_info(3, bindings[0]);
 		//setInfo.pBindings = bindings;
-	VK_CHECK(vkCreateDescriptorSetLayout(_device, &setInfo, nullptr, &_globalSetLayout));
-	
+	_globalSetLayout = _descriptorLayoutCache.create_descriptor_layout(&setInfo);
 
 	VkDescriptorSetLayoutCreateInfo set2Info = vkinit::descriptor_setlayout_info(1, textureBufferBinding);
-	VK_CHECK(vkCreateDescriptorSetLayout(_device, &set2Info, nullptr, &_singleTextureSetLayout));
-
+	_singleTextureSetLayout = _descriptorLayoutCache.create_descriptor_layout(&set2Info);
 
 
-	_mainDeletionQueue.push_function([=]() {
-		vkDestroyDescriptorSetLayout(_device, _globalSetLayout, nullptr);
-		vkDestroyDescriptorSetLayout(_device, _singleTextureSetLayout, nullptr);
-		});
+	// one persistently mapped buffer for all frames, each FrameData bumps through its own window
+	VkBufferCreateInfo arena_info = vkinit::buffer_create_info(
+										VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+										VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+										VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+										FRAME_OVERLAP * FRAME_ARENA_SIZE
+									);
+	VmaAllocationCreateInfo arena_allocinfo = {};
+	arena_allocinfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+	arena_allocinfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+	VmaAllocationInfo arena_mapping;
+	VK_CHECK(vmaCreateBuffer(_allocator, &arena_info, &arena_allocinfo,
+		&_frameArena._buffer, &_frameArena._allocation, &arena_mapping));
+	_frameArenaData = static_cast<char*>(arena_mapping.pMappedData);
+	_mainDeletionQueue.push_buffer(_frameArena._buffer, _frameArena._allocation);
 
-	VkDescriptorPoolCreateInfo pool_info = vkinit::descriptorpool_create_info(10, sizes.data(), sizes.size() );
+	for (int i = 0; i < FRAME_OVERLAP; i++)
+	{
+		_frames[i]._frameAllocator.init(_frameArena._buffer, _frameArenaData, i * FRAME_ARENA_SIZE, FRAME_ARENA_SIZE);
+	}
 
-	VK_CHECK(vkCreateDescriptorPool(_device, &pool_info, nullptr, &_descriptorPool));
-	_mainDeletionQueue.push_function([=]() {
-		vkDestroyDescriptorPool(_device, _descriptorPool, nullptr);
-		});
+	if (!_descriptorAllocator.allocate(&_globalDescriptor, _globalSetLayout))
+	{
+		cout << "failed to allocate the global descriptor set" << endl;
+	}
 
+	// all three bindings are dynamic, the offsets come from the frame allocator
+	VkDescriptorBufferInfo cam_info = vkinit::descriptor_buffer_info(
+										_frameArena._buffer,
+										0, sizeof(GPUCameraData)
+										);
+	VkDescriptorBufferInfo sence_info = vkinit::descriptor_buffer_info(
+										_frameArena._buffer,
+										0, sizeof(GPUSenceData)
+										);
+	VkDescriptorBufferInfo object_info = vkinit::descriptor_buffer_info(
+										_frameArena._buffer,
+										0, sizeof(GPUObjectData) * MAX_OBJECTS
+										);
 
-	size_t ParamBufferSize = FRAME_OVERLAP * pad_uniform_buffer_size(sizeof(GPUSenceData));
-	_all_allcated_buffer._senneParameterBuffer = create_buffer(
-													ParamBufferSize, 
-													VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 
-													VMA_MEMORY_USAGE_CPU_TO_GPU
-												);
+	VkWriteDescriptorSet cameraWrite = vkinit::write_descriptor_buffer(
+										VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 
+										_globalDescriptor, 
+										&cam_info, 
+										0
+										);
 	
-	ParamBufferSize = FRAME_OVERLAP * pad_uniform_buffer_size(sizeof(GPUCameraData));
-	_all_allcated_buffer._cameraBuffer = create_buffer(
-											ParamBufferSize, 
-											VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 
-											VMA_MEMORY_USAGE_CPU_TO_GPU
+	VkWriteDescriptorSet senceWrite = vkinit::write_descriptor_buffer(
+										VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+										_globalDescriptor,
+										&sence_info,
+										1
 										);
 
-	ParamBufferSize = FRAME_OVERLAP * pad_uniform_buffer_size(sizeof(GPUObjectData));
-	_all_allcated_buffer._objectBuffer = create_buffer(
-											ParamBufferSize,
-											VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-											VMA_MEMORY_USAGE_CPU_TO_GPU
+	VkWriteDescriptorSet objectWrite = vkinit::write_descriptor_buffer(
+										VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+										_globalDescriptor,
+										&object_info,
+										2
 										);
 
-	VkDescriptorSetAllocateInfo allocInfo = vkinit::descriptorset_allocate_info(_descriptorPool, 1, _globalSetLayout);
-	VK_CHECK(vkAllocateDescriptorSets(_device, &allocInfo, &_globalDescriptor));
+	VkWriteDescriptorSet setWrites[] = { cameraWrite, senceWrite, objectWrite };
 
-	for (int i = 0; i < FRAME_OVERLAP; i++)
+	vkUpdateDescriptorSets(_device, 3, setWrites, 0, nullptr);
+}
+
+void VulkanEngine::init_gpu_culling()
+{
+	CPU_ZONE("init_gpu_culling");
+	if (!_gpuCullSupported)
 	{
+		return;
+	}
 
-		VkDescriptorBufferInfo cam_info = vkinit::descriptor_buffer_info(
-											_all_allcated_buffer._cameraBuffer._buffer,
-											i, sizeof(GPUCameraData)
-											);
-		VkDescriptorBufferInfo sence_info = vkinit::descriptor_buffer_info(
-											_all_allcated_buffer._senneParameterBuffer._buffer,
-											0, sizeof(GPUSenceData)
-											);
-		VkDescriptorBufferInfo object_info = vkinit::descriptor_buffer_info(
-											_all_allcated_buffer._objectBuffer._buffer,
-											i, sizeof(GPUObjectData)
-											);
+	// objects and cull data live in the frame arena, the outputs are per frame
+	VkDescriptorSetLayoutBinding cullBindings[] = {
+		vkinit::descriptor_setlayout_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_COMPUTE_BIT),
+		vkinit::descriptor_setlayout_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_COMPUTE_BIT),
+		vkinit::descriptor_setlayout_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT),
+		vkinit::descriptor_setlayout_binding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT)
+	};
+	VkDescriptorSetLayoutCreateInfo setInfo = vkinit::descriptor_setlayout_info(4, cullBindings[0]);
+	_cullSetLayout = _descriptorLayoutCache.create_descriptor_layout(&setInfo);
 
-		VkWriteDescriptorSet cameraWrite = vkinit::write_descriptor_buffer(
-											VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 
-											_globalDescriptor, 
-											&cam_info, 
-											0
-											);
-		
-		VkWriteDescriptorSet senceWrite = vkinit::write_descriptor_buffer(
-											VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
-											_globalDescriptor,
-											&sence_info,
-											1
-											);
+	VkPushConstantRange push_constant = {};
+	push_constant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	push_constant.offset = 0;
+	push_constant.size = sizeof(GPUCullConstants);
 
-		VkWriteDescriptorSet objectWrite = vkinit::write_descriptor_buffer(
-											VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-											_globalDescriptor,
-											&object_info,
-											2
-											);
+	VkPipelineLayoutCreateInfo cull_layout_info = vkinit::pipeline_layout_create_info();
+	cull_layout_info.pushConstantRangeCount = 1;
+	cull_layout_info.pPushConstantRanges = &push_constant;
+	cull_layout_info.setLayoutCount = 1;
+	cull_layout_info.pSetLayouts = &_cullSetLayout;
+	VK_CHECK(vkCreatePipelineLayout(_device, &cull_layout_info, nullptr, &_cullPipelineLayout));
+
+	_mainDeletionQueue.push_pipeline_layout(_cullPipelineLayout);
+
+	VkShaderModule cullShader;
+	if (!load_shader_module("../../shaders/cull.comp.spv", &cullShader))
+	{
+		cout << "Error when building the cull shader module, culling stays on the cpu" << endl;
+		return;
+	}
+	VkComputePipelineCreateInfo pipeline_info = {};
+	pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipeline_info.pNext = nullptr;
+	pipeline_info.stage = vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_COMPUTE_BIT, cullShader);
+	pipeline_info.layout = _cullPipelineLayout;
+	VK_CHECK(vkCreateComputePipelines(_device, _pipelineCache.cache(), 1, &pipeline_info, nullptr, &_cullPipeline));
+	vkDestroyShaderModule(_device, cullShader, nullptr);
+
+	VkPipeline cullPipeline = _cullPipeline;
+	_mainDeletionQueue.push_pipeline(cullPipeline);
+
+	for (int i = 0; i < FRAME_OVERLAP; i++)
+	{
+		FrameData& frame = _frames[i];
+
+		frame._drawCommands = create_buffer(sizeof(VkDrawIndexedIndirectCommand) * MAX_DRAW_BATCHES,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VMA_MEMORY_USAGE_GPU_ONLY);
+
+		// host readable copy, so the instance counts can be checked against the cpu
+		VkBufferCreateInfo readback_info = vkinit::buffer_create_info(
+											VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+											VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+											sizeof(VkDrawIndexedIndirectCommand) * MAX_DRAW_BATCHES
+										);
+		VmaAllocationCreateInfo readback_allocinfo = {};
+		readback_allocinfo.usage = VMA_MEMORY_USAGE_GPU_TO_CPU;
+		readback_allocinfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+		VmaAllocationInfo readback_mapping;
+		VK_CHECK(vmaCreateBuffer(_allocator, &readback_info, &readback_allocinfo,
+			&frame._drawCommandsReadback._buffer, &frame._drawCommandsReadback._allocation, &readback_mapping));
+		frame._drawCommandsData = static_cast<VkDrawIndexedIndirectCommand*>(readback_mapping.pMappedData);
+		AllocatedBuffer readback = frame._drawCommandsReadback;
+		_mainDeletionQueue.push_buffer(readback._buffer, readback._allocation);
+
+		frame._visibleObjectBuffer = create_buffer(sizeof(GPUObjectData) * MAX_OBJECTS,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+
+		if (!_descriptorAllocator.allocate(&frame._cullDescriptor, _cullSetLayout) ||
+			!_descriptorAllocator.allocate(&frame._gpuGlobalDescriptor, _globalSetLayout))
+		{
+			cout << "failed to allocate the gpu culling descriptor sets" << endl;
+		}
 
-		VkWriteDescriptorSet setWrites[] = { cameraWrite, senceWrite, objectWrite };
+		VkDescriptorBufferInfo object_info = vkinit::descriptor_buffer_info(_frameArena._buffer, 0, sizeof(GPUObjectData) * MAX_OBJECTS);
+		VkDescriptorBufferInfo cull_info = vkinit::descriptor_buffer_info(_frameArena._buffer, 0, sizeof(GPUCullData) * MAX_OBJECTS);
+		VkDescriptorBufferInfo commands_buffer_info = vkinit::descriptor_buffer_info(frame._drawCommands._buffer, 0, VK_WHOLE_SIZE);
+		VkDescriptorBufferInfo visible_info = vkinit::descriptor_buffer_info(frame._visibleObjectBuffer._buffer, 0, VK_WHOLE_SIZE);
+		VkDescriptorBufferInfo cam_info = vkinit::descriptor_buffer_info(_frameArena._buffer, 0, sizeof(GPUCameraData));
+		VkDescriptorBufferInfo sence_info = vkinit::descriptor_buffer_info(_frameArena._buffer, 0, sizeof(GPUSenceData));
+		VkDescriptorBufferInfo visible_dynamic_info = vkinit::descriptor_buffer_info(
+			frame._visibleObjectBuffer._buffer, 0, sizeof(GPUObjectData) * MAX_OBJECTS);
+
+		// the gpu global set is _globalDescriptor with the compacted objects at binding 2
+		VkWriteDescriptorSet setWrites[] = {
+			vkinit::write_descriptor_buffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, frame._cullDescriptor, &object_info, 0),
+			vkinit::write_descriptor_buffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, frame._cullDescriptor, &cull_info, 1),
+			vkinit::write_descriptor_buffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frame._cullDescriptor, &commands_buffer_info, 2),
+			vkinit::write_descriptor_buffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frame._cullDescriptor, &visible_info, 3),
+			vkinit::write_descriptor_buffer(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, frame._gpuGlobalDescriptor, &cam_info, 0),
+			vkinit::write_descriptor_buffer(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, frame._gpuGlobalDescriptor, &sence_info, 1),
+			vkinit::write_descriptor_buffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, frame._gpuGlobalDescriptor, &visible_dynamic_info, 2)
+		};
+		vkUpdateDescriptorSets(_device, static_cast<uint32_t>(size(setWrites)), setWrites, 0, nullptr);
+	}
+}
 
-		vkUpdateDescriptorSets(_device, 3, setWrites, 0, nullptr);
+void VulkanEngine::init_bindless()
+{
+	CPU_ZONE("init_bindless");
+	if (!_bindless)
+	{
+		return;
 	}
+
+	VkPhysicalDeviceVulkan12Properties properties12 = {};
+	properties12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+	VkPhysicalDeviceProperties2 properties = {};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties.pNext = &properties12;
+	vkGetPhysicalDeviceProperties2(_choseGPU, &properties);
+	_bindlessCapacity = min({ MAX_BINDLESS_TEXTURES,
+		properties12.maxDescriptorSetUpdateAfterBindSampledImages,
+		properties12.maxPerStageDescriptorUpdateAfterBindSampledImages });
+
+	// one sampler for every texture, the images are indexed in the shader
+	VkDescriptorSetLayoutBinding bindings[] = {
+		vkinit::descriptor_setlayout_binding(0, VK_DESCRIPTOR_TYPE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT),
+		vkinit::descriptor_setlayout_binding(1, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, _bindlessCapacity, VK_SHADER_STAGE_FRAGMENT_BIT)
+	};
+	VkDescriptorBindingFlags bindingFlags[] = {
+		0,
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT
+	};
+	VkDescriptorSetLayoutBindingFlagsCreateInfo flags_info = {};
+	flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	flags_info.bindingCount = 2;
+	flags_info.pBindingFlags = bindingFlags;
+
+	// not through _descriptorLayoutCache, it does not look at the binding flags in pNext
+	VkDescriptorSetLayoutCreateInfo setInfo = vkinit::descriptor_setlayout_info(2, bindings[0],
+		VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT);
+	setInfo.pNext = &flags_info;
+	VK_CHECK(vkCreateDescriptorSetLayout(_device, &setInfo, nullptr, &_bindlessSetLayout));
+
+	// update after bind sets need a pool of their own
+	VkDescriptorPoolSize sizes[] = {
+		{ VK_DESCRIPTOR_TYPE_SAMPLER, 1 },
+		{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, _bindlessCapacity }
+	};
+	VkDescriptorPoolCreateInfo pool_info = vkinit::descriptorpool_create_info(1, sizes, 2,
+		VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT);
+	VK_CHECK(vkCreateDescriptorPool(_device, &pool_info, nullptr, &_bindlessPool));
+
+	VkDescriptorSetAllocateInfo allocInfo = vkinit::descriptorset_allocate_info(_bindlessPool, 1, _bindlessSetLayout);
+	VK_CHECK(vkAllocateDescriptorSets(_device, &allocInfo, &_bindlessSet));
+
+	// same filtering as the per material sampler of the atlas
+	VkSamplerCreateInfo samplerInfo = vkinit::sampler_create_info(
+		VK_FILTER_NEAREST, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT, VK_SAMPLER_MIPMAP_MODE_LINEAR, _maxAnisotropy);
+	VkSampler bindlessSampler;
+	VK_CHECK(vkCreateSampler(_device, &samplerInfo, nullptr, &bindlessSampler));
+
+	VkDescriptorImageInfo sampler_info = {};
+	sampler_info.sampler = bindlessSampler;
+	VkWriteDescriptorSet samplerWrite = vkinit::write_descriptor_image(VK_DESCRIPTOR_TYPE_SAMPLER, _bindlessSet, &sampler_info, 0);
+	vkUpdateDescriptorSets(_device, 1, &samplerWrite, 0, nullptr);
+
+	_mainDeletionQueue.push_descriptor_set_layout(_bindlessSetLayout);
+	_mainDeletionQueue.push_descriptor_pool(_bindlessPool);
+	_mainDeletionQueue.push_sampler(bindlessSampler);
+	cout << "Bindless textures, " << _bindlessCapacity << " slots" << endl;
 }
 
 void VulkanEngine::key_event_process(int32_t keycode)
 {
 	int mode_count = obj_name.size();
 	int selected = keycode - SDLK_1;
-	if (selected < 9 && selected >= 0)
+	if (selected < 9 && selected < mode_count && selected >= 0)
 	{
 		_selectedShader = selected;
 		return;
@@ -1014,8 +2359,144 @@ size_t VulkanEngine::pad_uniform_buffer_size(size_t originalSize)
 	return alignedSize;
 }
 
+void StartupTimeline::begin()
+{
+	start = chrono::steady_clock::now();
+	lastMark = start;
+	stages.clear();
+}
+
+void StartupTimeline::mark(const std::string& stage)
+{
+	auto now = chrono::steady_clock::now();
+	record(stage, lastMark, now, false);
+	lastMark = now;
+}
+
+void StartupTimeline::record(const std::string& stage, chrono::steady_clock::time_point begin, chrono::steady_clock::time_point end, bool worker)
+{
+	lock_guard<mutex> guard(lock);
+	stages.push_back({ stage,
+		chrono::duration<double, milli>(begin - start).count(),
+		chrono::duration<double, milli>(end - start).count(),
+		worker });
+}
+
+void StartupTimeline::print()
+{
+	lock_guard<mutex> guard(lock);
+	stable_sort(stages.begin(), stages.end(), [](const Stage& a, const Stage& b) { return a.begin < b.begin; });
+	cout << "startup timeline (ms since SDL_Init):" << endl;
+	for (const Stage& stage : stages)
+	{
+		cout << (stage.worker ? "  [worker] " : "  [main]   ")
+			<< stage.begin << " - " << stage.end
+			<< " (" << stage.end - stage.begin << ")  " << stage.name << endl;
+	}
+}
+
+void VulkanEngine::draw_stats()
+{
+	ImGui::Begin("Stats");
+	ImGui::Text("frame %.3f ms", _stats.frameMs);
+	if (_pacer.fps_cap() > 0)
+	{
+		ImGui::Text("present mode %s, capped at %.0f fps", frame_pacing::present_mode_name(_presentMode), _pacer.fps_cap());
+	}
+	else
+	{
+		ImGui::Text("present mode %s, uncapped", frame_pacing::present_mode_name(_presentMode));
+	}
+	ImGui::Text("input to present %.2f ms, avg %.2f ms, max %.2f ms", _pacer.last_latency(),
+		_pacer.average_latency(), _pacer.peak_latency());
+	if (_stats.gpuMs >= 0)
+	{
+		ImGui::Text("cpu %.3f ms, gpu %.3f ms", _stats.cpuMs, _stats.gpuMs);
+	}
+	else
+	{
+		ImGui::Text("cpu %.3f ms, no gpu timestamps", _stats.cpuMs);
+	}
+	ImGui::Text("uniform update %.3f ms", _stats.uniformUpdateMs);
+	ImGui::Text("frame arena %zu / %zu bytes", _stats.frameArenaBytes, FRAME_ARENA_SIZE);
+	ImGui::Text("objects %u in %u draw calls, %u triangles", _stats.objects, _stats.drawCalls, _stats.triangles);
+	ImGui::Text("pipeline binds %u, mesh binds %u", _stats.pipelineBinds, _stats.meshBinds);
+	ImGui::Text("pipelines compiling %u, frames with fallback %llu", _stats.pendingPipelines,
+		static_cast<unsigned long long>(_stats.fallbackFrames));
+	size_t pipelineStates;
+	{
+		// compiles insert from the workers
+		lock_guard<mutex> lock(_pipelineStatesLock);
+		pipelineStates = _pipelineStates.size();
+	}
+	ImGui::Text("pipeline states %zu, hits %u, misses %u", pipelineStates,
+		_pipelineHits.load(), _pipelineMisses.load());
+	ImGui::Text("descriptor pools %zu, %llu sets, %.2f us per allocation",
+		_descriptorAllocator.pool_count(),
+		static_cast<unsigned long long>(_descriptorAllocator.allocations()), _descriptorAllocator.average_allocation_us());
+	ImGui::Text("descriptor layouts %zu, cache hits %u, misses %u", _descriptorLayoutCache.layout_count(),
+		_descriptorLayoutCache.hits(), _descriptorLayoutCache.misses());
+	if (_bindless)
+	{
+		ImGui::Text("bindless textures %u / %u", _bindlessTextureCount, _bindlessCapacity);
+	}
+	if (_textureStreaming)
+	{
+		ImGui::Text("textures %.1f / %.1f MiB, %u loads, %u evictions", _stats.textureBytes / 1048576.0,
+			_stats.textureBudget / 1048576.0, _stats.textureSwaps, _stats.textureEvictions);
+		for (const StreamedTexture& streamed : _streamedTextures)
+		{
+			ImGui::Text("  %s: mip %u (wants %u)%s", streamed.name.c_str(), streamed.residentLevel, streamed.wantedLevel,
+				streamed.loading ? ", loading" : "");
+		}
+	}
+	ImGui::Checkbox("frustum culling", &_cullingEnabled);
+	ImGui::Text("visible %u, culled %u, %.3f ms (%s)", _stats.visible, _stats.culled, _stats.cullMs,
+		culling::kernel_name(culling::best_kernel()));
+	if (_cullPipeline != VK_NULL_HANDLE)
+	{
+		ImGui::Checkbox("gpu culling", &_gpuCulling);
+		ImGui::SameLine();
+		ImGui::Checkbox("check against cpu", &_gpuCullVerify);
+		ImGui::Text("gpu visible %u, batches differing from cpu %u", _stats.gpuVisible, _stats.gpuMismatches);
+	}
+	ImGui::End();
+}
+
+void VulkanEngine::draw_gpu_profiler()
+{
+	ImGui::Begin("GPU");
+	if (_timestampMask == 0)
+	{
+		ImGui::Text("the graphics queue has no timestamps");
+		ImGui::End();
+		return;
+	}
+	ImGui::Text("frame %d, last %zu frames", _stats.gpuFrame, _gpuHistory.count);
+	for (const GpuTimingHistory::Track& track : _gpuHistory.tracks)
+	{
+		float peak = _gpuHistory.peak(track);
+		char overlay[64];
+		snprintf(overlay, sizeof(overlay), "avg %.3f ms, max %.3f ms", _gpuHistory.average(track), peak);
+		// nested scopes are indented under their parent
+		float indent = track.depth * 8.f;
+		if (indent > 0.f)
+		{
+			ImGui::Indent(indent);
+		}
+		ImGui::PlotLines(track.name, track.ms.data(), static_cast<int>(track.ms.size()),
+			static_cast<int>(_gpuHistory.next), overlay, 0.f, max(peak, 0.001f), ImVec2(0, 40));
+		if (indent > 0.f)
+		{
+			ImGui::Unindent(indent);
+		}
+	}
+	ImGui::End();
+}
+
 void VulkanEngine::init_imgui()
 {
+	CPU_ZONE("init_imgui");
 	//1: create descriptor pool for IMGUI
 // the size of the pool is very oversize, but it's copied from imgui demo itself.
 	VkDescriptorPoolSize pool_sizes[] =
@@ -1058,6 +2539,7 @@ void VulkanEngine::init_imgui()
 	init_info.PhysicalDevice = _choseGPU;
 	init_info.Device = _device;
 	init_info.Queue = _graphicsQueue;
+	init_info.PipelineCache = _pipelineCache.cache();
 	init_info.DescriptorPool = imguiPool;
 	init_info.MinImageCount = 2; // 3
 	init_info.ImageCount = 2; // 3
@@ -1083,23 +2565,43 @@ void VulkanEngine::init_imgui()
 
 void VulkanEngine::init()
 {
-	// We initialize SDL and create a window with it. 
-	SDL_Init(SDL_INIT_VIDEO);
+	if (!_cpuTracePath.empty())
+	{
+		cpu_profiler::start();
+	}
+	CPU_THREAD_NAME("main");
+	CPU_ZONE("init");
+	_startup.begin();
+	if (!_headless)
+	{
+		// We initialize SDL and create a window with it. 
+		SDL_Init(SDL_INIT_VIDEO);
+		_startup.mark("SDL_Init");
+
+		SDL_WindowFlags window_flags = (SDL_WindowFlags)(SDL_WINDOW_VULKAN);
+
+		_window = SDL_CreateWindow(
+			"Vulkan Engine",
+			SDL_WINDOWPOS_UNDEFINED,
+			SDL_WINDOWPOS_UNDEFINED,
+			_windowExtent.width,
+			_windowExtent.height,
+			window_flags
+		);
+		_startup.mark("SDL_CreateWindow");
+	}
 
-	SDL_WindowFlags window_flags = (SDL_WindowFlags)(SDL_WINDOW_VULKAN);
+	load_config();
 
-	_window = SDL_CreateWindow(
-		"Vulkan Engine",
-		SDL_WINDOWPOS_UNDEFINED,
-		SDL_WINDOWPOS_UNDEFINED,
-		_windowExtent.width,
-		_windowExtent.height,
-		window_flags
-	);
+	_jobs.init();
+	kick_asset_loading();
+	_startup.mark("load_config + asset jobs queued");
 
 	init_vulkan();
+	_startup.mark("init_vulkan");
 	
 	init_swapchain();
+	_startup.mark("init_swapchain");
 
 	init_commands();
 
@@ -1110,51 +2612,147 @@ void VulkanEngine::init()
 	init_sync_struct();
 
 	init_descriptors();
+	init_bindless();
+	_startup.mark("init_commands .. init_descriptors");
 
+	auto pipelines_start = chrono::steady_clock::now();
 	init_pipelines();
+	init_gpu_culling();
+	cout << "init_pipelines took " << chrono::duration<double, milli>(chrono::steady_clock::now() - pipelines_start).count()
+		<< " ms with a " << (_pipelineCache.warm() ? "warm" : "cold") << " pipeline cache ("
+		<< _pipelineCache.loaded_bytes() << " bytes loaded)" << endl;
+	_startup.mark("init_pipelines");
 	//everything went fine
+	// all texture and mesh copies go to the transfer queue in a single submit,
+	// nothing waits for it, objects show up once their upload token completed
 	load_images();
 
 	load_mesh();
+	_startup.mark("wait for assets + stage");
+
+	_upload.flush();
+	_startup.mark("upload submit (" + to_string(_upload.bytes_in_flight()) + " bytes)");
 
 	init_scene();
 
-	init_imgui();
+	if (!_headless)
+	{
+		init_imgui();
+	}
+	_startup.mark("init_scene + init_imgui");
 
 	_isInitialized = true;
 }
 void VulkanEngine::cleanup()
 {
 	if (_isInitialized) {
+		CPU_ZONE("cleanup");
+		// compiles still running must finish before their pipelines can be destroyed
+		_jobs.wait(_pipelineCompiles);
+		publish_pipelines();
+		_jobs.shutdown();
 		--_frameNumber; // in draw call last it ++
 		vkWaitForFences(_device, 1, &get_current_frame()._renderFence, true, 1000000000);
 
-		_mainDeletionQueue.flush();
+		// everything compiled this run, the next start is warm
+		if (!_pipelineCache.save())
+		{
+			cout << "failed to write the pipeline cache to " << PIPELINE_CACHE_PATH << endl;
+		}
+		for (int i = 0; i < FRAME_OVERLAP; i++)
+		{
+			_frames[i]._deletionQueue.flush(_device, _allocator);
+		}
+		_mainDeletionQueue.flush(_device, _allocator);
 
-		vkDestroySurfaceKHR(_instances, _surface, nullptr);
+		if (_surface != VK_NULL_HANDLE)
+		{
+			vkDestroySurfaceKHR(_instances, _surface, nullptr);
+		}
 		
 		vkDestroyDevice(_device, nullptr);
 		
 		vkb::destroy_debug_utils_messenger(_instances, _debug_Message);
 		vkDestroyInstance(_instances, nullptr);
 		
-		SDL_DestroyWindow(_window);
+		if (_window)
+		{
+			SDL_DestroyWindow(_window);
+		}
+	}
+
+	if (!_cpuTracePath.empty())
+	{
+		cpu_profiler::stop();
+		if (cpu_profiler::write_trace(_cpuTracePath))
+		{
+			cout << "cpu trace written to " << _cpuTracePath << ", open it in chrome://tracing or ui.perfetto.dev" << endl;
+		}
+		else
+		{
+			cout << "failed to write the cpu trace to " << _cpuTracePath << endl;
+		}
 	}
 }
 
 void VulkanEngine::draw()
 {
-	VK_CHECK(vkWaitForFences(_device, 1, &get_current_frame()._renderFence, true, 1000000000));
+	CPU_ZONE("draw");
+	{
+		CPU_ZONE("wait for frame fence");
+		VK_CHECK(vkWaitForFences(_device, 1, &get_current_frame()._renderFence, true, 1000000000));
+	}
 	VK_CHECK(vkResetFences(_device, 1, &get_current_frame()._renderFence));
-	VK_CHECK(vkResetCommandBuffer(get_current_frame()._commandBuffer, 0));
+	auto cpu_start = chrono::steady_clock::now();
+	{
+		CPU_ZONE("frame setup");
+		read_frame_timestamps(get_current_frame());
+		check_gpu_culling(get_current_frame());
+		publish_pipelines();
+		// the gpu is done with this frame's arena window
+		get_current_frame()._deletionQueue.flush(_device, _allocator);
+		get_current_frame()._frameAllocator.reset();
+		VK_CHECK(vkResetCommandBuffer(get_current_frame()._commandBuffer, 0));
+		_upload.collect();
+		// after the flush, a texture it retires stays alive until this frame slot comes around again
+		update_texture_streaming();
+	}
 
 	uint32_t swapchainImageIndex; 
-	VK_CHECK(vkAcquireNextImageKHR(_device, _swapchain, 1000000000, get_current_frame()._presentSem, nullptr, &swapchainImageIndex));
+	if (_headless)
+	{
+		// the fence above already covers the offscreen image of this frame
+		swapchainImageIndex = _frameNumber % FRAME_OVERLAP;
+	}
+	else
+	{
+		CPU_ZONE("acquire");
+		VK_CHECK(vkAcquireNextImageKHR(_device, _swapchain, 1000000000, get_current_frame()._presentSem, nullptr, &swapchainImageIndex));
+	}
 	
 
 	VkCommandBuffer cmd = get_current_frame()._commandBuffer;
 	VkCommandBufferBeginInfo cmd_info = vkinit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
 	VK_CHECK(vkBeginCommandBuffer(cmd, &cmd_info));  // buid the cmd buffer 
+	GpuProfiler& profiler = get_current_frame()._gpuProfiler;
+	profiler.begin_frame(cmd, _frameNumber);
+	// read_frame_timestamps takes the first scope as the frame time
+	uint32_t frame_scope = profiler.begin_scope(cmd, "frame");
+
+	// culling (on the gpu a compute dispatch) has to be recorded outside the render pass
+	{
+		CPU_ZONE("prepare_objects");
+		GpuScope scope(profiler, cmd, "culling");
+		if (_stressObjectCount > 0)
+		{
+			prepare_objects(cmd, _renderObject.data(), static_cast<int>(_renderObject.size()));
+		}
+		else
+		{
+			// model viewer, only the model picked with the number keys
+			prepare_objects(cmd, &_renderObject[_selectedShader], 1);
+		}
+	}
 
 	VkClearValue clearValue;
 	float flash = abs(sin(_frameNumber / 120.f));
@@ -1172,28 +2770,66 @@ void VulkanEngine::draw()
 										&clearValues[0], 2
 										);
 	
+	uint32_t pass_scope = profiler.begin_scope(cmd, "render_pass");
 	vkCmdBeginRenderPass(cmd, &rendpass_info, VK_SUBPASS_CONTENTS_INLINE);
 	
 	// the place
 	//if (_selectedShader == 1)
 	//{
-	draw_object(cmd, _renderObject.data(), _renderObject.size());
+	draw_object(cmd);
 	//}
 	//vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _trianglePipelines[_selectedShader]);
 
 
 	vkCmdEndRenderPass(cmd);
+	profiler.end_scope(cmd, pass_scope);
+	profiler.end_scope(cmd, frame_scope);
 	VK_CHECK(vkEndCommandBuffer(cmd));
 
+	// uploads recorded while building this frame start now, on their own queue
+	{
+		CPU_ZONE("upload flush");
+		_upload.flush();
+	}
+
 	// submit
-	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	// the timeline wait is on a value already observed as signaled, it never
+	// blocks but orders the transfer writes before every read of this frame
+	VkSemaphore waitSemaphores[2] = { get_current_frame()._presentSem, _upload.timeline() };
+	VkPipelineStageFlags waitStages[2] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT };
+	uint64_t waitValues[2] = { 0, _upload.completed_value() };
+	VkTimelineSemaphoreSubmitInfo timeline_info = {};
+	timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timeline_info.waitSemaphoreValueCount = 2;
+	timeline_info.pWaitSemaphoreValues = waitValues;
+
 	VkSubmitInfo submit_info = vkinit::submit_info(
 							&cmd,
-							&waitStage,
-							&get_current_frame()._presentSem, 1,
+							waitStages,
+							waitSemaphores, 2,
 							&get_current_frame()._renderSem, 1
 							);
-	VK_CHECK(vkQueueSubmit(_graphicsQueue, 1, &submit_info, get_current_frame()._renderFence)); //send to GPU
+	submit_info.pNext = &timeline_info;
+	if (_headless)
+	{
+		// nothing acquires or presents, only the upload timeline is waited on
+		submit_info.waitSemaphoreCount = 1;
+		submit_info.pWaitSemaphores = &waitSemaphores[1];
+		submit_info.pWaitDstStageMask = &waitStages[1];
+		submit_info.signalSemaphoreCount = 0;
+		timeline_info.waitSemaphoreValueCount = 1;
+		timeline_info.pWaitSemaphoreValues = &waitValues[1];
+	}
+	{
+		CPU_ZONE("submit");
+		VK_CHECK(vkQueueSubmit(_graphicsQueue, 1, &submit_info, get_current_frame()._renderFence)); //send to GPU
+	}
+	_stats.cpuMs = chrono::duration<double, milli>(chrono::steady_clock::now() - cpu_start).count();
+	if (_headless)
+	{
+		_frameNumber++;
+		return;
+	}
 	
 	//Display
 	VkPresentInfoKHR presentInfo = vkinit::present_info(
@@ -1201,46 +2837,267 @@ void VulkanEngine::draw()
 								&get_current_frame()._renderSem, 1,
 								&swapchainImageIndex
 								);
-	VK_CHECK(vkQueuePresentKHR(_graphicsQueue, &presentInfo));
+	{
+		CPU_ZONE("present");
+		VK_CHECK(vkQueuePresentKHR(_graphicsQueue, &presentInfo));
+	}
+	_pacer.presented();
 	_frameNumber++;
 
 }
 
 void VulkanEngine::run()
 {
+	if (!_benchmarkName.empty())
+	{
+		run_benchmark();
+		return;
+	}
+	if (_headless)
+	{
+		run_headless();
+		return;
+	}
 	SDL_Event e;
 	bool bQuit = false;
 
-	//main loop
+	auto last_frame = chrono::steady_clock::now();
+	//main loop, one input, update and draw step per iteration
 	while (!bQuit)
 	{
+		{
+			// the cap slot first, then the gpu, so the input polled below is the
+			// newest this frame can be built from
+			CPU_ZONE("pacing");
+			_pacer.wait();
+			VK_CHECK(vkWaitForFences(_device, 1, &get_current_frame()._renderFence, true, 1000000000));
+		}
+		auto frame_start = chrono::steady_clock::now();
+		_stats.frameMs = chrono::duration<double, milli>(frame_start - last_frame).count();
+		last_frame = frame_start;
 		//Handle events on queue
+		{
+			CPU_ZONE("events");
+			uint32_t ticks = SDL_GetTicks();
+			while (SDL_PollEvent(&e) != 0)
+			{
+				if (e.type == SDL_KEYDOWN || e.type == SDL_MOUSEBUTTONDOWN || e.type == SDL_MOUSEMOTION)
+				{
+					// SDL stamps events in ms when they are queued
+					_pacer.input(frame_start - chrono::milliseconds(ticks - min(ticks, e.common.timestamp)));
+				}
+				//close the window when user alt-f4s or clicks the X button		
+				ImGui_ImplSDL2_ProcessEvent(&e);
+				if (e.type == SDL_QUIT)
+				{
+					bQuit = true;
+				}
+				else if (e.type == SDL_KEYDOWN)
+				{
+					key_event_process(e.key.keysym.sym);
+				}
+			}
+		}
+		{
+			CPU_ZONE("imgui");
+			ImGui_ImplVulkan_NewFrame();
+			ImGui_ImplSDL2_NewFrame(_window);
+
+			ImGui::NewFrame();
+
+
+			//imgui commands
+			draw_stats();
+			draw_gpu_profiler();
+		}
+
+		//your draw function
+		draw();
+		if (_frameNumber == 1)
+		{
+			_startup.mark("first frame");
+			_startup.print();
+			// what the first frame did not ask for compiles in the background now
+			request_all_pipelines();
+		}
+	}
+}
+
+bool VulkanEngine::step_frame()
+{
+	if (!_headless)
+	{
+		// only quitting is handled, keys would change what is measured
+		SDL_Event e;
 		while (SDL_PollEvent(&e) != 0)
 		{
-			//close the window when user alt-f4s or clicks the X button		
 			ImGui_ImplSDL2_ProcessEvent(&e);
 			if (e.type == SDL_QUIT)
 			{
-				bQuit = true;
-			}
-			else if (e.type == SDL_KEYDOWN)
-			{
-				key_event_process(e.key.keysym.sym);
+				return false;
 			}
 		}
 		ImGui_ImplVulkan_NewFrame();
 		ImGui_ImplSDL2_NewFrame(_window);
-
 		ImGui::NewFrame();
+		draw_stats();
+		draw_gpu_profiler();
+	}
+	draw();
+	return true;
+}
+
+void VulkanEngine::warm_up()
+{
+	// the first frame queues its pipelines, then everything else compiles and
+	// every upload lands before anything is timed
+	step_frame();
+	_startup.mark("first frame");
+	_startup.print();
+	request_all_pipelines();
+	_jobs.wait(_pipelineCompiles);
+	_upload.wait(_upload.flush());
+	for (int i = 0; i < FRAME_OVERLAP; i++)
+	{
+		step_frame();
+	}
+	_stats.fallbackFrames = 0;
+}
 
+bool VulkanEngine::read_frame_timestamps(FrameData& frame)
+{
+	if (!frame._gpuProfiler.resolve(_gpuScopeTimes))
+	{
+		return false;
+	}
+	_stats.gpuMs = _gpuScopeTimes[0].ms;
+	_stats.gpuFrame = frame._gpuProfiler.frame();
+	_gpuHistory.add(_gpuScopeTimes);
+	return true;
+}
 
-		//imgui commands
-		ImGui::ShowDemoWindow();
+void VulkanEngine::apply_benchmark_frame(uint32_t frame)
+{
+	RenderObject& object = _renderObject[_selectedShader];
+	object.camPos = benchmark::sample_track(_benchmarkScene.camera, frame, object.camPos);
+	_movestatus.camPos = { 0.f, 0.f, 0.f };
 
-		//your draw function
-		draw();
+	glm::vec3 angles = glm::radians(benchmark::sample_track(_benchmarkScene.rotation, frame, glm::vec3(0.f)));
+	_movestatus.transformMatrix = glm::rotate(glm::mat4{ 1.0f }, angles.x, glm::vec3(1, 0, 0))
+		* glm::rotate(glm::mat4{ 1.0f }, angles.y, glm::vec3(0, 1, 0))
+		* glm::rotate(glm::mat4{ 1.0f }, angles.z, glm::vec3(0, 0, 1));
+}
 
-		draw();
+void VulkanEngine::run_benchmark()
+{
+	const BenchmarkScene& scene = _benchmarkScene;
+	apply_benchmark_frame(0);
+	warm_up();
+	for (uint32_t i = 0; i < scene.warmupFrames; i++)
+	{
+		if (!step_frame())
+		{
+			return;
+		}
+	}
+
+	_benchmarkReport.begin(scene, _gpuProperties.deviceName, _windowExtent.width, _windowExtent.height);
+	int first_frame = _frameNumber;
+	auto record_gpu_time = [&]() {
+		if (_stats.gpuFrame < first_frame)
+		{
+			return;
+		}
+		size_t frame = static_cast<size_t>(_stats.gpuFrame - first_frame);
+		_benchmarkReport.set_gpu_ms(frame, _stats.gpuMs);
+		// scope 0 is the whole frame, already gpu_ms
+		for (size_t s = 1; s < _gpuScopeTimes.size(); s++)
+		{
+			_benchmarkReport.set_gpu_scope(frame, _gpuScopeTimes[s].name, _gpuScopeTimes[s].ms);
+		}
+	};
+
+	size_t uploaded = _upload.bytes_uploaded();
+	auto last_frame = chrono::steady_clock::now();
+	for (uint32_t i = 0; i < scene.frames; i++)
+	{
+		apply_benchmark_frame(i);
+		if (!step_frame())
+		{
+			cout << "benchmark " << scene.name << " stopped after " << i << " frames" << endl;
+			break;
+		}
+		auto now = chrono::steady_clock::now();
+		_stats.frameMs = chrono::duration<double, milli>(now - last_frame).count();
+		last_frame = now;
+
+		BenchmarkFrame frame;
+		frame.frameMs = _stats.frameMs;
+		frame.cpuMs = _stats.cpuMs;
+		frame.drawCalls = _stats.drawCalls;
+		frame.triangles = _stats.triangles;
+		frame.pipelineBinds = _stats.pipelineBinds;
+		frame.meshBinds = _stats.meshBinds;
+		frame.objects = _stats.objects;
+		frame.uploadBytes = _upload.bytes_uploaded() - uploaded;
+		uploaded = _upload.bytes_uploaded();
+		_benchmarkReport.add(frame);
+		// draw() read the timestamps of the frame that used this FrameData last
+		record_gpu_time();
+	}
+
+	// the frames still in flight
+	VK_CHECK(vkDeviceWaitIdle(_device));
+	for (FrameData& frame : _frames)
+	{
+		if (read_frame_timestamps(frame))
+		{
+			record_gpu_time();
+		}
+	}
+
+	_benchmarkReport.print();
+	string json_path = _benchmarkOutput + ".json";
+	string csv_path = _benchmarkOutput + ".csv";
+	if (!_benchmarkReport.write_json(json_path) || !_benchmarkReport.write_csv(csv_path))
+	{
+		cout << "failed to write " << json_path << " or " << csv_path << endl;
+		return;
 	}
+	cout << "report written to " << json_path << " and " << csv_path << endl;
 }
 
+void VulkanEngine::run_headless()
+{
+	warm_up();
+
+	vector<double> frameMs;
+	frameMs.reserve(_headlessFrames);
+	auto last_frame = chrono::steady_clock::now();
+	for (uint32_t i = 0; i < _headlessFrames; i++)
+	{
+		draw();
+		// with no present a frame is paced by the fence wait at the start of the next draw
+		auto now = chrono::steady_clock::now();
+		_stats.frameMs = chrono::duration<double, milli>(now - last_frame).count();
+		frameMs.push_back(_stats.frameMs);
+		last_frame = now;
+	}
+	VK_CHECK(vkDeviceWaitIdle(_device));
+	if (frameMs.empty())
+	{
+		return;
+	}
+
+	BenchmarkSummary summary = benchmark::summarize(frameMs);
+	cout << "headless " << summary.count << " frames at " << _windowExtent.width << "x" << _windowExtent.height
+		<< " on " << _gpuProperties.deviceName << endl;
+	cout << "  frame ms: min " << summary.min
+		<< ", avg " << summary.avg
+		<< ", median " << summary.p50
+		<< ", p99 " << summary.p99
+		<< ", max " << summary.max << endl;
+	cout << "  " << 1000.0 / summary.avg << " fps, "
+		<< _stats.objects << " objects in " << _stats.drawCalls << " draw calls, "
+		<< _stats.fallbackFrames << " frames with fallback pipelines" << endl;
+}
@@ -4,13 +4,60 @@
 #pragma once
 
 #include <vk_types.h>
+#include <vk_jobs.h>
+#include <vk_mesh_cache.h>
+#include <vk_upload.h>
+#include <vk_linear_allocator.h>
+#include <vk_culling.h>
+#include <vk_pipeline_cache.h>
+#include <vk_descriptors.h>
+#include <vk_deletion_queue.h>
+#include <vk_benchmark.h>
+#include <vk_gpu_profiler.h>
+#include <vk_frame_pacing.h>
 #include <vector>
 #include <string>
+#include <atomic>
 #include <functional>
-#include <deque>
+#include <chrono>
+#include <memory>
+#include <mutex>
 #include <glm/glm.hpp>
 #include <unordered_map>
 constexpr unsigned int FRAME_OVERLAP = 2;
+constexpr VkDeviceSize UPLOAD_RING_SIZE = 64 * 1024 * 1024;
+// per frame window of the frame arena, holds the camera, scene, object and cull data
+constexpr size_t FRAME_ARENA_SIZE = 16 * 1024 * 1024;
+constexpr uint32_t MAX_OBJECTS = 100000;
+// indirect commands per frame for the gpu culling path
+constexpr uint32_t MAX_DRAW_BATCHES = 4096;
+// next to shader_config.json, written back at cleanup
+constexpr const char* PIPELINE_CACHE_PATH = "vulkan_guide.pipelinecache";
+// upper bound of the bindless texture array, lowered to the device limits
+constexpr uint32_t MAX_BINDLESS_TEXTURES = 4096;
+// drawn instead of a material whose pipeline is still compiling
+constexpr const char* FALLBACK_MATERIAL = "defaultmesh";
+// texture sampler anisotropy, lowered to the device limit
+constexpr float MAX_ANISOTROPY = 16.f;
+// streamed textures start with the mips up to this size resident
+constexpr uint32_t STREAMING_FIRST_SIZE = 256;
+// share of the heap budget left after everything else the textures may take
+constexpr float STREAMING_BUDGET_SHARE = 0.9f;
+
+// Every piece of PipelineBuilder state that ends up in the pipeline, packed
+// into bytes: two builders with equal keys build the same VkPipeline.
+struct PipelineKey {
+	std::vector<uint8_t> bytes;
+	uint64_t hash{ 0 };
+
+	bool operator==(const PipelineKey& other) const {
+		return hash == other.hash && bytes == other.bytes;
+	}
+};
+
+struct PipelineKeyHash {
+	size_t operator()(const PipelineKey& key) const { return static_cast<size_t>(key.hash); }
+};
 
 class PipelineBuilder {
 public:
@@ -25,24 +72,9 @@ public:
 	VkPipelineMultisampleStateCreateInfo _mulsampling;
 	VkPipelineLayout _pipelineLayout;
 
-	VkPipeline build_pipline(VkDevice device, VkRenderPass renderpass);
-};
-
-struct DeletionQueue
-{
-	std::deque<std::function<void()>> deletors;
-
-	void push_function(std::function<void()>&& function) {
-		deletors.push_back(function);
-	}
-	
-	void flush() {
-		// reverse iterate the deletion queue to execute all the functions
-		for (auto it = deletors.rbegin(); it != deletors.rend(); it++) {
-			(*it)(); //call the function
-		}
-		deletors.clear();
-	}
+	VkPipeline build_pipline(VkDevice device, VkRenderPass renderpass, VkPipelineCache cache = VK_NULL_HANDLE);
+	// shader modules, vertex input, rasterizer, blend, depth, layout and render pass
+	PipelineKey key(VkRenderPass renderpass) const;
 };
 
 struct MeshPushConstants {
@@ -52,8 +84,39 @@ struct MeshPushConstants {
 
 struct Material {
 	VkDescriptorSet textureSet{ VK_NULL_HANDLE };
+	// the image behind textureSet, not sampled before it completes
+	UploadToken textureUpload{};
+	// VK_NULL_HANDLE until its compile is published, draws use the fallback meanwhile
 	VkPipeline pipeline;
 	VkPipelineLayout pipelineLayout;
+	// index into material_config, -1 for materials not built from the config
+	int config{ -1 };
+};
+
+enum class PipelineState { Idle, Compiling, Ready, Failed, Published };
+
+// compile of one material_config entry, the job writes pipeline before it
+// stores Ready, the main thread hands it to the material in publish_pipelines
+struct PipelineJob {
+	std::atomic<PipelineState> state{ PipelineState::Idle };
+	VkPipeline pipeline{ VK_NULL_HANDLE };
+};
+
+// one "material" entry of shader_config.json, everything its pipeline is built from
+struct MaterialConfig {
+	std::string name;
+	std::string vertexShader;
+	std::string fragmentShader;
+	// "mesh", "textured" or "bindless"
+	std::string layout;
+	// material drawn instead when the engine runs with --bindless
+	std::string bindlessVariant;
+	VkPolygonMode polygonMode{ VK_POLYGON_MODE_FILL };
+	VkCullModeFlags cullMode{ VK_CULL_MODE_NONE };
+	bool depthTest{ true };
+	bool depthWrite{ true };
+	VkCompareOp depthCompare{ VK_COMPARE_OP_LESS_OR_EQUAL };
+	bool blend{ false };
 };
 
 struct RenderObject
@@ -62,6 +125,20 @@ struct RenderObject
 	Material* material;
 	glm::vec3 camPos;
 	glm::mat4 transformMatrix;
+	// slot of its texture in the bindless array
+	uint32_t textureIndex{ 0 };
+	// index into _streamedTextures, -1 for untextured objects
+	int streamedTexture{ -1 };
+};
+
+// consecutive objects of _drawOrder sharing mesh and material, drawn as
+// count instances starting at object buffer entry first
+struct DrawBatch
+{
+	Material* material;
+	Mesh* mesh;
+	uint32_t first;
+	uint32_t count;
 };
 
 struct movestatus
@@ -79,6 +156,20 @@ struct GPUCameraData {
 
 struct GPUObjectData {
 	glm::mat4 modelMatrix;
+	// x: RenderObject::textureIndex
+	glm::uvec4 params;
+};
+
+// per object input of cull.comp, sphere in object space
+struct GPUCullData {
+	glm::vec4 sphere;
+	uint32_t batch;
+	uint32_t pad[3];
+};
+
+struct GPUCullConstants {
+	glm::vec4 planes[6];
+	uint32_t objectCount;
 };
 
 struct GPUSenceData{
@@ -101,18 +192,172 @@ struct FrameData {
 	VkCommandPool _commandPool;
 	VkCommandBuffer _commandBuffer;
 
+	// reset after _renderFence, every per frame uniform goes through it
+	LinearAllocator _frameAllocator;
+	// objects the frames in flight may still use, flushed after _renderFence
+	DeletionQueue _deletionQueue;
+	// dynamic offsets of the global set: camera, scene, objects
+	uint32_t _globalOffsets[3];
+
+	// gpu culling: cull.comp fills one indirect command per batch and the
+	// compacted object buffer the vertex shader reads through _gpuGlobalDescriptor
+	AllocatedBuffer _drawCommands;
+	AllocatedBuffer _visibleObjectBuffer;
+	// host copy of _drawCommands, _drawCommandsData maps it
+	AllocatedBuffer _drawCommandsReadback;
+	VkDrawIndexedIndirectCommand* _drawCommandsData{ nullptr };
+	VkDescriptorSet _cullDescriptor;
+	VkDescriptorSet _gpuGlobalDescriptor;
+	// batches culled on the gpu in the frame recorded here, 0 when it culled on the cpu
+	uint32_t _gpuBatchCount{ 0 };
+	// cpu culled instances per batch of that frame, compared with _drawCommandsData
+	// once _renderFence signaled, empty when not verifying
+	std::vector<uint32_t> _cpuBatchVisible;
+
+	// timestamp scopes of _commandBuffer, resolved after _renderFence
+	GpuProfiler _gpuProfiler;
 };
 
-struct AllFrameAllocatedBuffer
-{
-	AllocatedBuffer _cameraBuffer;
-	AllocatedBuffer _objectBuffer;
-	AllocatedBuffer _senneParameterBuffer;
+// cpu side numbers of the last frame, shown in the Stats window
+struct EngineStats {
+	double frameMs{ 0 };
+	// draw() after the fence wait up to the submit
+	double cpuMs{ 0 };
+	// "frame" scope of frame gpuFrame, read FRAME_OVERLAP frames late, -1 without timestamps
+	double gpuMs{ -1 };
+	int gpuFrame{ -1 };
+	double uniformUpdateMs{ 0 };
+	size_t frameArenaBytes{ 0 };
+	uint32_t objects{ 0 };
+	uint32_t drawCalls{ 0 };
+	uint32_t triangles{ 0 };
+	uint32_t pipelineBinds{ 0 };
+	uint32_t meshBinds{ 0 };
+	uint32_t visible{ 0 };
+	uint32_t culled{ 0 };
+	double cullMs{ 0 };
+	// read back FRAME_OVERLAP frames late from the indirect commands
+	uint32_t gpuVisible{ 0 };
+	uint32_t gpuTriangles{ 0 };
+	uint32_t gpuMismatches{ 0 };
+	uint32_t pendingPipelines{ 0 };
+	uint64_t fallbackFrames{ 0 };
+	VkDeviceSize textureBytes{ 0 };
+	VkDeviceSize textureBudget{ 0 };
+	uint32_t textureSwaps{ 0 };
+	uint32_t textureEvictions{ 0 };
 };
 
 struct Texture {
 	AllocatedImage image;
 	VkImageView imageView;
+	UploadToken upload{};
+	// slot in the bindless array, the load order
+	uint32_t bindlessIndex{ 0 };
+	uint32_t mipLevels{ 1 };
+	// index into _streamedTextures, -1 when it is fully resident
+	int streamIndex{ -1 };
+};
+
+// one mip level ready to copy, data points into its DecodedImage
+struct ImageLevel {
+	const uint8_t* data;
+	size_t size;
+	uint32_t width;
+	uint32_t height;
+};
+
+// cpu side of a texture, owned until file_box::free_image. PNG textures are
+// decoded to rgba8 with a mip chain built on the worker, KTX2 textures stay
+// mapped and their blocks are copied as they are.
+struct DecodedImage {
+	VkFormat format{ VK_FORMAT_R8G8B8A8_SRGB };
+	int width{ 0 };
+	int height{ 0 };
+	// every level, level 0 included, empty when loading failed
+	std::vector<ImageLevel> levels;
+
+	unsigned char* pixels{ nullptr };
+	// levels 1.. of a png mip chain
+	std::vector<uint8_t> mipData;
+	std::unique_ptr<MappedFile> file;
+
+	uint32_t mip_levels() const { return static_cast<uint32_t>(levels.size()); }
+	size_t byte_size() const
+	{
+		size_t bytes = 0;
+		for (const ImageLevel& level : levels)
+		{
+			bytes += level.size;
+		}
+		return bytes;
+	}
+};
+
+// A texture whose resident mips follow its on-screen size. The image only
+// holds levels residentLevel.., a residency change uploads a new image from
+// source and swaps it in once the copy completed, see update_texture_streaming.
+struct StreamedTexture {
+	std::string name;
+	// every level on the cpu (png decoded, ktx2 mapped)
+	DecodedImage source;
+	uint32_t residentLevel{ 0 };
+	VkDeviceSize residentBytes{ 0 };
+	// finest level its objects need, before the budget
+	uint32_t wantedLevel{ 0 };
+	// largest on-screen diameter of its objects in pixels, last frame
+	float screenSize{ 0.f };
+
+	// image being uploaded
+	bool loading{ false };
+	uint32_t loadingLevel{ 0 };
+	Texture loadingTexture;
+	VkDeviceSize loadingBytes{ 0 };
+
+	// first frame the next swap may happen, the frames in flight still
+	// sample the previous image through the other binding set
+	int settledFrame{ 0 };
+};
+
+// a material sampling a streamed texture, written to the set the frames in
+// flight are not using when the image changes
+struct TextureBinding {
+	Material* material;
+	int streamedTexture;
+	VkSampler sampler;
+	VkDescriptorSet sets[2];
+	uint32_t current{ 0 };
+};
+
+// obj parsed (or cache mapped) on a worker, waiting for its upload
+struct PendingMesh {
+	std::string name;
+	Mesh mesh;
+	MappedFile cacheFile;
+	const MeshCacheHeader* cache{ nullptr };
+	bool loaded{ false };
+};
+
+// wall clock of every startup stage, from SDL_Init to the first frame
+struct StartupTimeline {
+	struct Stage {
+		std::string name;
+		double begin;
+		double end;
+		bool worker;
+	};
+	std::chrono::steady_clock::time_point start;
+	std::chrono::steady_clock::time_point lastMark;
+	std::mutex lock;
+	std::vector<Stage> stages;
+
+	void begin();
+	// main thread stage, runs from the previous mark to now
+	void mark(const std::string& stage);
+	// any thread, explicit range
+	void record(const std::string& stage, std::chrono::steady_clock::time_point begin,
+		std::chrono::steady_clock::time_point end, bool worker = true);
+	void print();
 };
 
 
@@ -126,12 +371,50 @@ public:
 	VkExtent2D _windowExtent{ 1700 , 900 };
 
 	struct SDL_Window* _window{ nullptr };
+	// no window, surface or swapchain: draw() renders into offscreen images
+	// and run() times _headlessFrames frames, see run_headless
+	bool _headless{ false };
+	uint32_t _headlessFrames{ 1000 };
+	std::vector<AllocatedImage> _offscreenImages;
+	// --benchmark: the scene of json/benchmarks.json run instead of the
+	// interactive loop, reported to <_benchmarkOutput>.json and .csv
+	std::string _benchmarkName;
+	std::string _benchmarkOutput;
+	BenchmarkScene _benchmarkScene;
+	benchmark::Report _benchmarkReport;
+	// --cpu-trace: the CPU zones from init to cleanup, written as chrome trace json
+	std::string _cpuTracePath;
+	// --present-mode asks for it, init_swapchain keeps what the surface supports
+	VkPresentModeKHR _presentMode{ VK_PRESENT_MODE_FIFO_KHR };
+	// --fps-cap, 0 uncapped, negative picks one for the present mode in init_swapchain
+	double _fpsCap{ -1 };
+	FramePacer _pacer;
+	// ticks to ns and the valid bits of the graphics queue, 0 without timestamps
+	float _timestampPeriod{ 0.f };
+	uint64_t _timestampMask{ 0 };
+	// scopes of the last resolved frame, "frame" first, and their graphs
+	std::vector<GpuScopeTime> _gpuScopeTimes;
+	GpuTimingHistory _gpuHistory;
 
 	VkInstance _instances;
 	VkPhysicalDevice _choseGPU;
 	VkPhysicalDeviceProperties _gpuProperties;
+	// 1 when samplerAnisotropy is missing
+	float _maxAnisotropy{ 1.f };
+	// load "<name>.ktx2" instead of the png when there is one, the BC formats
+	// fall back to the png on devices without textureCompressionBC
+	bool _compressedTextures{ true };
+	bool _textureCompressionBC{ false };
+	// off for --bindless, the array slots are written once
+	bool _textureStreaming{ true };
+	// bytes, 0 leaves the limit to the vmaGetBudget heap budget
+	VkDeviceSize _textureBudget{ 0 };
+	uint32_t _textureHeap{ 0 };
+	std::vector<StreamedTexture> _streamedTextures;
+	std::vector<TextureBinding> _textureBindings;
+	glm::vec3 _cameraPosition{ 0.f };
 	VkDevice _device;
-	VkSurfaceKHR _surface;
+	VkSurfaceKHR _surface{ VK_NULL_HANDLE };
 	VkDebugUtilsMessengerEXT _debug_Message;
 
 	VkSwapchainKHR _swapchain;
@@ -148,6 +431,9 @@ public:
 
 	VkQueue _graphicsQueue;
 	uint32_t _graphicsQueueFamily;
+	// dedicated transfer family when the device has one, else the graphics queue
+	VkQueue _transferQueue;
+	uint32_t _transferQueueFamily;
 
 	VkRenderPass _renderPass;
 	std::vector<VkFramebuffer> _framebuffers;
@@ -156,34 +442,98 @@ public:
 
 	VmaAllocator _allocator;
 
-	std::vector<uint16_t> shader_index;
+	std::vector<MaterialConfig> material_config;
 	std::vector<std::string> obj_name;
-	std::vector<std::string> shader_name;
+	// material name of every obj_name entry
+	std::vector<std::string> obj_material;
+	// texture of every obj_name entry, empty for none
+	std::vector<std::string> obj_texture;
 	std::vector<std::string> texture_name;
 
 	VkPipelineLayout _meshPipelineLayout;  // Temp var
 	VkPipelineLayout _texturedPipeLayout;   // Temp var
 
+	// pipelines compile on the job system: the first get_material of a material
+	// queues it, everything else follows after the first frame
+	PipelineBuilder _basePipelineBuilder;
+	VertexInputDescription _vertexDescription;
+	std::unordered_map<std::string, VkShaderModule> _shaderModules;
+	std::unordered_map<std::string, VkPipelineLayout> _pipelineLayouts;
+	std::vector<std::unique_ptr<PipelineJob>> _pipelineJobs;
+	JobCounter _pipelineCompiles;
+	Material* _fallbackMaterial{ nullptr };
+	bool _usedFallback{ false };
+	// every graphics pipeline by its PipelineKey, owns them, see get_pipeline
+	std::mutex _pipelineStatesLock;
+	std::unordered_map<PipelineKey, VkPipeline, PipelineKeyHash> _pipelineStates;
+	std::atomic<uint32_t> _pipelineHits{ 0 };
+	std::atomic<uint32_t> _pipelineMisses{ 0 };
+
 
 	VkDescriptorSetLayout _globalSetLayout;
 	VkDescriptorSetLayout _singleTextureSetLayout;
-	VkDescriptorPool _descriptorPool;
+
+	// one update after bind array of every loaded texture, set 1 of the "bindless" layout
+	bool _bindless{ false };
+	uint32_t _bindlessCapacity{ 0 };
+	uint32_t _bindlessTextureCount{ 0 };
+	UploadToken _bindlessUpload{};
+	VkDescriptorSetLayout _bindlessSetLayout;
+	VkDescriptorPool _bindlessPool;
+	VkDescriptorSet _bindlessSet{ VK_NULL_HANDLE };
+	VkPipelineLayout _bindlessPipelineLayout{ VK_NULL_HANDLE };
+	DescriptorAllocator _descriptorAllocator;
+	DescriptorLayoutCache _descriptorLayoutCache;
 	
 	UploadContext _uploadContext;
+	UploadManager _upload;
+	PipelineCache _pipelineCache;
 
-	// All Frame use same Descriptor
+	// All Frame use same Descriptor, the frame is picked with dynamic offsets
 	VkDescriptorSet _globalDescriptor;
-	// all use same description set
-	AllFrameAllocatedBuffer _all_allcated_buffer;
+	// persistently mapped, FRAME_OVERLAP windows of FRAME_ARENA_SIZE
+	AllocatedBuffer _frameArena;
+	char* _frameArenaData{ nullptr };
 	// dynamic description set
 	GPUSenceData _senceParameters;
-	AllocatedBuffer _senneParameterBuffer;
+	EngineStats _stats;
 	// define you need pipeline
 	std::vector<RenderObject> _renderObject;
 	std::unordered_map<std::string, Mesh> _meshSet;
 	std::unordered_map<std::string, Material> _material;
 	std::unordered_map<std::string, Texture> _loadedTextures;
 	movestatus _movestatus;
+	// set before init, adds that many triangles to the scene and draws all of them
+	uint32_t _stressObjectCount{ 0 };
+	// 0 lays the stress objects out in a grid, anything else scatters them with it
+	uint32_t _stressSeed{ 0 };
+	// _renderObject pointers sorted by material then mesh, see draw_object
+	std::vector<RenderObject*> _drawOrder;
+	std::vector<DrawBatch> _drawBatches;
+	// batch of every _drawOrder entry
+	std::vector<uint32_t> _drawOrderBatch;
+	// per frame: world spheres of _drawOrder, surviving indices and their batches
+	bool _cullingEnabled{ true };
+	SphereSoA _cullSpheres;
+	std::vector<uint32_t> _visibleObjects;
+	std::vector<DrawBatch> _visibleBatches;
+	glm::mat4 _viewProj{ 1.f };
+	// compute culling with indirect draws, see prepare_objects
+	bool _gpuCullSupported{ false };
+	bool _gpuCulling{ false };
+	bool _gpuCullVerify{ false };
+	VkDescriptorSetLayout _cullSetLayout;
+	VkPipelineLayout _cullPipelineLayout;
+	VkPipeline _cullPipeline{ VK_NULL_HANDLE };
+	bool _drawOrderDirty{ true };
+	RenderObject* _drawRangeFirst{ nullptr };
+	int _drawRangeCount{ 0 };
+
+	JobSystem _jobs;
+	JobCounter _assetJobs;
+	std::vector<DecodedImage> _pendingTextures;
+	std::vector<std::unique_ptr<PendingMesh>> _pendingMeshes;
+	StartupTimeline _startup;
 	//initializes everything in the engine
 	void init();
 
@@ -195,6 +545,10 @@ public:
 
 	//run main loop
 	void run();
+	// fixed frame count without events, present or imgui, prints the frame times
+	void run_headless();
+	// plays _benchmarkScene and writes its report, windowed or headless
+	void run_benchmark();
 
 	AllocatedBuffer create_buffer(
 		size_t allocSize,
@@ -206,30 +560,69 @@ public:
 	Material* create_material(VkPipeline pipeline, VkPipelineLayout layout, const std::string& name);
 	Material* get_material(const std::string& name);
 	Mesh* getMesh(const std::string& name);
-	void draw_object(VkCommandBuffer cmd, RenderObject* first, int count);
+	// culls and fills the object buffer outside the render pass, draw_object
+	// then records the draws of what prepare_objects kept
+	void prepare_objects(VkCommandBuffer cmd, RenderObject* first, int count);
+	void draw_object(VkCommandBuffer cmd);
 	FrameData& get_current_frame();
 	
 	size_t pad_uniform_buffer_size(size_t originalSize);
+	// aligned for a dynamic uniform / storage buffer offset
+	LinearAllocation alloc_frame_uniform(size_t size);
+	LinearAllocation alloc_frame_storage(size_t size);
 	// Math
 	void UpdateDate(int obj_indx);
 
 private:
 	void init_vulkan();
 	void init_swapchain();
+	void init_offscreen_targets();
 	void init_commands();
 	void init_default_renderpass();
 	void init_framebuffers();
 	void init_sync_struct();
 	bool load_shader_module(const char* filePath, VkShaderModule* outShaderModule);
 	void init_pipelines();
+	VkPipeline build_material_pipeline(size_t index);
+	// the existing pipeline for identical builder state, else a new one; any thread
+	VkPipeline get_pipeline(const PipelineBuilder& builder);
+	void request_pipeline(int index);
+	void request_all_pipelines();
+	void publish_pipelines();
 	void init_depth_image();
 	void init_scene();
-	bool shader_perpare(PipelineBuilder* pipelineBuilder);
-
+	void build_stress_scene(uint32_t count);
+	void build_draw_batches(RenderObject* first, int count);
+	size_t cull_objects_cpu();
+	void record_gpu_culling(VkCommandBuffer cmd, FrameData& frame);
+	void check_gpu_culling(FrameData& frame);
+	bool bind_batch(VkCommandBuffer cmd, const DrawBatch& batch, VkDescriptorSet globalSet,
+		Material*& lastMaterial, Mesh*& lastMesh);
+
+	void load_config();
+	void kick_asset_loading();
 	void load_mesh();
 	void load_images();
+	void bind_texture(Material* material, const std::string& name, VkSampler sampler);
+	void update_texture_streaming();
+	void start_texture_load(StreamedTexture& streamed, uint32_t level);
+	void swap_streamed_texture(int index);
+	void destroy_texture(const Texture& texture);
 	void upload_mesh(Mesh& mesh);
+	// write_staging fills vertex_bytes() of vertices followed by index_bytes() of packed indices
+	void upload_mesh(Mesh& mesh, std::function<void(char* staging)>&& write_staging);
 	void key_event_process(int32_t keycode);
 	void init_descriptors();
+	void init_gpu_culling();
+	void init_bindless();
 	void init_imgui();
+	void draw_stats();
+	void draw_gpu_profiler();
+	// one draw, with the window events and the imgui frame when there is a window,
+	// false once the window was closed
+	bool step_frame();
+	// first frame, then every pipeline compiled and every upload landed
+	void warm_up();
+	bool read_frame_timestamps(FrameData& frame);
+	void apply_benchmark_frame(uint32_t frame);
 };
\ No newline at end of file
@@ -0,0 +1,126 @@
+#include <vk_frame_pacing.h>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace {
+	// sleep_for lands up to a scheduler tick late, the rest of the wait spins
+	constexpr std::chrono::microseconds SPIN_MARGIN{ 1500 };
+
+	struct PresentModeName {
+		VkPresentModeKHR mode;
+		const char* name;
+	};
+
+	const PresentModeName presentModeNames[] = {
+		{ VK_PRESENT_MODE_FIFO_KHR, "fifo" },
+		{ VK_PRESENT_MODE_FIFO_RELAXED_KHR, "fifo_relaxed" },
+		{ VK_PRESENT_MODE_MAILBOX_KHR, "mailbox" },
+		{ VK_PRESENT_MODE_IMMEDIATE_KHR, "immediate" },
+	};
+}
+
+namespace frame_pacing {
+
+	bool parse_present_mode(const char* name, VkPresentModeKHR& outMode)
+	{
+		for (const PresentModeName& entry : presentModeNames)
+		{
+			if (strcmp(entry.name, name) == 0)
+			{
+				outMode = entry.mode;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	const char* present_mode_name(VkPresentModeKHR mode)
+	{
+		for (const PresentModeName& entry : presentModeNames)
+		{
+			if (entry.mode == mode)
+			{
+				return entry.name;
+			}
+		}
+		return "unknown";
+	}
+
+	VkPresentModeKHR choose_present_mode(VkPhysicalDevice gpu, VkSurfaceKHR surface, VkPresentModeKHR wanted)
+	{
+		uint32_t count = 0;
+		vkGetPhysicalDeviceSurfacePresentModesKHR(gpu, surface, &count, nullptr);
+		std::vector<VkPresentModeKHR> modes(count);
+		vkGetPhysicalDeviceSurfacePresentModesKHR(gpu, surface, &count, modes.data());
+		if (std::find(modes.begin(), modes.end(), wanted) != modes.end())
+		{
+			return wanted;
+		}
+		return VK_PRESENT_MODE_FIFO_KHR;
+	}
+}
+
+void FramePacer::set_fps_cap(double fps)
+{
+	_fpsCap = std::max(fps, 0.0);
+	_period = _fpsCap > 0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / _fpsCap)) : Clock::duration{ 0 };
+	_deadline = Clock::now();
+}
+
+void FramePacer::wait()
+{
+	if (_period.count() == 0)
+	{
+		return;
+	}
+	Clock::time_point now = Clock::now();
+	if (_deadline - now > SPIN_MARGIN)
+	{
+		std::this_thread::sleep_for(_deadline - now - SPIN_MARGIN);
+	}
+	while (Clock::now() < _deadline)
+	{
+		std::this_thread::yield();
+	}
+	// slots follow each other, a late frame moves them instead of bursting to catch up
+	now = Clock::now();
+	_deadline = now - _deadline > _period ? now + _period : _deadline + _period;
+}
+
+void FramePacer::input(Clock::time_point when)
+{
+	if (!_inputPending || when < _inputTime)
+	{
+		_inputTime = when;
+	}
+	_inputPending = true;
+}
+
+void FramePacer::presented()
+{
+	if (!_inputPending)
+	{
+		return;
+	}
+	_inputPending = false;
+	_latencyMs[_next] = std::chrono::duration<float, std::milli>(Clock::now() - _inputTime).count();
+	_next = (_next + 1) % HISTORY;
+	_count = std::min(_count + 1, HISTORY);
+}
+
+float FramePacer::average_latency() const
+{
+	float total = 0.f;
+	for (float ms : _latencyMs)
+	{
+		total += ms;
+	}
+	return _count > 0 ? total / _count : 0.f;
+}
+
+float FramePacer::peak_latency() const
+{
+	return *std::max_element(_latencyMs.begin(), _latencyMs.end());
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <vk_types.h>
+#include <array>
+#include <chrono>
+#include <cstddef>
+
+namespace frame_pacing {
+
+	// "fifo", "fifo_relaxed", "mailbox" or "immediate", false for anything else
+	bool parse_present_mode(const char* name, VkPresentModeKHR& outMode);
+	const char* present_mode_name(VkPresentModeKHR mode);
+	// wanted when the surface supports it, else FIFO, the one mode every surface has
+	VkPresentModeKHR choose_present_mode(VkPhysicalDevice gpu, VkSurfaceKHR surface, VkPresentModeKHR wanted);
+}
+
+// Paces the interactive loop. wait() holds a frame back until its slot under
+// the fps cap, before the input is polled, so the input a frame is built from
+// is as recent as the cap allows. It also measures input to present: the
+// first input event of a frame starts the clock, the present of that frame
+// stops it. What the display adds after the present (queued images, scanout)
+// is not in the number.
+class FramePacer {
+public:
+	using Clock = std::chrono::steady_clock;
+	static constexpr size_t HISTORY = 240;
+
+	// 0 uncapped
+	void set_fps_cap(double fps);
+	double fps_cap() const { return _fpsCap; }
+
+	// sleeps until the next frame slot, the last stretch spins since sleeps overshoot
+	void wait();
+
+	// an input event of the frame being built, when SDL queued it
+	void input(Clock::time_point when);
+	// after vkQueuePresentKHR, closes the latency of the frame that had input
+	void presented();
+
+	// last HISTORY frames with input, ms
+	const std::array<float, HISTORY>& latency() const { return _latencyMs; }
+	size_t next() const { return _next; }
+	size_t count() const { return _count; }
+	float last_latency() const { return _count > 0 ? _latencyMs[(_next + HISTORY - 1) % HISTORY] : 0.f; }
+	float average_latency() const;
+	float peak_latency() const;
+
+private:
+	double _fpsCap{ 0 };
+	Clock::duration _period{ 0 };
+	Clock::time_point _deadline{};
+
+	bool _inputPending{ false };
+	Clock::time_point _inputTime{};
+
+	std::array<float, HISTORY> _latencyMs{};
+	size_t _next{ 0 };
+	size_t _count{ 0 };
+};
@@ -0,0 +1,128 @@
+#include <vk_gpu_profiler.h>
+#include <algorithm>
+#include <cstring>
+
+void GpuProfiler::init(VkDevice device, float timestampPeriod, uint64_t timestampMask, uint32_t maxScopes)
+{
+	_device = device;
+	_period = timestampPeriod;
+	_mask = timestampMask;
+	_maxScopes = maxScopes;
+	if (_mask == 0)
+	{
+		return;
+	}
+
+	VkQueryPoolCreateInfo query_info = {};
+	query_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	query_info.pNext = nullptr;
+	query_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	query_info.queryCount = _maxScopes * 2;
+	VK_CHECK(vkCreateQueryPool(_device, &query_info, nullptr, &_pool));
+	_scopes.reserve(_maxScopes);
+	_ticks.resize(_maxScopes * 2);
+}
+
+void GpuProfiler::begin_frame(VkCommandBuffer cmd, int frameNumber)
+{
+	if (!enabled())
+	{
+		return;
+	}
+	// an unread frame is dropped, its queries are reset below
+	vkCmdResetQueryPool(cmd, _pool, 0, _maxScopes * 2);
+	_scopes.clear();
+	_depth = 0;
+	_frame = frameNumber;
+	_pending = true;
+}
+
+uint32_t GpuProfiler::begin_scope(VkCommandBuffer cmd, const char* name)
+{
+	if (!enabled() || _scopes.size() >= _maxScopes)
+	{
+		return UINT32_MAX;
+	}
+	uint32_t scope = static_cast<uint32_t>(_scopes.size());
+	_scopes.push_back({ name, _depth++ });
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _pool, scope * 2);
+	return scope;
+}
+
+void GpuProfiler::end_scope(VkCommandBuffer cmd, uint32_t scope)
+{
+	if (scope == UINT32_MAX)
+	{
+		return;
+	}
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _pool, scope * 2 + 1);
+	_depth--;
+}
+
+bool GpuProfiler::resolve(std::vector<GpuScopeTime>& outScopes)
+{
+	if (!_pending || _scopes.empty())
+	{
+		return false;
+	}
+	// no WAIT bit: VK_NOT_READY instead of a stall when asked too early
+	uint32_t query_count = static_cast<uint32_t>(_scopes.size()) * 2;
+	VkResult result = vkGetQueryPoolResults(_device, _pool, 0, query_count, query_count * sizeof(uint64_t),
+		_ticks.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+	if (result != VK_SUCCESS)
+	{
+		return false;
+	}
+	_pending = false;
+
+	outScopes.clear();
+	for (size_t i = 0; i < _scopes.size(); i++)
+	{
+		uint64_t ticks = (_ticks[i * 2 + 1] - _ticks[i * 2]) & _mask;
+		outScopes.push_back({ _scopes[i].name, _scopes[i].depth, ticks * _period / 1000000.0 });
+	}
+	return true;
+}
+
+void GpuTimingHistory::add(const std::vector<GpuScopeTime>& scopes)
+{
+	for (const GpuScopeTime& scope : scopes)
+	{
+		auto it = std::find_if(tracks.begin(), tracks.end(),
+			[&](const Track& track) { return strcmp(track.name, scope.name) == 0; });
+		if (it == tracks.end())
+		{
+			tracks.push_back({ scope.name, scope.depth });
+		}
+	}
+	for (Track& track : tracks)
+	{
+		float ms = 0.f;
+		for (const GpuScopeTime& scope : scopes)
+		{
+			if (strcmp(track.name, scope.name) == 0)
+			{
+				ms = static_cast<float>(scope.ms);
+				break;
+			}
+		}
+		track.ms[next] = ms;
+	}
+	next = (next + 1) % FRAMES;
+	count = std::min(count + 1, FRAMES);
+}
+
+float GpuTimingHistory::average(const Track& track) const
+{
+	float total = 0.f;
+	for (float ms : track.ms)
+	{
+		total += ms;
+	}
+	return count > 0 ? total / count : 0.f;
+}
+
+float GpuTimingHistory::peak(const Track& track) const
+{
+	return *std::max_element(track.ms.begin(), track.ms.end());
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <vk_types.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// one resolved scope, names are the string literals passed to begin_scope
+struct GpuScopeTime {
+	const char* name;
+	uint32_t depth;
+	double ms;
+};
+
+// Timestamp scopes of one FrameData's command buffer. begin_frame resets the
+// pool inside the command buffer, every scope writes a begin and an end
+// timestamp, and resolve reads them back without waiting once the frame's
+// fence signaled. Without timestamps on the queue every call is a no-op.
+class GpuProfiler {
+public:
+	// timestampMask 0 disables the profiler, no pool is created
+	void init(VkDevice device, float timestampPeriod, uint64_t timestampMask, uint32_t maxScopes = 16);
+	VkQueryPool pool() const { return _pool; }
+	bool enabled() const { return _pool != VK_NULL_HANDLE; }
+
+	// outside a render pass, before the first scope
+	void begin_frame(VkCommandBuffer cmd, int frameNumber);
+	// index for end_scope, UINT32_MAX when disabled or out of queries
+	uint32_t begin_scope(VkCommandBuffer cmd, const char* name);
+	void end_scope(VkCommandBuffer cmd, uint32_t scope);
+
+	// scopes in begin order, false when nothing new was recorded or the gpu is not done
+	bool resolve(std::vector<GpuScopeTime>& outScopes);
+	// _frameNumber of the last begin_frame
+	int frame() const { return _frame; }
+
+private:
+	struct Scope {
+		const char* name;
+		uint32_t depth;
+	};
+
+	VkDevice _device{ VK_NULL_HANDLE };
+	VkQueryPool _pool{ VK_NULL_HANDLE };
+	double _period{ 0 };
+	uint64_t _mask{ 0 };
+	uint32_t _maxScopes{ 0 };
+	std::vector<Scope> _scopes;
+	std::vector<uint64_t> _ticks;
+	uint32_t _depth{ 0 };
+	int _frame{ -1 };
+	bool _pending{ false };
+};
+
+// begin_scope in the constructor, end_scope in the destructor
+class GpuScope {
+public:
+	GpuScope(GpuProfiler& profiler, VkCommandBuffer cmd, const char* name)
+		: _profiler(profiler), _cmd(cmd), _scope(profiler.begin_scope(cmd, name)) {}
+	~GpuScope() { _profiler.end_scope(_cmd, _scope); }
+	GpuScope(const GpuScope&) = delete;
+	GpuScope& operator=(const GpuScope&) = delete;
+
+private:
+	GpuProfiler& _profiler;
+	VkCommandBuffer _cmd;
+	uint32_t _scope;
+};
+
+// last FRAMES resolved times of every scope name, a ring the graphs read
+struct GpuTimingHistory {
+	static constexpr size_t FRAMES = 240;
+
+	struct Track {
+		const char* name;
+		uint32_t depth;
+		std::array<float, FRAMES> ms{};
+	};
+	std::vector<Track> tracks;
+	// slot the next add writes, the oldest value once the ring is full
+	size_t next{ 0 };
+	size_t count{ 0 };
+
+	// scopes missing from this frame get 0
+	void add(const std::vector<GpuScopeTime>& scopes);
+	float average(const Track& track) const;
+	float peak(const Track& track) const;
+};
@@ -6,6 +6,8 @@
 #include <sstream>
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
+#include <vk_ktx2.h>
+#include <vk_mipmaps.h>
 namespace vkinit {
 	VkCommandPoolCreateInfo vkinit::command_pool_create_info
 	(uint32_t queueFamilyIndex,
@@ -391,19 +393,73 @@ namespace vkinit {
 		return VK_SUCCESS;
 	}
 
-	VkResult vkinit::shadername_get(
-		std::vector<std::string>& shader_name,
-		std::vector<uint16_t>& shader_index,
+	static VkPolygonMode polygon_mode_from_string(const std::string& mode)
+	{
+		if (mode == "line")
+			return VK_POLYGON_MODE_LINE;
+		if (mode == "point")
+			return VK_POLYGON_MODE_POINT;
+		return VK_POLYGON_MODE_FILL;
+	}
+
+	static VkCullModeFlags cull_mode_from_string(const std::string& mode)
+	{
+		if (mode == "back")
+			return VK_CULL_MODE_BACK_BIT;
+		if (mode == "front")
+			return VK_CULL_MODE_FRONT_BIT;
+		return VK_CULL_MODE_NONE;
+	}
+
+	static VkCompareOp compare_op_from_string(const std::string& op)
+	{
+		if (op == "less")
+			return VK_COMPARE_OP_LESS;
+		if (op == "equal")
+			return VK_COMPARE_OP_EQUAL;
+		if (op == "greater")
+			return VK_COMPARE_OP_GREATER;
+		if (op == "greater_or_equal")
+			return VK_COMPARE_OP_GREATER_OR_EQUAL;
+		if (op == "always")
+			return VK_COMPARE_OP_ALWAYS;
+		return VK_COMPARE_OP_LESS_OR_EQUAL;
+	}
+
+	VkResult vkinit::config_get(
+		std::vector<MaterialConfig>& materials,
 		std::vector<std::string>& obj_name,
+		std::vector<std::string>& obj_material,
+		std::vector<std::string>& obj_texture,
 		std::vector<std::string>& texture_name,
 		rapidjson::Document &object
 	)
 	{
 		{
-			const rapidjson::Value& shader_set = object["shader"];
-			for (rapidjson::SizeType i = 0 ; i < shader_set.Size(); i++)
+			const rapidjson::Value& material_set = object["material"];
+			for (rapidjson::SizeType i = 0; i < material_set.Size(); i++)
 			{
-				shader_name.push_back(shader_set[i]["name"].GetString());
+				const rapidjson::Value& entry = material_set[i];
+				MaterialConfig material;
+				material.name = entry["name"].GetString();
+				material.vertexShader = entry["vertex"].GetString();
+				material.fragmentShader = entry["fragment"].GetString();
+				material.layout = entry["layout"].GetString();
+				if (entry.HasMember("polygon"))
+					material.polygonMode = polygon_mode_from_string(entry["polygon"].GetString());
+				if (entry.HasMember("cull"))
+					material.cullMode = cull_mode_from_string(entry["cull"].GetString());
+				if (entry.HasMember("depth_test"))
+					material.depthTest = entry["depth_test"].GetBool();
+				if (entry.HasMember("depth_write"))
+					material.depthWrite = entry["depth_write"].GetBool();
+				if (entry.HasMember("depth_compare"))
+					material.depthCompare = compare_op_from_string(entry["depth_compare"].GetString());
+				if (entry.HasMember("blend"))
+					material.blend = entry["blend"].GetBool();
+				if (entry.HasMember("bindless"))
+					material.bindlessVariant = entry["bindless"].GetString();
+				materials.push_back(material);
 			}
 		}
 		{
@@ -418,8 +474,8 @@ namespace vkinit {
 			for (rapidjson::SizeType i = 0; i < shader_set.Size(); i++)
 			{
 				obj_name.push_back(shader_set[i]["Mode_name"].GetString());
-				shader_index.push_back(shader_set[i]["Vertex_shader"].GetInt());
-				shader_index.push_back(shader_set[i]["Fragment_shader"].GetInt());
+				obj_material.push_back(shader_set[i]["Material"].GetString());
+				obj_texture.push_back(shader_set[i].HasMember("Texture") ? shader_set[i]["Texture"].GetString() : "");
 			}
 		}
 		return VK_SUCCESS;
@@ -532,19 +588,27 @@ namespace vkinit {
 	}
 
 	VkSamplerCreateInfo vkinit::sampler_create_info(
-		VkFilter filters, 
-		VkSamplerAddressMode samplerAddressMode
+		VkFilter magFilter,
+		VkFilter minFilter,
+		VkSamplerAddressMode samplerAddressMode,
+		VkSamplerMipmapMode mipmapMode,
+		float maxAnisotropy
 	)
 	{
 		VkSamplerCreateInfo info = {};
 		info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
 		info.pNext = nullptr;
 
-		info.magFilter = filters;
-		info.minFilter = filters;
+		info.magFilter = magFilter;
+		info.minFilter = minFilter;
 		info.addressModeU = samplerAddressMode;
 		info.addressModeV = samplerAddressMode;
 		info.addressModeW = samplerAddressMode;
+		info.mipmapMode = mipmapMode;
+		info.minLod = 0.f;
+		info.maxLod = VK_LOD_CLAMP_NONE;
+		info.anisotropyEnable = maxAnisotropy > 1.f ? VK_TRUE : VK_FALSE;
+		info.maxAnisotropy = maxAnisotropy;
 
 		return info;
 	}
@@ -592,8 +656,48 @@ namespace file_box
 		return VK_SUCCESS;
 	}
 
-	VkResult load_image_from_file(VulkanEngine& engine, const char* file, AllocatedImage& outImage)
+	static VkResult map_ktx2(const std::string& file, DecodedImage& outImage)
+	{
+		int64_t imageMtime, ktxMtime;
+		uint64_t imageSize, ktxSize;
+		std::string ktxFile = ktx2::texture_path(file);
+		if (!file_stat(ktxFile, ktxMtime, ktxSize))
+		{
+			return VK_ERROR_UNKNOWN;
+		}
+		if (file_stat(file, imageMtime, imageSize) && imageMtime > ktxMtime)
+		{
+			std::cout << ktxFile << " is older than " << file << ", using the image" << std::endl;
+			return VK_ERROR_UNKNOWN;
+		}
+
+		auto mapped = std::make_unique<MappedFile>();
+		ktx2::Image ktx;
+		if (!mapped->open(ktxFile) || !ktx2::parse(mapped->data(), mapped->size(), ktx))
+		{
+			std::cout << ktxFile << " is not a usable ktx2 file, using the image" << std::endl;
+			return VK_ERROR_UNKNOWN;
+		}
+
+		outImage.format = ktx.format;
+		outImage.width = static_cast<int>(ktx.width);
+		outImage.height = static_cast<int>(ktx.height);
+		outImage.levels.clear();
+		for (const ktx2::Level& level : ktx.levels)
+		{
+			outImage.levels.push_back({ mapped->data() + level.offset, level.size, level.width, level.height });
+		}
+		outImage.file = std::move(mapped);
+		return VK_SUCCESS;
+	}
+
+	VkResult decode_image(const char* file, DecodedImage& outImage, bool allowCompressed)
 	{
+		if (allowCompressed && map_ktx2(file, outImage) == VK_SUCCESS)
+		{
+			return VK_SUCCESS;
+		}
+
 		int texWidth, texHeight, texChannels;
 
 		stbi_uc* pixels = stbi_load(file, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
@@ -601,107 +705,104 @@ namespace file_box
 		if (!pixels) {
 			return VK_ERROR_UNKNOWN;
 		}
-		
-		void* pixel_ptr = pixels;
-		VkDeviceSize imageSize = texWidth * texHeight * 4;
-		VkFormat image_format = VK_FORMAT_R8G8B8A8_SRGB;
-		AllocatedBuffer stagingbuffer = engine.create_buffer(
-												imageSize, 
-												VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-												VMA_MEMORY_USAGE_CPU_ONLY);
-
-		void* data;
-		vmaMapMemory(engine._allocator, stagingbuffer._allocation, &data);
-		memcpy(data, pixel_ptr, static_cast<size_t>(imageSize));
-		vmaUnmapMemory(engine._allocator, stagingbuffer._allocation);
+		outImage.format = VK_FORMAT_R8G8B8A8_SRGB;
+		outImage.pixels = pixels;
+		outImage.width = texWidth;
+		outImage.height = texHeight;
+
+		std::vector<mipmaps::Level> mips;
+		mipmaps::build_chain(pixels, texWidth, texHeight, outImage.mipData, mips);
+		outImage.levels.clear();
+		outImage.levels.push_back({ pixels, static_cast<size_t>(texWidth) * texHeight * 4,
+			static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight) });
+		for (const mipmaps::Level& mip : mips)
+		{
+			outImage.levels.push_back({ outImage.mipData.data() + mip.offset,
+				static_cast<size_t>(mip.width) * mip.height * 4, mip.width, mip.height });
+		}
+		return VK_SUCCESS;
+	}
+
+	void free_image(DecodedImage& image)
+	{
+		stbi_image_free(image.pixels);
+		image.pixels = nullptr;
+		image.mipData = {};
+		image.file.reset();
+		image.levels.clear();
+	}
+
+	VkResult load_image_from_file(VulkanEngine& engine, const char* file, AllocatedImage& outImage)
+	{
+		DecodedImage decoded;
+		VkResult result = decode_image(file, decoded);
+		if (result != VK_SUCCESS) {
+			return result;
+		}
+		UploadToken token = upload_image(engine, decoded, outImage);
+		free_image(decoded);
+		engine._mainDeletionQueue.push_image(outImage._image, outImage._allocation);
+		// keep the old synchronous contract, loaders on the frame path use upload_image
+		engine._upload.wait(token);
+		return VK_SUCCESS;
+	}
+
+	UploadToken upload_image(VulkanEngine& engine, const DecodedImage& image, AllocatedImage& outImage,
+		uint32_t firstLevel)
+	{
+		uint32_t mipLevels = image.mip_levels() - firstLevel;
+		const ImageLevel* levels = image.levels.data() + firstLevel;
+		// every level starts on a 16 byte boundary, a multiple of each block size
+		std::vector<VkDeviceSize> offsets(mipLevels);
+		VkDeviceSize imageSize = 0;
+		for (uint32_t level = 0; level < mipLevels; level++)
+		{
+			offsets[level] = imageSize;
+			imageSize += (levels[level].size + 15) & ~VkDeviceSize(15);
+		}
+		StagingRegion staging = engine._upload.stage(imageSize);
+		for (uint32_t level = 0; level < mipLevels; level++)
+		{
+			memcpy(static_cast<char*>(staging.data) + offsets[level], levels[level].data, levels[level].size);
+		}
 
 		VkExtent3D imageExent;
-		imageExent.width = texWidth;
-		imageExent.height = texHeight;
+		imageExent.width = levels[0].width;
+		imageExent.height = levels[0].height;
 		imageExent.depth = 1;
 
 		VkImageCreateInfo dimg_info = vkinit::image_create_info(
-										image_format, 
+										image.format, 
 										VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, 
 										imageExent);
+		dimg_info.mipLevels = mipLevels;
+		engine._upload.share(dimg_info);
 
 		AllocatedImage newImage;
 		VmaAllocationCreateInfo dimg_allocinfo = {};
 		dimg_allocinfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
 		vmaCreateImage(engine._allocator, &dimg_info, &dimg_allocinfo, &newImage._image, &newImage._allocation, nullptr);
 
-		engine.immediate_submit([&](VkCommandBuffer cmd) {
-			VkImageSubresourceRange range;
-			range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			range.baseMipLevel = 0;
-			range.levelCount = 1;
-			range.baseArrayLayer = 0;
-			range.layerCount = 1;
-
-			VkImageMemoryBarrier imageBarrier_toTransfer = {};
-			imageBarrier_toTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-
-			imageBarrier_toTransfer.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			imageBarrier_toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-			imageBarrier_toTransfer.image = newImage._image;
-			imageBarrier_toTransfer.subresourceRange = range;
-
-			imageBarrier_toTransfer.srcAccessMask = 0;
-			imageBarrier_toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-			//barrier the image into the transfer-receive layout
-			vkCmdPipelineBarrier(
-				cmd, 
-				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 
-				VK_PIPELINE_STAGE_TRANSFER_BIT, 
-				0, 0, nullptr, 0, 
-				nullptr, 1, 
-				&imageBarrier_toTransfer
-				);
-
-			VkBufferImageCopy copyRegion = {};
-			copyRegion.bufferOffset = 0;
+		std::vector<VkBufferImageCopy> copyRegions(mipLevels);
+		for (uint32_t level = 0; level < mipLevels; level++)
+		{
+			VkBufferImageCopy& copyRegion = copyRegions[level];
+			copyRegion = {};
+			copyRegion.bufferOffset = offsets[level];
 			copyRegion.bufferRowLength = 0;
 			copyRegion.bufferImageHeight = 0;
 
 			copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			copyRegion.imageSubresource.mipLevel = 0;
+			copyRegion.imageSubresource.mipLevel = level;
 			copyRegion.imageSubresource.baseArrayLayer = 0;
 			copyRegion.imageSubresource.layerCount = 1;
-			copyRegion.imageExtent = imageExent;
-
-			vkCmdCopyBufferToImage(
-				cmd, 
-				stagingbuffer._buffer, 
-				newImage._image, 
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, 
-				&copyRegion
-			);
-			VkImageMemoryBarrier imageBarrier_toReadable = imageBarrier_toTransfer;
-
-			imageBarrier_toReadable.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-			imageBarrier_toReadable.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-			imageBarrier_toReadable.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			imageBarrier_toReadable.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-			//barrier the image into the shader readable layout
-			vkCmdPipelineBarrier(
-				cmd, 
-				VK_PIPELINE_STAGE_TRANSFER_BIT, 
-				VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 
-				0, 0, nullptr, 0, 
-				nullptr, 1, 
-				&imageBarrier_toReadable
-			);
-		});
-
-		engine._mainDeletionQueue.push_function([=]() {
-			vmaDestroyImage(engine._allocator, newImage._image, newImage._allocation);
-			});
-		outImage = newImage;
+			copyRegion.imageExtent = { levels[level].width, levels[level].height, 1 };
+		}
 
-		return VK_SUCCESS;
+		engine._upload.copy_image(staging, newImage._image, copyRegions.data(), mipLevels, mipLevels);
+
+		outImage = newImage;
+		return engine._upload.token();
 	}
 
 }
\ No newline at end of file
@@ -122,10 +122,13 @@ namespace vkinit {
 		uint32_t pushconstant_count = 1
 	);
 
-	VkResult shadername_get(
-		std::vector<std::string>& shader_name,
-		std::vector<uint16_t> &shader_index,
+	// materials, textures and objects of shader_config.json, missing
+	// material state keeps the MaterialConfig defaults
+	VkResult config_get(
+		std::vector<MaterialConfig>& materials,
 		std::vector<std::string> &obj_name,
+		std::vector<std::string> &obj_material,
+		std::vector<std::string> &obj_texture,
 		std::vector<std::string>& texture_name,
 		rapidjson::Document &object
 	);
@@ -169,9 +172,14 @@ namespace vkinit {
 		uint32_t binding
 	);
 
+	// LINEAR minFilter with LINEAR mipmapMode gives trilinear filtering, anisotropy
+	// above 1 needs the samplerAnisotropy feature
 	VkSamplerCreateInfo sampler_create_info(
-		VkFilter filters, 
-		VkSamplerAddressMode samplerAddressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT
+		VkFilter magFilter,
+		VkFilter minFilter,
+		VkSamplerAddressMode samplerAddressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+		VkSamplerMipmapMode mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+		float maxAnisotropy = 1.f
 	);
 
 	VkWriteDescriptorSet write_descriptor_image(
@@ -190,5 +198,18 @@ namespace file_box {
 
 	VkResult load_image_from_file(VulkanEngine& engine, const char* file, AllocatedImage& outImage);
 
+	// cpu half of load_image_from_file, safe to call from a worker thread.
+	// With allowCompressed a valid "<name>.ktx2" next to the image, not older
+	// than it, is mapped instead and the png is never decoded.
+	VkResult decode_image(const char* file, DecodedImage& outImage, bool allowCompressed = false);
+	void free_image(DecodedImage& image);
+
+	// records the staging copy and layout transitions on engine._upload, the
+	// image is usable once the returned token completes. Only levels firstLevel..
+	// are uploaded, the image is created at the size of firstLevel. The caller
+	// owns the image.
+	UploadToken upload_image(VulkanEngine& engine, const DecodedImage& image, AllocatedImage& outImage,
+		uint32_t firstLevel = 0);
+
 }
 
@@ -0,0 +1,153 @@
+#include <vk_jobs.h>
+#include <algorithm>
+
+namespace {
+	// index of the worker owning the current thread, -1 outside the pool
+	thread_local int t_workerIndex = -1;
+}
+
+JobSystem::~JobSystem()
+{
+	shutdown();
+}
+
+void JobSystem::init(unsigned workerCount)
+{
+	if (workerCount == 0)
+	{
+		unsigned cores = std::thread::hardware_concurrency();
+		workerCount = cores > 1 ? cores - 1 : 1;
+	}
+	_running = true;
+	for (unsigned i = 0; i < workerCount; i++)
+	{
+		_queues.push_back(std::make_unique<WorkerQueue>());
+	}
+	for (unsigned i = 0; i < workerCount; i++)
+	{
+		_workers.emplace_back([this, i]() { worker_loop(i); });
+	}
+}
+
+void JobSystem::shutdown()
+{
+	if (!_running)
+	{
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(_sleepLock);
+		_running = false;
+	}
+	_wake.notify_all();
+	for (std::thread& worker : _workers)
+	{
+		worker.join();
+	}
+	_workers.clear();
+	_queues.clear();
+}
+
+void JobSystem::run(JobCounter& counter, std::function<void()>&& job)
+{
+	counter.pending.fetch_add(1, std::memory_order_relaxed);
+	if (_queues.empty())
+	{
+		// not initialized, behave like a plain call
+		Job inline_job{ std::move(job), &counter };
+		execute(inline_job);
+		return;
+	}
+
+	size_t queue = t_workerIndex >= 0
+		? static_cast<size_t>(t_workerIndex)
+		: _nextQueue.fetch_add(1, std::memory_order_relaxed) % _queues.size();
+	{
+		std::lock_guard<std::mutex> lock(_queues[queue]->lock);
+		_queues[queue]->jobs.push_back({ std::move(job), &counter });
+	}
+	_queued.fetch_add(1, std::memory_order_release);
+	{
+		// pairs with the predicate check in worker_loop so a wakeup is never lost
+		std::lock_guard<std::mutex> lock(_sleepLock);
+	}
+	_wake.notify_one();
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+	size_t self = t_workerIndex >= 0 ? static_cast<size_t>(t_workerIndex) : 0;
+	while (!counter.done())
+	{
+		Job job;
+		if ((t_workerIndex >= 0 && pop(self, job)) || steal(self, job))
+		{
+			execute(job);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+bool JobSystem::pop(size_t queue, Job& job)
+{
+	WorkerQueue& owned = *_queues[queue];
+	std::lock_guard<std::mutex> lock(owned.lock);
+	if (owned.jobs.empty())
+	{
+		return false;
+	}
+	job = std::move(owned.jobs.back());
+	owned.jobs.pop_back();
+	_queued.fetch_sub(1, std::memory_order_relaxed);
+	return true;
+}
+
+bool JobSystem::steal(size_t thief, Job& job)
+{
+	size_t count = _queues.size();
+	for (size_t i = 0; i < count; i++)
+	{
+		WorkerQueue& victim = *_queues[(thief + i) % count];
+		std::lock_guard<std::mutex> lock(victim.lock);
+		if (victim.jobs.empty())
+		{
+			continue;
+		}
+		job = std::move(victim.jobs.front());
+		victim.jobs.pop_front();
+		_queued.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+	return false;
+}
+
+void JobSystem::execute(Job& job)
+{
+	job.function();
+	job.counter->pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void JobSystem::worker_loop(size_t index)
+{
+	t_workerIndex = static_cast<int>(index);
+	while (true)
+	{
+		Job job;
+		if (pop(index, job) || steal(index, job))
+		{
+			execute(job);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(_sleepLock);
+		_wake.wait(lock, [this]() {
+			return !_running || _queued.load(std::memory_order_acquire) > 0;
+			});
+		if (!_running)
+		{
+			return;
+		}
+	}
+}
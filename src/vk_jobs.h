@@ -0,0 +1,63 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counts the unfinished jobs of one group, JobSystem::wait joins the group.
+struct JobCounter
+{
+	std::atomic<uint32_t> pending{ 0 };
+
+	bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+// Small work stealing job system. Every worker owns a deque, it pops its own
+// jobs from the back and steals from the front of the others when it runs dry.
+// Jobs pushed from outside the pool are spread round robin over the workers.
+class JobSystem
+{
+public:
+	~JobSystem();
+
+	// workerCount 0 = one worker per core, minus the calling thread
+	void init(unsigned workerCount = 0);
+	void shutdown();
+
+	void run(JobCounter& counter, std::function<void()>&& job);
+	// run jobs on the calling thread until every job of the counter finished
+	void wait(JobCounter& counter);
+
+	unsigned worker_count() const { return static_cast<unsigned>(_workers.size()); }
+
+private:
+	struct Job
+	{
+		std::function<void()> function;
+		JobCounter* counter;
+	};
+
+	struct WorkerQueue
+	{
+		std::mutex lock;
+		std::deque<Job> jobs;
+	};
+
+	bool pop(size_t queue, Job& job);
+	bool steal(size_t thief, Job& job);
+	void execute(Job& job);
+	void worker_loop(size_t index);
+
+	std::vector<std::unique_ptr<WorkerQueue>> _queues;
+	std::vector<std::thread> _workers;
+	std::mutex _sleepLock;
+	std::condition_variable _wake;
+	std::atomic<uint32_t> _queued{ 0 };
+	std::atomic<uint32_t> _nextQueue{ 0 };
+	std::atomic<bool> _running{ false };
+};
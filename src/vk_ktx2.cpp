@@ -0,0 +1,316 @@
+#include <vk_ktx2.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+	const uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+	struct Header {
+		uint8_t identifier[12];
+		uint32_t vkFormat;
+		uint32_t typeSize;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t layerCount;
+		uint32_t faceCount;
+		uint32_t levelCount;
+		uint32_t supercompressionScheme;
+		uint32_t dfdByteOffset;
+		uint32_t dfdByteLength;
+		uint32_t kvdByteOffset;
+		uint32_t kvdByteLength;
+		uint64_t sgdByteOffset;
+		uint64_t sgdByteLength;
+	};
+	static_assert(sizeof(Header) == 80, "ktx2 header is 80 bytes");
+
+	struct LevelIndex {
+		uint64_t byteOffset;
+		uint64_t byteLength;
+		uint64_t uncompressedByteLength;
+	};
+
+	// khr_df color models and channel ids
+	constexpr uint32_t KHR_DF_MODEL_RGBSDA = 1;
+	constexpr uint32_t KHR_DF_MODEL_BC1A = 128;
+	constexpr uint32_t KHR_DF_MODEL_BC3 = 130;
+	constexpr uint32_t KHR_DF_MODEL_BC7 = 134;
+	constexpr uint32_t KHR_DF_CHANNEL_COLOR = 0;
+	constexpr uint32_t KHR_DF_CHANNEL_BC3_ALPHA = 15;
+	constexpr uint32_t KHR_DF_CHANNEL_RGBSDA_ALPHA = 15;
+	constexpr uint32_t KHR_DF_PRIMARIES_BT709 = 1;
+	constexpr uint32_t KHR_DF_TRANSFER_LINEAR = 1;
+	constexpr uint32_t KHR_DF_TRANSFER_SRGB = 2;
+
+	bool is_srgb(VkFormat format)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		case VK_FORMAT_BC3_SRGB_BLOCK:
+		case VK_FORMAT_BC7_SRGB_BLOCK:
+		case VK_FORMAT_R8G8B8A8_SRGB:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	void put_sample(std::vector<uint32_t>& dfd, uint32_t bitOffset, uint32_t bitLength, uint32_t channel, uint32_t upper)
+	{
+		dfd.push_back(bitOffset | ((bitLength - 1) << 16) | (channel << 24));
+		dfd.push_back(0);
+		dfd.push_back(0);
+		dfd.push_back(upper);
+	}
+
+	// basic data format descriptor, one block
+	std::vector<uint32_t> make_dfd(VkFormat format)
+	{
+		uint32_t model = KHR_DF_MODEL_RGBSDA;
+		uint32_t blockDim = 0;
+		uint32_t bytesPlane0 = 4;
+		switch (format)
+		{
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+			model = KHR_DF_MODEL_BC1A;
+			blockDim = 3 | (3 << 8);
+			bytesPlane0 = 8;
+			break;
+		case VK_FORMAT_BC3_SRGB_BLOCK:
+		case VK_FORMAT_BC3_UNORM_BLOCK:
+			model = KHR_DF_MODEL_BC3;
+			blockDim = 3 | (3 << 8);
+			bytesPlane0 = 16;
+			break;
+		case VK_FORMAT_BC7_SRGB_BLOCK:
+		case VK_FORMAT_BC7_UNORM_BLOCK:
+			model = KHR_DF_MODEL_BC7;
+			blockDim = 3 | (3 << 8);
+			bytesPlane0 = 16;
+			break;
+		default:
+			break;
+		}
+
+		std::vector<uint32_t> block;
+		block.push_back(0);	// vendor khronos, descriptor type basic
+		block.push_back(0);	// version and size, filled below
+		block.push_back(model | (KHR_DF_PRIMARIES_BT709 << 8)
+			| ((is_srgb(format) ? KHR_DF_TRANSFER_SRGB : KHR_DF_TRANSFER_LINEAR) << 16));
+		block.push_back(blockDim);
+		block.push_back(bytesPlane0);
+		block.push_back(0);
+
+		if (model == KHR_DF_MODEL_RGBSDA)
+		{
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				put_sample(block, c * 8, 8, c == 3 ? KHR_DF_CHANNEL_RGBSDA_ALPHA : c, 255);
+			}
+		}
+		else if (model == KHR_DF_MODEL_BC3)
+		{
+			put_sample(block, 0, 64, KHR_DF_CHANNEL_BC3_ALPHA, 0xFFFFFFFF);
+			put_sample(block, 64, 64, KHR_DF_CHANNEL_COLOR, 0xFFFFFFFF);
+		}
+		else
+		{
+			put_sample(block, 0, bytesPlane0 * 8, KHR_DF_CHANNEL_COLOR, 0xFFFFFFFF);
+		}
+		// version 2, block size in bytes
+		block[1] = 2 | (static_cast<uint32_t>(block.size() * 4) << 16);
+
+		std::vector<uint32_t> dfd;
+		dfd.push_back(static_cast<uint32_t>(block.size() * 4 + 4));
+		dfd.insert(dfd.end(), block.begin(), block.end());
+		return dfd;
+	}
+
+	size_t align_up(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+namespace ktx2 {
+
+	std::string texture_path(const std::string& imagePath)
+	{
+		size_t dot = imagePath.find_last_of('.');
+		size_t slash = imagePath.find_last_of("/\\");
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		{
+			return imagePath + ".ktx2";
+		}
+		return imagePath.substr(0, dot) + ".ktx2";
+	}
+
+	bool is_block_compressed(VkFormat format)
+	{
+		return format != VK_FORMAT_R8G8B8A8_SRGB && format != VK_FORMAT_R8G8B8A8_UNORM && level_size(format, 1, 1) != 0;
+	}
+
+	size_t level_size(VkFormat format, uint32_t width, uint32_t height)
+	{
+		size_t blocks = static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4);
+		switch (format)
+		{
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+			return blocks * 8;
+		case VK_FORMAT_BC3_SRGB_BLOCK:
+		case VK_FORMAT_BC3_UNORM_BLOCK:
+		case VK_FORMAT_BC7_SRGB_BLOCK:
+		case VK_FORMAT_BC7_UNORM_BLOCK:
+			return blocks * 16;
+		case VK_FORMAT_R8G8B8A8_SRGB:
+		case VK_FORMAT_R8G8B8A8_UNORM:
+			return static_cast<size_t>(width) * height * 4;
+		default:
+			return 0;
+		}
+	}
+
+	const char* format_name(VkFormat format)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+			return "BC1";
+		case VK_FORMAT_BC3_SRGB_BLOCK:
+		case VK_FORMAT_BC3_UNORM_BLOCK:
+			return "BC3";
+		case VK_FORMAT_BC7_SRGB_BLOCK:
+		case VK_FORMAT_BC7_UNORM_BLOCK:
+			return "BC7";
+		case VK_FORMAT_R8G8B8A8_SRGB:
+		case VK_FORMAT_R8G8B8A8_UNORM:
+			return "RGBA8";
+		default:
+			return "unknown";
+		}
+	}
+
+	bool parse(const uint8_t* data, size_t size, Image& out)
+	{
+		if (size < sizeof(Header))
+		{
+			return false;
+		}
+		Header header;
+		memcpy(&header, data, sizeof(Header));
+		if (memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0)
+		{
+			return false;
+		}
+		VkFormat format = static_cast<VkFormat>(header.vkFormat);
+		if (level_size(format, 1, 1) == 0 || header.supercompressionScheme != 0
+			|| header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelDepth != 0
+			|| header.layerCount > 1 || header.faceCount != 1)
+		{
+			return false;
+		}
+		// 0 asks the loader to build the chain, this one only uploads
+		uint32_t levelCount = header.levelCount;
+		if (levelCount == 0 || levelCount > 32 || size < sizeof(Header) + levelCount * sizeof(LevelIndex))
+		{
+			return false;
+		}
+
+		out.format = format;
+		out.width = header.pixelWidth;
+		out.height = header.pixelHeight;
+		out.levels.clear();
+		for (uint32_t i = 0; i < levelCount; i++)
+		{
+			LevelIndex index;
+			memcpy(&index, data + sizeof(Header) + i * sizeof(LevelIndex), sizeof(LevelIndex));
+			uint32_t width = std::max(header.pixelWidth >> i, 1u);
+			uint32_t height = std::max(header.pixelHeight >> i, 1u);
+			if (index.byteLength != level_size(format, width, height)
+				|| index.byteOffset > size || index.byteLength > size - index.byteOffset)
+			{
+				return false;
+			}
+			out.levels.push_back({ static_cast<size_t>(index.byteOffset), static_cast<size_t>(index.byteLength), width, height });
+		}
+		return true;
+	}
+
+	bool write(const std::string& path, VkFormat format, uint32_t width, uint32_t height,
+		const std::vector<std::vector<uint8_t>>& levels)
+	{
+		if (levels.empty() || level_size(format, 1, 1) == 0)
+		{
+			return false;
+		}
+		std::vector<uint32_t> dfd = make_dfd(format);
+
+		Header header = {};
+		memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+		header.vkFormat = format;
+		header.typeSize = 1;
+		header.pixelWidth = width;
+		header.pixelHeight = height;
+		header.pixelDepth = 0;
+		header.layerCount = 0;
+		header.faceCount = 1;
+		header.levelCount = static_cast<uint32_t>(levels.size());
+		header.supercompressionScheme = 0;
+		header.dfdByteOffset = static_cast<uint32_t>(sizeof(Header) + levels.size() * sizeof(LevelIndex));
+		header.dfdByteLength = static_cast<uint32_t>(dfd.size() * 4);
+
+		// levels are aligned to the block size (lcm with 4), smallest first
+		size_t alignment = is_block_compressed(format) ? level_size(format, 1, 1) : 4;
+		std::vector<LevelIndex> index(levels.size());
+		size_t offset = header.dfdByteOffset + header.dfdByteLength;
+		for (size_t i = levels.size(); i-- > 0;)
+		{
+			offset = align_up(offset, alignment);
+			index[i] = { offset, levels[i].size(), levels[i].size() };
+			offset += levels[i].size();
+		}
+
+		std::string tmpPath = path + ".tmp";
+		FILE* file = fopen(tmpPath.c_str(), "wb");
+		if (!file)
+		{
+			return false;
+		}
+		bool ok = fwrite(&header, sizeof(Header), 1, file) == 1
+			&& fwrite(index.data(), sizeof(LevelIndex), index.size(), file) == index.size()
+			&& fwrite(dfd.data(), 4, dfd.size(), file) == dfd.size();
+		size_t written = header.dfdByteOffset + header.dfdByteLength;
+		const uint8_t zeros[16] = {};
+		for (size_t i = levels.size(); ok && i-- > 0;)
+		{
+			size_t padding = static_cast<size_t>(index[i].byteOffset) - written;
+			ok = fwrite(zeros, 1, padding, file) == padding
+				&& fwrite(levels[i].data(), 1, levels[i].size(), file) == levels[i].size();
+			written = static_cast<size_t>(index[i].byteOffset) + levels[i].size();
+		}
+		ok = fclose(file) == 0 && ok;
+		if (!ok)
+		{
+			remove(tmpPath.c_str());
+			return false;
+		}
+#ifdef _WIN32
+		remove(path.c_str());
+#endif
+		return rename(tmpPath.c_str(), path.c_str()) == 0;
+	}
+}
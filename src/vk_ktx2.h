@@ -0,0 +1,44 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Minimal KTX2 container support, only what the engine uploads directly:
+// one 2d image (no layers, faces or depth), no supercompression, block
+// compressed BC1/BC3/BC7 or plain rgba8. Level data is stored smallest
+// level first as the spec asks, the level index is in base level order.
+namespace ktx2 {
+
+	struct Level {
+		size_t offset;
+		size_t size;
+		uint32_t width;
+		uint32_t height;
+	};
+
+	struct Image {
+		VkFormat format;
+		uint32_t width;
+		uint32_t height;
+		// levels[0] is the base level
+		std::vector<Level> levels;
+	};
+
+	// "<name>.ktx2" next to "<name>.png"
+	std::string texture_path(const std::string& imagePath);
+
+	// checks the header and level index of a ktx2 file in memory, every level
+	// is in bounds and exactly the size its format and extent need
+	bool parse(const uint8_t* data, size_t size, Image& out);
+
+	// levels base first, written to a temp file renamed over path
+	bool write(const std::string& path, VkFormat format, uint32_t width, uint32_t height,
+		const std::vector<std::vector<uint8_t>>& levels);
+
+	bool is_block_compressed(VkFormat format);
+	// bytes of one level of format, 0 for formats the loader does not take
+	size_t level_size(VkFormat format, uint32_t width, uint32_t height);
+	const char* format_name(VkFormat format);
+}
@@ -0,0 +1,28 @@
+#include <vk_linear_allocator.h>
+
+void LinearAllocator::init(VkBuffer buffer, char* mapped, size_t begin, size_t capacity)
+{
+	_buffer = buffer;
+	_mapped = mapped;
+	_begin = begin;
+	_end = begin + capacity;
+	_head = begin;
+}
+
+LinearAllocation LinearAllocator::alloc(size_t size, size_t alignment)
+{
+	LinearAllocation allocation;
+	size_t start = _head;
+	if (alignment > 1)
+	{
+		start = (start + alignment - 1) & ~(alignment - 1);
+	}
+	if (start + size > _end)
+	{
+		return allocation;
+	}
+	_head = start + size;
+	allocation.data = _mapped + start;
+	allocation.offset = static_cast<uint32_t>(start);
+	return allocation;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <vk_types.h>
+#include <cstddef>
+#include <cstdint>
+
+// one sub allocation, offset is relative to the start of the backing buffer
+// so it can be used directly as a dynamic descriptor offset
+struct LinearAllocation {
+	void* data{ nullptr };
+	uint32_t offset{ 0 };
+};
+
+// Bump allocator over a window of a persistently mapped buffer.
+// Every frame owns one window and resets it once its render fence signaled,
+// nothing is mapped, unmapped or freed on the frame path.
+class LinearAllocator {
+public:
+	void init(VkBuffer buffer, char* mapped, size_t begin, size_t capacity);
+	void reset() { _head = _begin; }
+
+	// data is null when the window is exhausted
+	LinearAllocation alloc(size_t size, size_t alignment);
+
+	VkBuffer buffer() const { return _buffer; }
+	size_t used() const { return _head - _begin; }
+	size_t capacity() const { return _end - _begin; }
+
+private:
+	VkBuffer _buffer{ VK_NULL_HANDLE };
+	char* _mapped{ nullptr };
+	size_t _begin{ 0 };
+	size_t _end{ 0 };
+	size_t _head{ 0 };
+};
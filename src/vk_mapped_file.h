@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read only memory mapping of a whole file. The mapping lives until close()
+// or destruction, pointers into data() must not outlive it.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string& path);
+	void close();
+
+	const uint8_t* data() const { return _data; }
+	size_t size() const { return _size; }
+	bool is_open() const { return _data != nullptr; }
+
+private:
+	const uint8_t* _data{ nullptr };
+	size_t _size{ 0 };
+#ifdef _WIN32
+	void* _file{ nullptr };
+	void* _mapping{ nullptr };
+#endif
+};
+
+namespace file_box {
+	// modification time (seconds) and size of the file, false if it does not exist
+	bool file_stat(const std::string& path, int64_t& mtime, uint64_t& size);
+
+	// 64 bit FNV-1a
+	uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325ull);
+}
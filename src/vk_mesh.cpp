@@ -1,6 +1,38 @@
 #include <vk_mesh.h>
-#include <tiny_obj_loader.h>
+#include <vk_obj_parser.h>
 #include <iostream>
+#include <unordered_map>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <glm/geometric.hpp>
+#include <glm/common.hpp>
+
+namespace {
+	// one obj face corner, vertices are welded when all three indices match
+	struct ObjIndexKey
+	{
+		int vertex_index;
+		int normal_index;
+		int texcoord_index;
+
+		bool operator==(const ObjIndexKey& other) const {
+			return vertex_index == other.vertex_index
+				&& normal_index == other.normal_index
+				&& texcoord_index == other.texcoord_index;
+		}
+	};
+
+	struct ObjIndexKeyHash
+	{
+		size_t operator()(const ObjIndexKey& key) const {
+			size_t h = std::hash<int>()(key.vertex_index);
+			h ^= std::hash<int>()(key.normal_index) + 0x9e3779b9 + (h << 6) + (h >> 2);
+			h ^= std::hash<int>()(key.texcoord_index) + 0x9e3779b9 + (h << 6) + (h >> 2);
+			return h;
+		}
+	};
+}
 
 VertexInputDescription Vertex::get_vertex_description()
 {
@@ -49,70 +81,124 @@ VertexInputDescription Vertex::get_vertex_description()
 	return description;
 }
 
-bool Mesh::load_from_obj(const char* filename)
+bool Mesh::load_from_obj(const char* filename, unsigned threadCount)
 {
-	tinyobj::attrib_t attrib;
-	//shapes contains the info for each separate object in the file
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
-
-	std::string warn;
-	std::string err;
-	tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filename, nullptr);
-	if (!warn.empty()) {
-		std::cout << "WARN: " << warn << std::endl;
-	}
-	//if we have any error, print it to the console, and break the mesh loading.
+	ObjData obj;
 	//This happens if the file can't be found or is malformed
-	if (!err.empty()) {
-		std::cerr << err << std::endl;
+	if (!obj_parser::parse(filename, obj, threadCount))
+	{
+		std::cerr << "failed to load obj file " << filename << std::endl;
 		return false;
 	}
-	// SIMD
-	// Loop over shapes
-	for (size_t s = 0; s < shapes.size(); s++) {
-		// Loop over faces(polygon)
-		size_t index_offset = 0;
-		for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
-
-			//hardcode loading to triangles
-			int fv = 3;
-
-			// Loop over vertices in the face.
-			for (size_t v = 0; v < fv; v++) {
-				// access to vertex
-				tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-
-				//vertex position
-				tinyobj::real_t vx = attrib.vertices[3 * idx.vertex_index + 0];
-				tinyobj::real_t vy = attrib.vertices[3 * idx.vertex_index + 1];
-				tinyobj::real_t vz = attrib.vertices[3 * idx.vertex_index + 2];
-				//vertex normal
-				tinyobj::real_t nx = attrib.normals[3 * idx.normal_index + 0];
-				tinyobj::real_t ny = attrib.normals[3 * idx.normal_index + 1];
-				tinyobj::real_t nz = attrib.normals[3 * idx.normal_index + 2];
-				//vertex uv
-				tinyobj::real_t ux = attrib.texcoords[2 * idx.texcoord_index + 0];
-				tinyobj::real_t uy = attrib.texcoords[2 * idx.texcoord_index + 1];
-				//copy it into our vertex
-				Vertex new_vert;
-				new_vert.position.x = vx;
-				new_vert.position.y = vy;
-				new_vert.position.z = vz;
-
-				new_vert.normal.x = nx;
-				new_vert.normal.y = ny;
-				new_vert.normal.z = nz;
-
-				new_vert.uv.x = ux;
-				new_vert.uv.y = 1 - uy;
-				//we are setting the vertex color as the vertex normal. This is just for display purposes
-				new_vert.color = new_vert.normal;
-
-				_vertices.push_back(new_vert);
-			}
-			index_offset += fv;
+
+	size_t face_corners = obj.indices.size();
+	std::unordered_map<ObjIndexKey, uint32_t, ObjIndexKeyHash> weld_map;
+	weld_map.reserve(face_corners);
+	_vertices.reserve(face_corners);
+	_indices.reserve(face_corners);
+
+	// Loop over the triangle corners of all shapes
+	for (const ObjIndex& idx : obj.indices)
+	{
+		ObjIndexKey key = { idx.vertex_index, idx.normal_index, idx.texcoord_index };
+		auto found = weld_map.find(key);
+		if (found != weld_map.end())
+		{
+			_indices.push_back(found->second);
+			continue;
 		}
+
+		//vertex position
+		float vx = obj.vertices[3 * idx.vertex_index + 0];
+		float vy = obj.vertices[3 * idx.vertex_index + 1];
+		float vz = obj.vertices[3 * idx.vertex_index + 2];
+		//vertex normal
+		float nx = obj.normals[3 * idx.normal_index + 0];
+		float ny = obj.normals[3 * idx.normal_index + 1];
+		float nz = obj.normals[3 * idx.normal_index + 2];
+		//vertex uv
+		float ux = obj.texcoords[2 * idx.texcoord_index + 0];
+		float uy = obj.texcoords[2 * idx.texcoord_index + 1];
+		//copy it into our vertex
+		Vertex new_vert;
+		new_vert.position.x = vx;
+		new_vert.position.y = vy;
+		new_vert.position.z = vz;
+
+		new_vert.normal.x = nx;
+		new_vert.normal.y = ny;
+		new_vert.normal.z = nz;
+
+		new_vert.uv.x = ux;
+		new_vert.uv.y = 1 - uy;
+		//we are setting the vertex color as the vertex normal. This is just for display purposes
+		new_vert.color = new_vert.normal;
+
+		uint32_t new_index = static_cast<uint32_t>(_vertices.size());
+		weld_map.emplace(key, new_index);
+		_vertices.push_back(new_vert);
+		_indices.push_back(new_index);
 	}
+	_sourceVertexCount = face_corners;
+	_vertexCount = static_cast<uint32_t>(_vertices.size());
+	_indexCount = static_cast<uint32_t>(_indices.size());
+	_indexType = _vertices.size() <= 0xFFFF ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+	compute_bounds();
 	return true;
-}
\ No newline at end of file
+}
+
+void Mesh::compute_bounds()
+{
+	if (_vertices.empty())
+	{
+		_bounds = {};
+		return;
+	}
+	glm::vec3 min = _vertices[0].position;
+	glm::vec3 max = _vertices[0].position;
+	for (const Vertex& v : _vertices)
+	{
+		min = glm::min(min, v.position);
+		max = glm::max(max, v.position);
+	}
+	_bounds.min = min;
+	_bounds.max = max;
+	_bounds.origin = (min + max) * 0.5f;
+
+	float radius2 = 0.f;
+	for (const Vertex& v : _vertices)
+	{
+		glm::vec3 d = v.position - _bounds.origin;
+		radius2 = std::max(radius2, glm::dot(d, d));
+	}
+	_bounds.radius = std::sqrt(radius2);
+}
+
+size_t Mesh::index_stride() const
+{
+	return _indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+size_t Mesh::vertex_bytes() const
+{
+	return static_cast<size_t>(_vertexCount) * sizeof(Vertex);
+}
+
+size_t Mesh::index_bytes() const
+{
+	return static_cast<size_t>(_indexCount) * index_stride();
+}
+
+void Mesh::copy_indices(void* dst) const
+{
+	if (_indexType == VK_INDEX_TYPE_UINT32)
+	{
+		memcpy(dst, _indices.data(), _indices.size() * sizeof(uint32_t));
+		return;
+	}
+	uint16_t* packed = static_cast<uint16_t*>(dst);
+	for (size_t i = 0; i < _indices.size(); i++)
+	{
+		packed[i] = static_cast<uint16_t>(_indices[i]);
+	}
+}
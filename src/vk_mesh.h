@@ -14,6 +14,11 @@ struct AllocatedBuffer {
 	VmaAllocation _allocation;
 };
 
+// timeline value of the UploadManager batch that fills a resource
+struct UploadToken {
+	uint64_t value{ 0 };
+};
+
 struct Vertex
 {
 	glm::vec3 position;
@@ -23,9 +28,40 @@ struct Vertex
 	static VertexInputDescription get_vertex_description();
 };
 
+struct MeshBounds
+{
+	glm::vec3 min;
+	glm::vec3 max;
+	// bounding sphere around the aabb center
+	glm::vec3 origin;
+	float radius;
+};
+
 struct Mesh
 {
 	std::vector<Vertex> _vertices;
+	// welded index list, always kept as 32 bit on the cpu side
+	std::vector<uint32_t> _indices;
 	AllocatedBuffer _vertexBuffer;
-	bool load_from_obj(const char* filename);
-};
\ No newline at end of file
+	AllocatedBuffer _indexBuffer;
+	// 16 bit when every vertex can be addressed with it, chosen at load time
+	VkIndexType _indexType{ VK_INDEX_TYPE_UINT32 };
+	// counts stay valid when the mesh is uploaded straight from a cache mapping
+	// and _vertices/_indices are left empty
+	uint32_t _vertexCount{ 0 };
+	uint32_t _indexCount{ 0 };
+	MeshBounds _bounds{};
+	UploadToken _uploadToken{};
+	// face corners before welding, only used for load statistics
+	size_t _sourceVertexCount{ 0 };
+
+	// threadCount 0 lets the obj parser use every core
+	bool load_from_obj(const char* filename, unsigned threadCount = 0);
+	void compute_bounds();
+
+	size_t index_stride() const;
+	size_t vertex_bytes() const;
+	size_t index_bytes() const;
+	// write _indices into dst using the gpu index type
+	void copy_indices(void* dst) const;
+};
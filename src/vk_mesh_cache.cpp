@@ -0,0 +1,147 @@
+#include <vk_mesh_cache.h>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+#include <cstring>
+
+namespace {
+	uint64_t align_up(uint64_t value, uint64_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	bool hash_file(const std::string& path, uint64_t& hash)
+	{
+		MappedFile source;
+		if (!source.open(path))
+		{
+			return false;
+		}
+		hash = file_box::hash_bytes(source.data(), source.size());
+		return true;
+	}
+
+	// header and blob ranges fit in the file and match this build
+	bool valid_layout(const MappedFile& file, uint64_t sourceSize)
+	{
+		if (file.size() < sizeof(MeshCacheHeader))
+		{
+			return false;
+		}
+		const MeshCacheHeader* header = reinterpret_cast<const MeshCacheHeader*>(file.data());
+		if (header->magic != MESH_CACHE_MAGIC || header->version != MESH_CACHE_VERSION
+			|| header->vertexStride != sizeof(Vertex) || header->sourceSize != sourceSize)
+		{
+			return false;
+		}
+		size_t index_stride = header->indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+		return header->vertexOffset + uint64_t(header->vertexCount) * sizeof(Vertex) <= header->indexOffset
+			&& header->indexOffset + uint64_t(header->indexCount) * index_stride <= file.size();
+	}
+
+	// patches sourceMtime of an existing cache file in place
+	bool write_mtime(const std::string& path, int64_t mtime)
+	{
+		FILE* file = fopen(path.c_str(), "r+b");
+		if (!file)
+		{
+			return false;
+		}
+		bool written = fseek(file, offsetof(MeshCacheHeader, sourceMtime), SEEK_SET) == 0
+			&& fwrite(&mtime, sizeof(mtime), 1, file) == 1;
+		return (fclose(file) == 0) && written;
+	}
+}
+
+namespace mesh_cache {
+
+	std::string cache_path(const std::string& objPath)
+	{
+		return objPath + ".meshcache";
+	}
+
+	bool write(const std::string& objPath, const Mesh& mesh)
+	{
+		MeshCacheHeader header = {};
+		header.magic = MESH_CACHE_MAGIC;
+		header.version = MESH_CACHE_VERSION;
+		header.vertexStride = sizeof(Vertex);
+		header.indexType = static_cast<uint32_t>(mesh._indexType);
+		header.vertexCount = mesh._vertexCount;
+		header.indexCount = mesh._indexCount;
+		header.sourceVertexCount = static_cast<uint32_t>(mesh._sourceVertexCount);
+		header.vertexOffset = align_up(sizeof(MeshCacheHeader), 16);
+		header.indexOffset = align_up(header.vertexOffset + mesh.vertex_bytes(), 16);
+		header.bounds = mesh._bounds;
+		if (!file_box::file_stat(objPath, header.sourceMtime, header.sourceSize)
+			|| !hash_file(objPath, header.sourceHash))
+		{
+			return false;
+		}
+
+		std::vector<char> blob(header.indexOffset + mesh.index_bytes(), 0);
+		memcpy(blob.data(), &header, sizeof(header));
+		memcpy(blob.data() + header.vertexOffset, mesh._vertices.data(), mesh.vertex_bytes());
+		mesh.copy_indices(blob.data() + header.indexOffset);
+
+		// write a temp file and rename it over the old cache so a crash never leaves a torn file
+		std::string path = cache_path(objPath);
+		std::string temp_path = path + ".tmp";
+		FILE* file = fopen(temp_path.c_str(), "wb");
+		if (!file)
+		{
+			return false;
+		}
+		bool written = fwrite(blob.data(), 1, blob.size(), file) == blob.size();
+		written = (fclose(file) == 0) && written;
+		if (!written)
+		{
+			remove(temp_path.c_str());
+			return false;
+		}
+#ifdef _WIN32
+		remove(path.c_str());
+#endif
+		return rename(temp_path.c_str(), path.c_str()) == 0;
+	}
+
+	const MeshCacheHeader* open(const std::string& objPath, MappedFile& file, Mesh& mesh)
+	{
+		int64_t mtime;
+		uint64_t size;
+		if (!file_box::file_stat(objPath, mtime, size) || !file.open(cache_path(objPath)))
+		{
+			return nullptr;
+		}
+
+		bool valid = valid_layout(file, size);
+		const MeshCacheHeader* header = reinterpret_cast<const MeshCacheHeader*>(file.data());
+		// a matching mtime is trusted as is, a touched file is only rebuilt when its contents changed
+		if (valid && header->sourceMtime != mtime)
+		{
+			uint64_t hash;
+			valid = hash_file(objPath, hash) && hash == header->sourceHash;
+			// same contents: store the new mtime so later starts skip the hash, the
+			// mapping is closed first since windows maps it without write sharing
+			if (valid)
+			{
+				file.close();
+				write_mtime(cache_path(objPath), mtime);
+				valid = file.open(cache_path(objPath)) && valid_layout(file, size);
+				header = reinterpret_cast<const MeshCacheHeader*>(file.data());
+			}
+		}
+		if (!valid)
+		{
+			file.close();
+			return nullptr;
+		}
+
+		mesh._vertexCount = header->vertexCount;
+		mesh._indexCount = header->indexCount;
+		mesh._indexType = static_cast<VkIndexType>(header->indexType);
+		mesh._sourceVertexCount = header->sourceVertexCount;
+		mesh._bounds = header->bounds;
+		return header;
+	}
+}
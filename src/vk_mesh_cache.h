@@ -0,0 +1,49 @@
+#pragma once
+#include <vk_mesh.h>
+#include <vk_mapped_file.h>
+#include <string>
+
+// Binary mesh cache written next to each obj as "<name>.obj.meshcache".
+// Layout: MeshCacheHeader, vertex blob (Vertex[vertexCount]) and index blob
+// (indexCount entries of the mesh index type), both 16 byte aligned so they
+// can be copied straight out of the mapping into a staging buffer.
+constexpr uint32_t MESH_CACHE_MAGIC = 0x4853454D; // "MESH"
+constexpr uint32_t MESH_CACHE_VERSION = 1;
+
+struct MeshCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertexStride;
+	uint32_t indexType;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t sourceVertexCount;
+	uint32_t pad;
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	// source obj identity, checked before the cache is trusted
+	int64_t sourceMtime;
+	uint64_t sourceSize;
+	uint64_t sourceHash;
+	MeshBounds bounds;
+};
+
+namespace mesh_cache {
+
+	std::string cache_path(const std::string& objPath);
+
+	// write mesh (loaded from objPath) to its cache file, the file is replaced atomically
+	bool write(const std::string& objPath, const Mesh& mesh);
+
+	// map the cache for objPath and validate it against the source obj.
+	// On success the header points into file and mesh gets counts, index type and bounds.
+	const MeshCacheHeader* open(const std::string& objPath, MappedFile& file, Mesh& mesh);
+
+	inline const void* vertex_data(const MeshCacheHeader* header) {
+		return reinterpret_cast<const char*>(header) + header->vertexOffset;
+	}
+	inline const void* index_data(const MeshCacheHeader* header) {
+		return reinterpret_cast<const char*>(header) + header->indexOffset;
+	}
+}
@@ -0,0 +1,158 @@
+#include <vk_mipmaps.h>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIP_SSE 1
+#endif
+
+namespace {
+
+	// linear to srgb has a steep start, 4096 steps keep the dark end exact
+	constexpr int LINEAR_STEPS = 4096;
+
+	struct SrgbTables {
+		float toLinear[256];
+		uint8_t toSrgb[LINEAR_STEPS];
+
+		SrgbTables()
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				float c = i / 255.f;
+				toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+			for (int i = 0; i < LINEAR_STEPS; i++)
+			{
+				float l = i / float(LINEAR_STEPS - 1);
+				float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.f / 2.4f) - 0.055f;
+				toSrgb[i] = static_cast<uint8_t>(std::min(255.f, c * 255.f + 0.5f));
+			}
+		}
+	};
+
+	const SrgbTables& tables()
+	{
+		static const SrgbTables t;
+		return t;
+	}
+
+	// one source row to linear rgba floats
+	void row_to_linear(const uint8_t* src, uint32_t width, float* out)
+	{
+		const SrgbTables& t = tables();
+		for (uint32_t x = 0; x < width; x++)
+		{
+			out[x * 4 + 0] = t.toLinear[src[x * 4 + 0]];
+			out[x * 4 + 1] = t.toLinear[src[x * 4 + 1]];
+			out[x * 4 + 2] = t.toLinear[src[x * 4 + 2]];
+			out[x * 4 + 3] = src[x * 4 + 3] / 255.f;
+		}
+	}
+
+	// averages 2x2 blocks of two linear rows, writes srgb bytes
+	void downsample_row(const float* row0, const float* row1, uint32_t width, uint8_t* dst)
+	{
+		const SrgbTables& t = tables();
+#if MIP_SSE
+		// a pixel is one register, rgb scaled for the table and alpha for bytes
+		const __m128 scale = _mm_setr_ps(0.25f * (LINEAR_STEPS - 1), 0.25f * (LINEAR_STEPS - 1),
+			0.25f * (LINEAR_STEPS - 1), 0.25f * 255.f);
+		alignas(16) int32_t index[4];
+		for (uint32_t x = 0; x < width; x++)
+		{
+			__m128 sum = _mm_add_ps(
+				_mm_add_ps(_mm_loadu_ps(row0 + x * 8), _mm_loadu_ps(row0 + x * 8 + 4)),
+				_mm_add_ps(_mm_loadu_ps(row1 + x * 8), _mm_loadu_ps(row1 + x * 8 + 4)));
+			// cvtps rounds to nearest
+			_mm_store_si128(reinterpret_cast<__m128i*>(index), _mm_cvtps_epi32(_mm_mul_ps(sum, scale)));
+			dst[x * 4 + 0] = t.toSrgb[index[0]];
+			dst[x * 4 + 1] = t.toSrgb[index[1]];
+			dst[x * 4 + 2] = t.toSrgb[index[2]];
+			dst[x * 4 + 3] = static_cast<uint8_t>(index[3]);
+		}
+#else
+		for (uint32_t x = 0; x < width; x++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				float sum = (row0[x * 8 + c] + row0[x * 8 + 4 + c]) + (row1[x * 8 + c] + row1[x * 8 + 4 + c]);
+				if (c < 3)
+				{
+					dst[x * 4 + c] = t.toSrgb[static_cast<int>(sum * 0.25f * (LINEAR_STEPS - 1) + 0.5f)];
+				}
+				else
+				{
+					dst[x * 4 + c] = static_cast<uint8_t>(sum * 0.25f * 255.f + 0.5f);
+				}
+			}
+		}
+#endif
+	}
+}
+
+namespace mipmaps {
+
+	uint32_t level_count(uint32_t width, uint32_t height)
+	{
+		uint32_t levels = 1;
+		while (width > 1 || height > 1)
+		{
+			width = std::max(width / 2, 1u);
+			height = std::max(height / 2, 1u);
+			levels++;
+		}
+		return levels;
+	}
+
+	void build_chain(const uint8_t* pixels, uint32_t width, uint32_t height,
+		std::vector<uint8_t>& outData, std::vector<Level>& outLevels)
+	{
+		outData.clear();
+		outLevels.clear();
+
+		size_t total = 0;
+		uint32_t w = width;
+		uint32_t h = height;
+		while (w > 1 || h > 1)
+		{
+			w = std::max(w / 2, 1u);
+			h = std::max(h / 2, 1u);
+			outLevels.push_back({ total, w, h });
+			total += static_cast<size_t>(w) * h * 4;
+		}
+		outData.resize(total);
+
+		std::vector<float> row0(static_cast<size_t>(std::max(width, 2u)) * 4);
+		std::vector<float> row1(static_cast<size_t>(std::max(width, 2u)) * 4);
+		const uint8_t* src = pixels;
+		uint32_t srcWidth = width;
+		uint32_t srcHeight = height;
+		for (const Level& level : outLevels)
+		{
+			uint8_t* dst = outData.data() + level.offset;
+			for (uint32_t y = 0; y < level.height; y++)
+			{
+				// a 1 texel wide or tall source repeats its only column or row
+				uint32_t y0 = srcHeight > 1 ? y * 2 : 0;
+				uint32_t y1 = srcHeight > 1 ? y * 2 + 1 : 0;
+				row_to_linear(src + static_cast<size_t>(y0) * srcWidth * 4, srcWidth, row0.data());
+				row_to_linear(src + static_cast<size_t>(y1) * srcWidth * 4, srcWidth, row1.data());
+				if (srcWidth == 1)
+				{
+					// duplicate the column so the 2x2 kernel still applies
+					for (int c = 0; c < 4; c++)
+					{
+						row0[4 + c] = row0[c];
+						row1[4 + c] = row1[c];
+					}
+				}
+				downsample_row(row0.data(), row1.data(), level.width, dst + static_cast<size_t>(y) * level.width * 4);
+			}
+			src = dst;
+			srcWidth = level.width;
+			srcHeight = level.height;
+		}
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mipmaps {
+
+	// one level of a chain, offset in bytes into the chain data
+	struct Level {
+		size_t offset;
+		uint32_t width;
+		uint32_t height;
+	};
+
+	// levels of a full chain down to 1x1, level 0 included
+	uint32_t level_count(uint32_t width, uint32_t height);
+
+	// box filters an rgba8 srgb image down to 1x1. The average is taken in
+	// linear space (alpha stays linear), odd sizes drop their last row or column.
+	// Only levels 1.. are written, level 0 stays with the caller.
+	void build_chain(const uint8_t* pixels, uint32_t width, uint32_t height,
+		std::vector<uint8_t>& outData, std::vector<Level>& outLevels);
+}
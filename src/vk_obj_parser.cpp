@@ -0,0 +1,623 @@
+#include <vk_obj_parser.h>
+#include <vk_mapped_file.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <thread>
+
+namespace {
+
+	inline bool is_space(char c) { return c == ' ' || c == '\t'; }
+	inline bool is_digit(char c) { return static_cast<unsigned int>(c - '0') < 10u; }
+
+	// corner whose indices were relative ("-1") and still need the vertex
+	// counts of the previous chunks added
+	struct RelativeCorner
+	{
+		uint32_t corner;
+		uint32_t mask;
+	};
+
+	enum RelativeMask : uint32_t
+	{
+		RELATIVE_VERTEX = 1,
+		RELATIVE_TEXCOORD = 2,
+		RELATIVE_NORMAL = 4,
+	};
+
+	struct ObjChunk
+	{
+		const char* begin;
+		const char* end;
+
+		std::vector<float> vertices;
+		std::vector<float> normals;
+		std::vector<float> texcoords;
+		// raw face corners and the corner count of every face
+		std::vector<ObjIndex> corners;
+		std::vector<uint32_t> faceSizes;
+		std::vector<RelativeCorner> relative;
+		bool trianglesOnly{ true };
+		bool ok{ true };
+
+		// output of the second pass
+		std::vector<ObjIndex> indices;
+	};
+
+	const char* skip_spaces(const char* p, const char* end)
+	{
+		while (p < end && is_space(*p)) p++;
+		return p;
+	}
+
+	// tinyobj parseReal: one whitespace separated token, default when it does not parse
+	float parse_real(const char*& p, const char* end)
+	{
+		p = skip_spaces(p, end);
+		const char* token_end = p;
+		while (token_end < end && !is_space(*token_end) && *token_end != '\r') token_end++;
+		double value = 0.0;
+		obj_parser::parse_float(p, token_end, value);
+		p = token_end;
+		return static_cast<float>(value);
+	}
+
+	// atoi on a bounded range
+	int parse_int(const char* p, const char* end)
+	{
+		p = skip_spaces(p, end);
+		bool negative = false;
+		if (p < end && (*p == '+' || *p == '-'))
+		{
+			negative = *p == '-';
+			p++;
+		}
+		int value = 0;
+		while (p < end && is_digit(*p))
+		{
+			value = value * 10 + (*p - '0');
+			p++;
+		}
+		return negative ? -value : value;
+	}
+
+	const char* skip_index(const char* p, const char* end)
+	{
+		while (p < end && *p != '/' && !is_space(*p) && *p != '\r') p++;
+		return p;
+	}
+
+	// tinyobj fixIndex, relative indices are resolved against the chunk local count
+	bool fix_index(int idx, size_t localCount, int& out, bool& relative)
+	{
+		if (idx > 0)
+		{
+			out = idx - 1;
+			return true;
+		}
+		if (idx == 0)
+		{
+			return false;
+		}
+		out = static_cast<int>(localCount) + idx;
+		relative = true;
+		return true;
+	}
+
+	bool parse_face(ObjChunk& chunk, const char* p, const char* end)
+	{
+		const size_t v_count = chunk.vertices.size() / 3;
+		const size_t vn_count = chunk.normals.size() / 3;
+		const size_t vt_count = chunk.texcoords.size() / 2;
+		uint32_t face_size = 0;
+
+		p = skip_spaces(p, end);
+		while (p < end)
+		{
+			ObjIndex corner = { -1, -1, -1 };
+			uint32_t mask = 0;
+			bool relative = false;
+
+			if (!fix_index(parse_int(p, end), v_count, corner.vertex_index, relative))
+			{
+				return false;
+			}
+			if (relative)
+			{
+				mask |= RELATIVE_VERTEX;
+			}
+			p = skip_index(p, end);
+			if (p < end && *p == '/')
+			{
+				p++;
+				if (p < end && *p == '/')
+				{
+					// i//k
+					p++;
+					relative = false;
+					if (!fix_index(parse_int(p, end), vn_count, corner.normal_index, relative))
+					{
+						return false;
+					}
+					if (relative)
+					{
+						mask |= RELATIVE_NORMAL;
+					}
+					p = skip_index(p, end);
+				}
+				else
+				{
+					// i/j/k or i/j
+					relative = false;
+					if (!fix_index(parse_int(p, end), vt_count, corner.texcoord_index, relative))
+					{
+						return false;
+					}
+					if (relative)
+					{
+						mask |= RELATIVE_TEXCOORD;
+					}
+					p = skip_index(p, end);
+					if (p < end && *p == '/')
+					{
+						p++;
+						relative = false;
+						if (!fix_index(parse_int(p, end), vn_count, corner.normal_index, relative))
+						{
+							return false;
+						}
+						if (relative)
+						{
+							mask |= RELATIVE_NORMAL;
+						}
+						p = skip_index(p, end);
+					}
+				}
+			}
+
+			if (mask)
+			{
+				chunk.relative.push_back({ static_cast<uint32_t>(chunk.corners.size()), mask });
+			}
+			chunk.corners.push_back(corner);
+			face_size++;
+			while (p < end && (is_space(*p) || *p == '\r')) p++;
+		}
+
+		chunk.faceSizes.push_back(face_size);
+		chunk.trianglesOnly &= face_size == 3;
+		return true;
+	}
+
+	void parse_chunk(ObjChunk& chunk)
+	{
+		const char* p = chunk.begin;
+		while (p < chunk.end)
+		{
+			const char* line_end = p;
+			while (line_end < chunk.end && *line_end != '\n' && *line_end != '\r') line_end++;
+
+			const char* token = skip_spaces(p, line_end);
+			p = line_end + 1;
+			if (line_end - token < 2 || token[0] == '#')
+			{
+				continue;
+			}
+
+			if (token[0] == 'v' && is_space(token[1]))
+			{
+				token += 2;
+				chunk.vertices.push_back(parse_real(token, line_end));
+				chunk.vertices.push_back(parse_real(token, line_end));
+				chunk.vertices.push_back(parse_real(token, line_end));
+			}
+			else if (token[0] == 'v' && token[1] == 'n' && line_end - token > 2 && is_space(token[2]))
+			{
+				token += 3;
+				chunk.normals.push_back(parse_real(token, line_end));
+				chunk.normals.push_back(parse_real(token, line_end));
+				chunk.normals.push_back(parse_real(token, line_end));
+			}
+			else if (token[0] == 'v' && token[1] == 't' && line_end - token > 2 && is_space(token[2]))
+			{
+				token += 3;
+				chunk.texcoords.push_back(parse_real(token, line_end));
+				chunk.texcoords.push_back(parse_real(token, line_end));
+			}
+			else if (token[0] == 'f' && is_space(token[1]))
+			{
+				if (!parse_face(chunk, token + 2, line_end))
+				{
+					chunk.ok = false;
+					return;
+				}
+			}
+			// everything else (groups, materials, smoothing) does not change the geometry
+		}
+	}
+
+	template <typename T>
+	int pnpoly(int nvert, T* vertx, T* verty, T testx, T testy)
+	{
+		int i, j, c = 0;
+		for (i = 0, j = nvert - 1; i < nvert; j = i++) {
+			if (((verty[i] > testy) != (verty[j] > testy)) &&
+				(testx < (vertx[j] - vertx[i]) * (testy - verty[i]) / (verty[j] - verty[i]) + vertx[i]))
+				c = !c;
+		}
+		return c;
+	}
+
+	// Ear clipping exactly as tinyobj exportGroupsToShape does it, so polygon
+	// faces split into the same triangles in the same order.
+	void triangulate_polygon(const ObjIndex* face, size_t count, const std::vector<float>& v, std::vector<ObjIndex>& out)
+	{
+		size_t npolys = count;
+		size_t axes[2] = { 1, 2 };
+		for (size_t k = 0; k < npolys; ++k) {
+			size_t vi0 = size_t(face[(k + 0) % npolys].vertex_index);
+			size_t vi1 = size_t(face[(k + 1) % npolys].vertex_index);
+			size_t vi2 = size_t(face[(k + 2) % npolys].vertex_index);
+			if (((3 * vi0 + 2) >= v.size()) || ((3 * vi1 + 2) >= v.size()) || ((3 * vi2 + 2) >= v.size())) {
+				continue;
+			}
+			float e0x = v[vi1 * 3 + 0] - v[vi0 * 3 + 0];
+			float e0y = v[vi1 * 3 + 1] - v[vi0 * 3 + 1];
+			float e0z = v[vi1 * 3 + 2] - v[vi0 * 3 + 2];
+			float e1x = v[vi2 * 3 + 0] - v[vi1 * 3 + 0];
+			float e1y = v[vi2 * 3 + 1] - v[vi1 * 3 + 1];
+			float e1z = v[vi2 * 3 + 2] - v[vi1 * 3 + 2];
+			float cx = std::fabs(e0y * e1z - e0z * e1y);
+			float cy = std::fabs(e0z * e1x - e0x * e1z);
+			float cz = std::fabs(e0x * e1y - e0y * e1x);
+			const float epsilon = std::numeric_limits<float>::epsilon();
+			if (cx > epsilon || cy > epsilon || cz > epsilon) {
+				// found a corner
+				if (!(cx > cy && cx > cz)) {
+					axes[0] = 0;
+					if (cz > cx && cz > cy) axes[1] = 1;
+				}
+				break;
+			}
+		}
+
+		float area = 0;
+		for (size_t k = 0; k < npolys; ++k) {
+			size_t vi0 = size_t(face[(k + 0) % npolys].vertex_index);
+			size_t vi1 = size_t(face[(k + 1) % npolys].vertex_index);
+			if (((vi0 * 3 + axes[0]) >= v.size()) || ((vi0 * 3 + axes[1]) >= v.size()) ||
+				((vi1 * 3 + axes[0]) >= v.size()) || ((vi1 * 3 + axes[1]) >= v.size())) {
+				continue;
+			}
+			float v0x = v[vi0 * 3 + axes[0]];
+			float v0y = v[vi0 * 3 + axes[1]];
+			float v1x = v[vi1 * 3 + axes[0]];
+			float v1y = v[vi1 * 3 + axes[1]];
+			area += (v0x * v1y - v0y * v1x) * 0.5f;
+		}
+
+		std::vector<ObjIndex> remaining(face, face + count);
+		size_t guess_vert = 0;
+		ObjIndex ind[3];
+		float vx[3];
+		float vy[3];
+		size_t remainingIterations = remaining.size();
+		size_t previousRemainingVertices = remaining.size();
+
+		while (remaining.size() > 3 && remainingIterations > 0) {
+			npolys = remaining.size();
+			if (guess_vert >= npolys) {
+				guess_vert -= npolys;
+			}
+			if (previousRemainingVertices != npolys) {
+				previousRemainingVertices = npolys;
+				remainingIterations = npolys;
+			}
+			else {
+				remainingIterations--;
+			}
+
+			for (size_t k = 0; k < 3; k++) {
+				ind[k] = remaining[(guess_vert + k) % npolys];
+				size_t vi = size_t(ind[k].vertex_index);
+				if (((vi * 3 + axes[0]) >= v.size()) || ((vi * 3 + axes[1]) >= v.size())) {
+					vx[k] = 0.0f;
+					vy[k] = 0.0f;
+				}
+				else {
+					vx[k] = v[vi * 3 + axes[0]];
+					vy[k] = v[vi * 3 + axes[1]];
+				}
+			}
+			float e0x = vx[1] - vx[0];
+			float e0y = vy[1] - vy[0];
+			float e1x = vx[2] - vx[1];
+			float e1y = vy[2] - vy[1];
+			float cross = e0x * e1y - e0y * e1x;
+			// if an internal angle
+			if (cross * area < 0.0f) {
+				guess_vert += 1;
+				continue;
+			}
+
+			// check all other verts in case they are inside this triangle
+			bool overlap = false;
+			for (size_t otherVert = 3; otherVert < npolys; ++otherVert) {
+				size_t idx = (guess_vert + otherVert) % npolys;
+				size_t ovi = size_t(remaining[idx].vertex_index);
+				if (((ovi * 3 + axes[0]) >= v.size()) || ((ovi * 3 + axes[1]) >= v.size())) {
+					continue;
+				}
+				float tx = v[ovi * 3 + axes[0]];
+				float ty = v[ovi * 3 + axes[1]];
+				if (pnpoly(3, vx, vy, tx, ty)) {
+					overlap = true;
+					break;
+				}
+			}
+			if (overlap) {
+				guess_vert += 1;
+				continue;
+			}
+
+			// this triangle is an ear
+			out.push_back(ind[0]);
+			out.push_back(ind[1]);
+			out.push_back(ind[2]);
+
+			// remove v1 from the list
+			remaining.erase(remaining.begin() + (guess_vert + 1) % npolys);
+		}
+
+		if (remaining.size() == 3) {
+			out.push_back(remaining[0]);
+			out.push_back(remaining[1]);
+			out.push_back(remaining[2]);
+		}
+	}
+
+	void build_indices(ObjChunk& chunk, size_t vertexBase, size_t normalBase, size_t texcoordBase, const std::vector<float>& v)
+	{
+		for (const RelativeCorner& rel : chunk.relative)
+		{
+			ObjIndex& corner = chunk.corners[rel.corner];
+			if (rel.mask & RELATIVE_VERTEX) corner.vertex_index += static_cast<int>(vertexBase);
+			if (rel.mask & RELATIVE_NORMAL) corner.normal_index += static_cast<int>(normalBase);
+			if (rel.mask & RELATIVE_TEXCOORD) corner.texcoord_index += static_cast<int>(texcoordBase);
+		}
+
+		if (chunk.trianglesOnly)
+		{
+			chunk.indices.swap(chunk.corners);
+			return;
+		}
+
+		chunk.indices.reserve(chunk.corners.size());
+		size_t offset = 0;
+		for (uint32_t face_size : chunk.faceSizes)
+		{
+			const ObjIndex* face = chunk.corners.data() + offset;
+			offset += face_size;
+			if (face_size < 3)
+			{
+				// face must have 3+ vertices
+				continue;
+			}
+			if (face_size == 3)
+			{
+				chunk.indices.insert(chunk.indices.end(), face, face + 3);
+				continue;
+			}
+			triangulate_polygon(face, face_size, v, chunk.indices);
+		}
+	}
+
+	template <typename Fn>
+	void run_parallel(size_t count, Fn&& fn)
+	{
+		std::vector<std::thread> workers;
+		workers.reserve(count > 0 ? count - 1 : 0);
+		for (size_t i = 1; i < count; i++)
+		{
+			workers.emplace_back([&fn, i]() { fn(i); });
+		}
+		if (count > 0)
+		{
+			fn(0);
+		}
+		for (std::thread& worker : workers)
+		{
+			worker.join();
+		}
+	}
+
+	template <typename T>
+	void append(std::vector<T>& dst, const std::vector<T>& src)
+	{
+		dst.insert(dst.end(), src.begin(), src.end());
+	}
+}
+
+namespace obj_parser {
+
+	bool parse_float(const char* s, const char* s_end, double& result)
+	{
+		if (s >= s_end)
+		{
+			return false;
+		}
+
+		double mantissa = 0.0;
+		int exponent = 0;
+		char sign = '+';
+		char exp_sign = '+';
+		const char* curr = s;
+		int read = 0;
+		bool end_not_reached = false;
+		bool leading_decimal_dots = false;
+
+		if (*curr == '+' || *curr == '-') {
+			sign = *curr;
+			curr++;
+			if ((curr != s_end) && (*curr == '.')) {
+				leading_decimal_dots = true;
+			}
+		}
+		else if (is_digit(*curr)) {
+		}
+		else if (*curr == '.') {
+			leading_decimal_dots = true;
+		}
+		else {
+			return false;
+		}
+
+		// integer part
+		end_not_reached = (curr != s_end);
+		if (!leading_decimal_dots) {
+			while (end_not_reached && is_digit(*curr)) {
+				mantissa *= 10;
+				mantissa += static_cast<int>(*curr - 0x30);
+				curr++;
+				read++;
+				end_not_reached = (curr != s_end);
+			}
+			if (read == 0) return false;
+		}
+
+		if (end_not_reached) {
+			// decimal part
+			if (*curr == '.') {
+				curr++;
+				read = 1;
+				end_not_reached = (curr != s_end);
+				while (end_not_reached && is_digit(*curr)) {
+					static const double pow_lut[] = {
+						1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001,
+					};
+					const int lut_entries = sizeof pow_lut / sizeof pow_lut[0];
+					mantissa += static_cast<int>(*curr - 0x30) *
+						(read < lut_entries ? pow_lut[read] : std::pow(10.0, -read));
+					read++;
+					curr++;
+					end_not_reached = (curr != s_end);
+				}
+			}
+			else if (*curr != 'e' && *curr != 'E') {
+				end_not_reached = false;
+			}
+		}
+
+		// exponent part
+		if (end_not_reached && (*curr == 'e' || *curr == 'E')) {
+			curr++;
+			end_not_reached = (curr != s_end);
+			if (end_not_reached && (*curr == '+' || *curr == '-')) {
+				exp_sign = *curr;
+				curr++;
+			}
+			else if (end_not_reached && is_digit(*curr)) {
+			}
+			else {
+				// empty E is not allowed
+				return false;
+			}
+
+			read = 0;
+			end_not_reached = (curr != s_end);
+			while (end_not_reached && is_digit(*curr)) {
+				exponent *= 10;
+				exponent += static_cast<int>(*curr - 0x30);
+				curr++;
+				read++;
+				end_not_reached = (curr != s_end);
+			}
+			exponent *= (exp_sign == '+' ? 1 : -1);
+			if (read == 0) return false;
+		}
+
+		result = (sign == '+' ? 1 : -1) *
+			(exponent ? std::ldexp(mantissa * std::pow(5.0, exponent), exponent) : mantissa);
+		return true;
+	}
+
+	bool parse(const char* filename, ObjData& out, unsigned threadCount)
+	{
+		MappedFile file;
+		if (!file.open(filename))
+		{
+			return false;
+		}
+		return parse(reinterpret_cast<const char*>(file.data()), file.size(), out, threadCount);
+	}
+
+	bool parse(const char* text, size_t size, ObjData& out, unsigned threadCount)
+	{
+		if (threadCount == 0)
+		{
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+		}
+		size_t chunk_count = std::min<size_t>(threadCount, size / MIN_CHUNK_BYTES + 1);
+
+		// split at line boundaries, every chunk starts at the beginning of a line
+		std::vector<ObjChunk> chunks(chunk_count);
+		const char* text_end = text + size;
+		const char* begin = text;
+		for (size_t i = 0; i < chunk_count; i++)
+		{
+			const char* end = (i + 1 == chunk_count) ? text_end : text + size * (i + 1) / chunk_count;
+			end = std::max(end, begin);
+			while (end < text_end && *end != '\n') end++;
+			if (end < text_end) end++;
+			chunks[i].begin = begin;
+			chunks[i].end = end;
+			begin = end;
+		}
+
+		run_parallel(chunk_count, [&](size_t i) { parse_chunk(chunks[i]); });
+
+		out = ObjData{};
+		std::vector<size_t> vertex_base(chunk_count), normal_base(chunk_count), texcoord_base(chunk_count);
+		size_t vertices = 0, normals = 0, texcoords = 0;
+		for (size_t i = 0; i < chunk_count; i++)
+		{
+			if (!chunks[i].ok)
+			{
+				return false;
+			}
+			vertex_base[i] = vertices / 3;
+			normal_base[i] = normals / 3;
+			texcoord_base[i] = texcoords / 2;
+			vertices += chunks[i].vertices.size();
+			normals += chunks[i].normals.size();
+			texcoords += chunks[i].texcoords.size();
+		}
+		out.vertices.reserve(vertices);
+		out.normals.reserve(normals);
+		out.texcoords.reserve(texcoords);
+		for (ObjChunk& chunk : chunks)
+		{
+			append(out.vertices, chunk.vertices);
+			append(out.normals, chunk.normals);
+			append(out.texcoords, chunk.texcoords);
+		}
+
+		// polygons need every position before they can be split
+		run_parallel(chunk_count, [&](size_t i) {
+			build_indices(chunks[i], vertex_base[i], normal_base[i], texcoord_base[i], out.vertices);
+			});
+
+		size_t index_count = 0;
+		for (ObjChunk& chunk : chunks)
+		{
+			index_count += chunk.indices.size();
+		}
+		out.indices.reserve(index_count);
+		for (ObjChunk& chunk : chunks)
+		{
+			append(out.indices, chunk.indices);
+		}
+		return true;
+	}
+}
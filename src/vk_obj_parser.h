@@ -0,0 +1,37 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// one triangle corner, same meaning as tinyobj::index_t (-1 when absent)
+struct ObjIndex
+{
+	int vertex_index;
+	int normal_index;
+	int texcoord_index;
+};
+
+// The v/vn/vt/f subset of an obj file, laid out like tinyobj::attrib_t with
+// all shapes' triangulated indices concatenated in file order.
+struct ObjData
+{
+	std::vector<float> vertices;
+	std::vector<float> normals;
+	std::vector<float> texcoords;
+	std::vector<ObjIndex> indices;
+};
+
+namespace obj_parser {
+
+	// Chunks smaller than this are not worth a thread of their own.
+	constexpr size_t MIN_CHUNK_BYTES = 64 * 1024;
+
+	// Parse an obj with up to threadCount workers (0 = hardware concurrency).
+	// The result matches tinyobj::LoadObj with triangulation enabled.
+	bool parse(const char* filename, ObjData& out, unsigned threadCount = 0);
+	bool parse(const char* text, size_t size, ObjData& out, unsigned threadCount = 0);
+
+	// Float parser for [s, end), no strtod. It keeps tinyobj's arithmetic so
+	// values are bit identical to the old loader.
+	bool parse_float(const char* s, const char* end, double& result);
+}
@@ -0,0 +1,98 @@
+#include <vk_pipeline_cache.h>
+#include <vk_mapped_file.h>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+void PipelineCache::init(VkDevice device, const VkPhysicalDeviceProperties& properties, const std::string& path)
+{
+	_device = device;
+	_properties = properties;
+	_path = path;
+
+	VkPipelineCacheCreateInfo cache_info = {};
+	cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cache_info.pNext = nullptr;
+
+	MappedFile file;
+	if (file.open(_path) && header_matches(file.data(), file.size()))
+	{
+		cache_info.initialDataSize = file.size();
+		cache_info.pInitialData = file.data();
+		_warm = true;
+		_loadedBytes = file.size();
+	}
+	else if (file.is_open())
+	{
+		std::cout << "Pipeline cache " << _path << " was written by another driver or device, starting cold" << std::endl;
+	}
+
+	// a driver may still refuse data with a matching header, retry empty
+	if (vkCreatePipelineCache(_device, &cache_info, nullptr, &_cache) != VK_SUCCESS && _warm)
+	{
+		_warm = false;
+		_loadedBytes = 0;
+		cache_info.initialDataSize = 0;
+		cache_info.pInitialData = nullptr;
+		VK_CHECK(vkCreatePipelineCache(_device, &cache_info, nullptr, &_cache));
+	}
+}
+
+bool PipelineCache::header_matches(const uint8_t* data, size_t size) const
+{
+	// VkPipelineCacheHeaderVersionOne, read field by field, the file has no alignment guarantees
+	uint32_t headerSize, headerVersion, vendorID, deviceID;
+	uint8_t uuid[VK_UUID_SIZE];
+	if (size < 16 + VK_UUID_SIZE)
+	{
+		return false;
+	}
+	memcpy(&headerSize, data, 4);
+	memcpy(&headerVersion, data + 4, 4);
+	memcpy(&vendorID, data + 8, 4);
+	memcpy(&deviceID, data + 12, 4);
+	memcpy(uuid, data + 16, VK_UUID_SIZE);
+
+	return headerSize >= 16 + VK_UUID_SIZE && headerSize <= size
+		&& headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+		&& vendorID == _properties.vendorID
+		&& deviceID == _properties.deviceID
+		&& memcmp(uuid, _properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+bool PipelineCache::save()
+{
+	if (_cache == VK_NULL_HANDLE)
+	{
+		return false;
+	}
+	size_t size = 0;
+	VK_CHECK(vkGetPipelineCacheData(_device, _cache, &size, nullptr));
+	std::vector<char> blob(size);
+	VK_CHECK(vkGetPipelineCacheData(_device, _cache, &size, blob.data()));
+
+	std::string temp_path = _path + ".tmp";
+	FILE* file = fopen(temp_path.c_str(), "wb");
+	if (!file)
+	{
+		return false;
+	}
+	bool written = fwrite(blob.data(), 1, size, file) == size;
+	written = (fclose(file) == 0) && written;
+	if (!written)
+	{
+		remove(temp_path.c_str());
+		return false;
+	}
+#ifdef _WIN32
+	remove(_path.c_str());
+#endif
+	return rename(temp_path.c_str(), _path.c_str()) == 0;
+}
+
+void PipelineCache::cleanup()
+{
+	vkDestroyPipelineCache(_device, _cache, nullptr);
+	_cache = VK_NULL_HANDLE;
+}
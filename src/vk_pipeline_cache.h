@@ -0,0 +1,30 @@
+#pragma once
+#include <vk_types.h>
+#include <string>
+
+// VkPipelineCache kept on disk between runs.
+// The file is only handed to the driver when its header (vendor, device and
+// pipelineCacheUUID) matches this device, otherwise the cache starts empty
+// and gets replaced on save. Every pipeline build passes cache().
+class PipelineCache {
+public:
+	void init(VkDevice device, const VkPhysicalDeviceProperties& properties, const std::string& path);
+	// writes a temp file and renames it over path, a crash never leaves a torn cache
+	bool save();
+	void cleanup();
+
+	VkPipelineCache cache() const { return _cache; }
+	// true when the file on disk was valid for this device
+	bool warm() const { return _warm; }
+	size_t loaded_bytes() const { return _loadedBytes; }
+
+private:
+	bool header_matches(const uint8_t* data, size_t size) const;
+
+	VkDevice _device{ VK_NULL_HANDLE };
+	VkPipelineCache _cache{ VK_NULL_HANDLE };
+	VkPhysicalDeviceProperties _properties{};
+	std::string _path;
+	bool _warm{ false };
+	size_t _loadedBytes{ 0 };
+};
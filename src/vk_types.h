@@ -5,6 +5,18 @@
 #include <vulkan/vulkan.h>
 #include "vk_mem_alloc.h"
 #include <vk_mesh.h>
+#include <iostream>
+
+#define VK_CHECK(x)												\
+	do															\
+	{															\
+		VkResult err = x;										\
+		if (err)												\
+		{														\
+			std::cout << "Detect Vulkan Error: " << err << std::endl;	\
+			abort();											\
+		}														\
+	}while(0)
 
 struct AllocatedImage {
 	VkImage _image;
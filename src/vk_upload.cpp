@@ -0,0 +1,343 @@
+#include <vk_upload.h>
+#include <vk_initializers.h>
+#include <algorithm>
+#include <cstring>
+
+void UploadManager::init(VkDevice device, VmaAllocator allocator,
+	VkQueue transferQueue, uint32_t transferFamily,
+	uint32_t graphicsFamily, VkDeviceSize ringSize)
+{
+	_device = device;
+	_allocator = allocator;
+	_queue = transferQueue;
+	_transferFamily = transferFamily;
+	_graphicsFamily = graphicsFamily;
+	_families[0] = graphicsFamily;
+	_families[1] = transferFamily;
+
+	VkSemaphoreTypeCreateInfo type_info = {};
+	type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	type_info.initialValue = 0;
+	VkSemaphoreCreateInfo sem_info = vkinit::semaphore_create_info();
+	sem_info.pNext = &type_info;
+	VK_CHECK(vkCreateSemaphore(_device, &sem_info, nullptr, &_timeline));
+
+	VkBufferCreateInfo ring_info = vkinit::buffer_create_info(
+										VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+										VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+										ringSize
+									);
+	VmaAllocationCreateInfo vmaalloc_info = {};
+	vmaalloc_info.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+	vmaalloc_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+	VmaAllocationInfo allocation_info;
+	VK_CHECK(vmaCreateBuffer(_allocator, &ring_info, &vmaalloc_info,
+		&_ring._buffer, &_ring._allocation, &allocation_info));
+	_ringData = static_cast<char*>(allocation_info.pMappedData);
+	_ringSize = ringSize;
+}
+
+void UploadManager::cleanup()
+{
+	if (_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	wait(flush());
+	for (Batch& batch : _freeBatches)
+	{
+		vkDestroyCommandPool(_device, batch.pool, nullptr);
+	}
+	_freeBatches.clear();
+	vkDestroySemaphore(_device, _timeline, nullptr);
+	vmaDestroyBuffer(_allocator, _ring._buffer, _ring._allocation);
+	_device = VK_NULL_HANDLE;
+}
+
+UploadManager::Batch& UploadManager::recording()
+{
+	if (_recording)
+	{
+		return _open;
+	}
+	if (!_freeBatches.empty())
+	{
+		_open = std::move(_freeBatches.back());
+		_freeBatches.pop_back();
+		VK_CHECK(vkResetCommandPool(_device, _open.pool, 0));
+	}
+	else
+	{
+		_open = Batch{};
+		VkCommandPoolCreateInfo pool_info = vkinit::command_pool_create_info(
+											_transferFamily, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+		VK_CHECK(vkCreateCommandPool(_device, &pool_info, nullptr, &_open.pool));
+		VkCommandBufferAllocateInfo cmd_info = vkinit::command_buffer_allocate_info(_open.pool, 1);
+		VK_CHECK(vkAllocateCommandBuffers(_device, &cmd_info, &_open.cmd));
+	}
+	VkCommandBufferBeginInfo begin_info = vkinit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+	VK_CHECK(vkBeginCommandBuffer(_open.cmd, &begin_info));
+	_recording = true;
+	return _open;
+}
+
+bool UploadManager::ring_alloc(VkDeviceSize size, VkDeviceSize alignment, uint64_t& position)
+{
+	if (size > _ringSize)
+	{
+		return false;
+	}
+	uint64_t start = (_ringHead + alignment - 1) / alignment * alignment;
+	uint64_t physical = start % _ringSize;
+	if (physical + size > _ringSize)
+	{
+		// never split an allocation over the end, skip to the next lap
+		start += _ringSize - physical;
+	}
+	if (start + size - _ringTail > _ringSize)
+	{
+		return false;
+	}
+	_ringHead = start + size;
+	position = start;
+	return true;
+}
+
+StagingRegion UploadManager::stage(VkDeviceSize size, VkDeviceSize alignment)
+{
+	Batch& batch = recording();
+	StagingRegion region;
+	region.size = size;
+
+	uint64_t position;
+	bool fits = ring_alloc(size, alignment, position);
+	if (!fits)
+	{
+		collect();
+		fits = ring_alloc(size, alignment, position);
+	}
+
+	if (fits)
+	{
+		region.buffer = _ring._buffer;
+		region.offset = position % _ringSize;
+		region.data = _ringData + region.offset;
+	}
+	else
+	{
+		// ring exhausted by uploads still in flight, spill instead of waiting on them
+		VkBufferCreateInfo staging_info = vkinit::buffer_create_info(
+											VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+											VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+											size
+										);
+		VmaAllocationCreateInfo vmaalloc_info = {};
+		vmaalloc_info.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+		vmaalloc_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+		AllocatedBuffer staging;
+		VmaAllocationInfo allocation_info;
+		VK_CHECK(vmaCreateBuffer(_allocator, &staging_info, &vmaalloc_info,
+			&staging._buffer, &staging._allocation, &allocation_info));
+		batch.dedicated.push_back(staging);
+
+		region.buffer = staging._buffer;
+		region.offset = 0;
+		region.data = static_cast<char*>(allocation_info.pMappedData);
+	}
+	batch.bytes += size;
+	return region;
+}
+
+void UploadManager::copy_buffer(const StagingRegion& src, VkDeviceSize srcOffset,
+	VkBuffer dst, VkDeviceSize dstOffset, VkDeviceSize size)
+{
+	VkBufferCopy copy;
+	copy.srcOffset = src.offset + srcOffset;
+	copy.dstOffset = dstOffset;
+	copy.size = size;
+	vkCmdCopyBuffer(recording().cmd, src.buffer, dst, 1, &copy);
+}
+
+void UploadManager::copy_image(const StagingRegion& src, VkImage image,
+	const VkBufferImageCopy* regions, uint32_t regionCount, uint32_t mipLevels)
+{
+	VkCommandBuffer cmd = recording().cmd;
+
+	VkImageSubresourceRange range;
+	range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	range.baseMipLevel = 0;
+	range.levelCount = mipLevels;
+	range.baseArrayLayer = 0;
+	range.layerCount = 1;
+
+	VkImageMemoryBarrier imageBarrier_toTransfer = {};
+	imageBarrier_toTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	imageBarrier_toTransfer.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageBarrier_toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	imageBarrier_toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageBarrier_toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageBarrier_toTransfer.image = image;
+	imageBarrier_toTransfer.subresourceRange = range;
+	imageBarrier_toTransfer.srcAccessMask = 0;
+	imageBarrier_toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	//barrier the image into the transfer-receive layout
+	vkCmdPipelineBarrier(cmd,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 0, nullptr, 0, nullptr, 1,
+		&imageBarrier_toTransfer);
+
+	std::vector<VkBufferImageCopy> copies(regions, regions + regionCount);
+	for (VkBufferImageCopy& copy : copies)
+	{
+		copy.bufferOffset += src.offset;
+	}
+	vkCmdCopyBufferToImage(cmd, src.buffer, image,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		static_cast<uint32_t>(copies.size()), copies.data());
+
+	VkImageMemoryBarrier imageBarrier_toReadable = imageBarrier_toTransfer;
+	imageBarrier_toReadable.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	imageBarrier_toReadable.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageBarrier_toReadable.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	// a transfer only queue can not name the fragment stage, there the
+	// timeline wait of the graphics submit makes the copy visible
+	VkPipelineStageFlags dstStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	imageBarrier_toReadable.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	if (dedicated_transfer())
+	{
+		dstStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		imageBarrier_toReadable.dstAccessMask = 0;
+	}
+
+	//barrier the image into the shader readable layout
+	vkCmdPipelineBarrier(cmd,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		dstStage,
+		0, 0, nullptr, 0, nullptr, 1,
+		&imageBarrier_toReadable);
+}
+
+UploadToken UploadManager::upload_buffer(VkBuffer dst, const void* data, VkDeviceSize size)
+{
+	StagingRegion region = stage(size);
+	memcpy(region.data, data, static_cast<size_t>(size));
+	copy_buffer(region, 0, dst, 0, size);
+	return token();
+}
+
+UploadToken UploadManager::token() const
+{
+	UploadToken token;
+	token.value = _submittedValue + (_recording ? 1 : 0);
+	return token;
+}
+
+UploadToken UploadManager::flush()
+{
+	if (!_recording)
+	{
+		return token();
+	}
+	VK_CHECK(vkEndCommandBuffer(_open.cmd));
+
+	uint64_t value = _submittedValue + 1;
+	VkTimelineSemaphoreSubmitInfo timeline_info = {};
+	timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timeline_info.signalSemaphoreValueCount = 1;
+	timeline_info.pSignalSemaphoreValues = &value;
+
+	VkSubmitInfo submit = vkinit::submit_info(&_open.cmd, nullptr, nullptr, 0, &_timeline, 1);
+	submit.pNext = &timeline_info;
+	VK_CHECK(vkQueueSubmit(_queue, 1, &submit, VK_NULL_HANDLE));
+
+	_submittedValue = value;
+	_open.value = value;
+	_open.ringHead = _ringHead;
+	_bytesInFlight += _open.bytes;
+	_bytesUploaded += _open.bytes;
+	_inFlight.push_back(std::move(_open));
+	_open = Batch{};
+	_recording = false;
+	return token();
+}
+
+bool UploadManager::is_complete(UploadToken token)
+{
+	if (token.value <= _completedValue)
+	{
+		return true;
+	}
+	VK_CHECK(vkGetSemaphoreCounterValue(_device, _timeline, &_completedValue));
+	return token.value <= _completedValue;
+}
+
+void UploadManager::wait(UploadToken token)
+{
+	if (token.value > _submittedValue)
+	{
+		flush();
+	}
+	if (!is_complete(token))
+	{
+		VkSemaphoreWaitInfo wait_info = {};
+		wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		wait_info.semaphoreCount = 1;
+		wait_info.pSemaphores = &_timeline;
+		wait_info.pValues = &token.value;
+		VK_CHECK(vkWaitSemaphores(_device, &wait_info, UINT64_MAX));
+		_completedValue = std::max(_completedValue, token.value);
+	}
+	collect();
+}
+
+void UploadManager::collect()
+{
+	if (_inFlight.empty())
+	{
+		return;
+	}
+	VK_CHECK(vkGetSemaphoreCounterValue(_device, _timeline, &_completedValue));
+	while (!_inFlight.empty() && _inFlight.front().value <= _completedValue)
+	{
+		retire(_inFlight.front());
+		_freeBatches.push_back(std::move(_inFlight.front()));
+		_inFlight.pop_front();
+	}
+}
+
+void UploadManager::retire(Batch& batch)
+{
+	// batches finish in submit order, so the tail only moves forward
+	_ringTail = batch.ringHead;
+	for (AllocatedBuffer& staging : batch.dedicated)
+	{
+		vmaDestroyBuffer(_allocator, staging._buffer, staging._allocation);
+	}
+	batch.dedicated.clear();
+	_bytesInFlight -= batch.bytes;
+	batch.bytes = 0;
+}
+
+void UploadManager::share(VkBufferCreateInfo& info) const
+{
+	if (dedicated_transfer())
+	{
+		info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		info.queueFamilyIndexCount = 2;
+		info.pQueueFamilyIndices = _families;
+	}
+}
+
+void UploadManager::share(VkImageCreateInfo& info) const
+{
+	if (dedicated_transfer())
+	{
+		info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		info.queueFamilyIndexCount = 2;
+		info.pQueueFamilyIndices = _families;
+	}
+}
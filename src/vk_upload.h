@@ -0,0 +1,102 @@
+#pragma once
+#include <vk_types.h>
+#include <deque>
+#include <vector>
+
+// staging memory handed out by UploadManager::stage, valid until the next flush
+struct StagingRegion {
+	VkBuffer buffer{ VK_NULL_HANDLE };
+	VkDeviceSize offset{ 0 };
+	char* data{ nullptr };
+	VkDeviceSize size{ 0 };
+};
+
+// Asynchronous uploads on the transfer queue.
+// Copies are recorded into an open batch that flush() submits with a timeline
+// semaphore signal, callers keep the returned UploadToken and poll it with
+// is_complete. Staging data goes to a persistently mapped ring buffer, a batch
+// that does not fit the ring gets a dedicated staging buffer instead of waiting
+// for older uploads. Only the main thread records or flushes.
+class UploadManager {
+public:
+	void init(VkDevice device, VmaAllocator allocator,
+		VkQueue transferQueue, uint32_t transferFamily,
+		uint32_t graphicsFamily, VkDeviceSize ringSize);
+	void cleanup();
+
+	// size bytes of mapped staging memory in the open batch
+	StagingRegion stage(VkDeviceSize size, VkDeviceSize alignment = 16);
+
+	void copy_buffer(const StagingRegion& src, VkDeviceSize srcOffset,
+		VkBuffer dst, VkDeviceSize dstOffset, VkDeviceSize size);
+	// regions[].bufferOffset is relative to src, the image ends up in
+	// SHADER_READ_ONLY_OPTIMAL for every mip level
+	void copy_image(const StagingRegion& src, VkImage image,
+		const VkBufferImageCopy* regions, uint32_t regionCount, uint32_t mipLevels = 1);
+	// stage + copy_buffer in one go
+	UploadToken upload_buffer(VkBuffer dst, const void* data, VkDeviceSize size);
+
+	// token signaled once everything recorded so far reached the gpu
+	UploadToken token() const;
+	// submit the open batch, no-op when nothing was recorded
+	UploadToken flush();
+	bool is_complete(UploadToken token);
+	// blocking wait, meant for startup and tools, never for the render loop
+	void wait(UploadToken token);
+	// release the ring space and staging buffers of finished batches
+	void collect();
+
+	// resources written by the transfer queue and read by graphics need
+	// concurrent sharing when the families differ
+	void share(VkBufferCreateInfo& info) const;
+	void share(VkImageCreateInfo& info) const;
+
+	VkSemaphore timeline() const { return _timeline; }
+	// highest value observed as signaled, a graphics submit can wait on it for free
+	uint64_t completed_value() const { return _completedValue; }
+	bool dedicated_transfer() const { return _transferFamily != _graphicsFamily; }
+
+	size_t bytes_in_flight() const { return _bytesInFlight; }
+	size_t bytes_uploaded() const { return _bytesUploaded; }
+
+private:
+	struct Batch {
+		VkCommandPool pool{ VK_NULL_HANDLE };
+		VkCommandBuffer cmd{ VK_NULL_HANDLE };
+		uint64_t value{ 0 };
+		// ring head at submit time, everything before it is free once value signals
+		uint64_t ringHead{ 0 };
+		size_t bytes{ 0 };
+		std::vector<AllocatedBuffer> dedicated;
+	};
+
+	Batch& recording();
+	bool ring_alloc(VkDeviceSize size, VkDeviceSize alignment, uint64_t& position);
+	void retire(Batch& batch);
+
+	VkDevice _device{ VK_NULL_HANDLE };
+	VmaAllocator _allocator{ VK_NULL_HANDLE };
+	VkQueue _queue{ VK_NULL_HANDLE };
+	uint32_t _transferFamily{ 0 };
+	uint32_t _graphicsFamily{ 0 };
+	uint32_t _families[2]{};
+
+	VkSemaphore _timeline{ VK_NULL_HANDLE };
+	uint64_t _submittedValue{ 0 };
+	uint64_t _completedValue{ 0 };
+
+	AllocatedBuffer _ring{};
+	char* _ringData{ nullptr };
+	VkDeviceSize _ringSize{ 0 };
+	// monotonic positions, the physical offset is position % _ringSize
+	uint64_t _ringHead{ 0 };
+	uint64_t _ringTail{ 0 };
+
+	bool _recording{ false };
+	Batch _open;
+	std::deque<Batch> _inFlight;
+	std::vector<Batch> _freeBatches;
+
+	size_t _bytesInFlight{ 0 };
+	size_t _bytesUploaded{ 0 };
+};
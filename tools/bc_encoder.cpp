@@ -0,0 +1,893 @@
+#include "bc_encoder.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+	// principal axis of the texels in mask through power iteration on the covariance,
+	// channels is 3 (rgb) or 4 (rgba)
+	void principal_axis(const uint8_t* texels, uint32_t mask, int channels, float* mean, float* axis)
+	{
+		int count = 0;
+		for (int c = 0; c < channels; c++)
+		{
+			mean[c] = 0.f;
+		}
+		for (int i = 0; i < 16; i++)
+		{
+			if (mask & (1u << i))
+			{
+				count++;
+				for (int c = 0; c < channels; c++)
+				{
+					mean[c] += texels[i * 4 + c];
+				}
+			}
+		}
+		for (int c = 0; c < channels; c++)
+		{
+			mean[c] /= std::max(count, 1);
+		}
+
+		float cov[4][4] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			if (!(mask & (1u << i)))
+			{
+				continue;
+			}
+			float d[4];
+			for (int c = 0; c < channels; c++)
+			{
+				d[c] = texels[i * 4 + c] - mean[c];
+			}
+			for (int a = 0; a < channels; a++)
+			{
+				for (int b = 0; b < channels; b++)
+				{
+					cov[a][b] += d[a] * d[b];
+				}
+			}
+		}
+
+		for (int c = 0; c < channels; c++)
+		{
+			axis[c] = 1.f;
+		}
+		for (int iteration = 0; iteration < 8; iteration++)
+		{
+			float next[4] = {};
+			for (int a = 0; a < channels; a++)
+			{
+				for (int b = 0; b < channels; b++)
+				{
+					next[a] += cov[a][b] * axis[b];
+				}
+			}
+			float length = 0.f;
+			for (int c = 0; c < channels; c++)
+			{
+				length += next[c] * next[c];
+			}
+			if (length < 1e-8f)
+			{
+				// flat block, any axis does
+				break;
+			}
+			length = std::sqrt(length);
+			for (int c = 0; c < channels; c++)
+			{
+				axis[c] = next[c] / length;
+			}
+		}
+	}
+
+	// the two ends of the texels in mask along their principal axis
+	void fit_endpoints(const uint8_t* texels, int channels, float* low, float* high, uint32_t mask = 0xFFFF)
+	{
+		float mean[4];
+		float axis[4];
+		principal_axis(texels, mask, channels, mean, axis);
+
+		float tMin = 0.f;
+		float tMax = 0.f;
+		for (int i = 0; i < 16; i++)
+		{
+			if (!(mask & (1u << i)))
+			{
+				continue;
+			}
+			float t = 0.f;
+			for (int c = 0; c < channels; c++)
+			{
+				t += (texels[i * 4 + c] - mean[c]) * axis[c];
+			}
+			tMin = std::min(tMin, t);
+			tMax = std::max(tMax, t);
+		}
+		for (int c = 0; c < channels; c++)
+		{
+			low[c] = std::clamp(mean[c] + axis[c] * tMin, 0.f, 255.f);
+			high[c] = std::clamp(mean[c] + axis[c] * tMax, 0.f, 255.f);
+		}
+	}
+
+	uint16_t pack_565(const float* color)
+	{
+		uint32_t r = static_cast<uint32_t>(color[0] * 31.f / 255.f + 0.5f);
+		uint32_t g = static_cast<uint32_t>(color[1] * 63.f / 255.f + 0.5f);
+		uint32_t b = static_cast<uint32_t>(color[2] * 31.f / 255.f + 0.5f);
+		return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+	}
+
+	void unpack_565(uint16_t packed, int* color)
+	{
+		int r = (packed >> 11) & 31;
+		int g = (packed >> 5) & 63;
+		int b = packed & 31;
+		color[0] = (r << 3) | (r >> 2);
+		color[1] = (g << 2) | (g >> 4);
+		color[2] = (b << 3) | (b >> 2);
+	}
+
+	int distance2(const uint8_t* texel, const int* color, int channels)
+	{
+		int sum = 0;
+		for (int c = 0; c < channels; c++)
+		{
+			int d = texel[c] - color[c];
+			sum += d * d;
+		}
+		return sum;
+	}
+
+	// always four color mode, BC3 color blocks ignore the endpoint order anyway
+	void encode_color_block(const uint8_t* texels, uint8_t* out)
+	{
+		float low[4];
+		float high[4];
+		fit_endpoints(texels, 3, low, high);
+		uint16_t c0 = pack_565(high);
+		uint16_t c1 = pack_565(low);
+		if (c0 < c1)
+		{
+			std::swap(c0, c1);
+		}
+
+		uint32_t indices = 0;
+		if (c0 != c1)
+		{
+			int palette[4][3];
+			unpack_565(c0, palette[0]);
+			unpack_565(c1, palette[1]);
+			for (int c = 0; c < 3; c++)
+			{
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+			for (int i = 0; i < 16; i++)
+			{
+				uint32_t best = 0;
+				int bestError = distance2(texels + i * 4, palette[0], 3);
+				for (uint32_t p = 1; p < 4; p++)
+				{
+					int error = distance2(texels + i * 4, palette[p], 3);
+					if (error < bestError)
+					{
+						best = p;
+						bestError = error;
+					}
+				}
+				indices |= best << (i * 2);
+			}
+		}
+
+		memcpy(out, &c0, 2);
+		memcpy(out + 2, &c1, 2);
+		memcpy(out + 4, &indices, 4);
+	}
+
+	void encode_alpha_block(const uint8_t* texels, uint8_t* out)
+	{
+		int a0 = 0;
+		int a1 = 255;
+		for (int i = 0; i < 16; i++)
+		{
+			a0 = std::max<int>(a0, texels[i * 4 + 3]);
+			a1 = std::min<int>(a1, texels[i * 4 + 3]);
+		}
+
+		uint64_t indices = 0;
+		if (a0 != a1)
+		{
+			// a0 > a1 selects the eight value ramp
+			int palette[8];
+			palette[0] = a0;
+			palette[1] = a1;
+			for (int i = 1; i < 7; i++)
+			{
+				palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+			}
+			for (int i = 0; i < 16; i++)
+			{
+				uint64_t best = 0;
+				int bestError = 256;
+				for (int p = 0; p < 8; p++)
+				{
+					int error = std::abs(texels[i * 4 + 3] - palette[p]);
+					if (error < bestError)
+					{
+						best = p;
+						bestError = error;
+					}
+				}
+				indices |= best << (i * 3);
+			}
+		}
+
+		out[0] = static_cast<uint8_t>(a0);
+		out[1] = static_cast<uint8_t>(a1);
+		for (int b = 0; b < 6; b++)
+		{
+			out[2 + b] = static_cast<uint8_t>(indices >> (b * 8));
+		}
+	}
+
+	// little endian bit stream, BC7 fields are written lsb first
+	struct BitWriter {
+		uint8_t* out;
+		uint32_t bit{ 0 };
+
+		void put(uint32_t value, uint32_t count)
+		{
+			for (uint32_t i = 0; i < count; i++, bit++)
+			{
+				if (value & (1u << i))
+				{
+					out[bit / 8] |= static_cast<uint8_t>(1u << (bit % 8));
+				}
+			}
+		}
+	};
+
+	const int BC7_WEIGHTS2[4] = { 0, 21, 43, 64 };
+	const int BC7_WEIGHTS3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+	const int BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// two subset partitions, bit i set when texel i belongs to subset 1
+	const uint16_t BC7_PARTITIONS2[64] = {
+		0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80,
+		0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+		0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE,
+		0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+		0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A,
+		0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+		0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C,
+		0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22
+	};
+	// first texel of subset 1, its index msb is implicit 0 like texel 0 of subset 0
+	const uint8_t BC7_ANCHORS2[64] = {
+		15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+		15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+		15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+		6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15
+	};
+
+	// the single index set modes, endpoints are colorBits (alphaBits) plus a p-bit
+	struct Bc7Mode {
+		uint32_t mode;
+		uint32_t subsets;
+		uint32_t colorBits;
+		// 0: opaque, alpha decodes as 255
+		uint32_t alphaBits;
+		// one p-bit per subset instead of one per endpoint
+		bool sharedPbit;
+		uint32_t indexBits;
+	};
+	const Bc7Mode BC7_MODE1 = { 1, 2, 6, 0, true, 3 };
+	const Bc7Mode BC7_MODE3 = { 3, 2, 7, 0, false, 2 };
+	const Bc7Mode BC7_MODE6 = { 6, 1, 7, 7, false, 4 };
+	const Bc7Mode BC7_MODE7 = { 7, 2, 5, 5, false, 2 };
+
+	// partitions whose estimate gets a full encode
+	constexpr int BC7_PARTITION_CANDIDATES = 2;
+	// squared error of mode 6 below which the partitioned modes are not tried
+	constexpr int BC7_PARTITION_THRESHOLD = 16 * 4 * 4;
+
+	struct Bc7Block {
+		uint32_t partition{ 0 };
+		// [subset][endpoint][channel]
+		uint32_t q[2][2][4];
+		uint32_t pbit[2][2];
+		uint32_t indices[16];
+		int error{ 0 };
+	};
+
+	uint32_t subset_mask(const Bc7Mode& mode, uint32_t partition, uint32_t subset)
+	{
+		if (mode.subsets == 1)
+		{
+			return 0xFFFF;
+		}
+		return subset == 1 ? BC7_PARTITIONS2[partition] : 0xFFFFu & ~BC7_PARTITIONS2[partition];
+	}
+
+	const int* bc7_weights(uint32_t indexBits)
+	{
+		return indexBits == 2 ? BC7_WEIGHTS2 : (indexBits == 3 ? BC7_WEIGHTS3 : BC7_WEIGHTS4);
+	}
+
+	// an n bit endpoint expanded to 8 bits by repeating its top bits
+	int bc7_expand(uint32_t v, uint32_t n)
+	{
+		return static_cast<int>((v << (8 - n)) | (v >> (2 * n - 8)));
+	}
+
+	// bits + p-bit
+	int bc7_unquantize(uint32_t q, uint32_t pbit, uint32_t bits)
+	{
+		return bc7_expand((q << 1) | pbit, bits + 1);
+	}
+
+	uint32_t bc7_quantize(float value, uint32_t pbit, uint32_t bits)
+	{
+		int guess = static_cast<int>(std::round((value * ((1 << (bits + 1)) - 1) / 255.f - pbit) / 2.f));
+		uint32_t best = 0;
+		float bestError = 1e9f;
+		for (int q = guess - 1; q <= guess + 1; q++)
+		{
+			if (q < 0 || q >= (1 << bits))
+			{
+				continue;
+			}
+			float error = std::abs(value - bc7_unquantize(q, pbit, bits));
+			if (error < bestError)
+			{
+				best = static_cast<uint32_t>(q);
+				bestError = error;
+			}
+		}
+		return best;
+	}
+
+	void bc7_endpoint_color(const Bc7Mode& mode, const uint32_t* q, uint32_t pbit, int* color)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			color[c] = bc7_unquantize(q[c], pbit, mode.colorBits);
+		}
+		color[3] = mode.alphaBits ? bc7_unquantize(q[3], pbit, mode.alphaBits) : 255;
+	}
+
+	// picks q and p-bits for one subset, the p-bit with the smaller endpoint error wins
+	void bc7_quantize_endpoints(const Bc7Mode& mode, const float (*endpoints)[4], uint32_t (*q)[4], uint32_t* pbit)
+	{
+		int channels = mode.alphaBits ? 4 : 3;
+		auto endpoint_error = [&](int e, uint32_t p, uint32_t* candidate) {
+			float error = 0.f;
+			for (int c = 0; c < channels; c++)
+			{
+				uint32_t bits = c < 3 ? mode.colorBits : mode.alphaBits;
+				candidate[c] = bc7_quantize(endpoints[e][c], p, bits);
+				float d = endpoints[e][c] - bc7_unquantize(candidate[c], p, bits);
+				error += d * d;
+			}
+			return error;
+		};
+		float bestError = 1e30f;
+		for (uint32_t p0 = 0; p0 < 2; p0++)
+		{
+			for (uint32_t p1 = 0; p1 < 2; p1++)
+			{
+				if (mode.sharedPbit && p0 != p1)
+				{
+					continue;
+				}
+				uint32_t candidate[2][4] = {};
+				float error = endpoint_error(0, p0, candidate[0]) + endpoint_error(1, p1, candidate[1]);
+				if (error < bestError)
+				{
+					bestError = error;
+					pbit[0] = p0;
+					pbit[1] = p1;
+					memcpy(q, candidate, sizeof(candidate));
+				}
+			}
+		}
+	}
+
+	// nearest palette entry for every texel of the subset, returns the squared error
+	int bc7_assign_indices(const Bc7Mode& mode, const uint8_t* texels, uint32_t mask,
+		const uint32_t (*q)[4], const uint32_t* pbit, uint32_t* indices)
+	{
+		int endpoint[2][4];
+		bc7_endpoint_color(mode, q[0], pbit[0], endpoint[0]);
+		bc7_endpoint_color(mode, q[1], pbit[1], endpoint[1]);
+		const int* weights = bc7_weights(mode.indexBits);
+		uint32_t count = 1u << mode.indexBits;
+		int palette[16][4];
+		for (uint32_t i = 0; i < count; i++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				palette[i][c] = ((64 - weights[i]) * endpoint[0][c] + weights[i] * endpoint[1][c] + 32) >> 6;
+			}
+		}
+
+		int total = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			if (!(mask & (1u << i)))
+			{
+				continue;
+			}
+			indices[i] = 0;
+			int bestError = distance2(texels + i * 4, palette[0], 4);
+			for (uint32_t p = 1; p < count; p++)
+			{
+				int error = distance2(texels + i * 4, palette[p], 4);
+				if (error < bestError)
+				{
+					indices[i] = p;
+					bestError = error;
+				}
+			}
+			total += bestError;
+		}
+		return total;
+	}
+
+	// least squares endpoints for the weights the indices pick, false when
+	// every texel sits on the same weight
+	bool bc7_refit(const Bc7Mode& mode, const uint8_t* texels, uint32_t mask, const uint32_t* indices, float (*endpoints)[4])
+	{
+		const int* weights = bc7_weights(mode.indexBits);
+		float aa = 0.f;
+		float ab = 0.f;
+		float bb = 0.f;
+		float ax[4] = {};
+		float bx[4] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			if (!(mask & (1u << i)))
+			{
+				continue;
+			}
+			float b = weights[indices[i]] / 64.f;
+			float a = 1.f - b;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (int c = 0; c < 4; c++)
+			{
+				ax[c] += a * texels[i * 4 + c];
+				bx[c] += b * texels[i * 4 + c];
+			}
+		}
+		float det = aa * bb - ab * ab;
+		if (std::abs(det) < 1e-6f)
+		{
+			return false;
+		}
+		for (int c = 0; c < 4; c++)
+		{
+			endpoints[0][c] = std::clamp((ax[c] * bb - bx[c] * ab) / det, 0.f, 255.f);
+			endpoints[1][c] = std::clamp((bx[c] * aa - ax[c] * ab) / det, 0.f, 255.f);
+		}
+		return true;
+	}
+
+	void bc7_encode_mode(const Bc7Mode& mode, const uint8_t* texels, uint32_t partition, Bc7Block& block)
+	{
+		block.partition = partition;
+		block.error = 0;
+		int channels = mode.alphaBits ? 4 : 3;
+		for (uint32_t s = 0; s < mode.subsets; s++)
+		{
+			uint32_t mask = subset_mask(mode, partition, s);
+			float endpoints[2][4] = {};
+			fit_endpoints(texels, channels, endpoints[0], endpoints[1], mask);
+			if (!mode.alphaBits)
+			{
+				endpoints[0][3] = endpoints[1][3] = 255.f;
+			}
+			bc7_quantize_endpoints(mode, endpoints, block.q[s], block.pbit[s]);
+			int error = bc7_assign_indices(mode, texels, mask, block.q[s], block.pbit[s], block.indices);
+
+			// one least squares pass on the chosen indices, kept when it helps
+			Bc7Block refined = block;
+			if (bc7_refit(mode, texels, mask, block.indices, endpoints))
+			{
+				bc7_quantize_endpoints(mode, endpoints, refined.q[s], refined.pbit[s]);
+				int refinedError = bc7_assign_indices(mode, texels, mask, refined.q[s], refined.pbit[s], refined.indices);
+				if (refinedError < error)
+				{
+					memcpy(block.q[s], refined.q[s], sizeof(block.q[s]));
+					memcpy(block.pbit[s], refined.pbit[s], sizeof(block.pbit[s]));
+					memcpy(block.indices, refined.indices, sizeof(block.indices));
+					error = refinedError;
+				}
+			}
+			block.error += error;
+		}
+	}
+
+	// residual of the texels in mask off their principal axis, a cheap stand-in for
+	// the error a subset encodes with
+	float bc7_line_error(const uint8_t* texels, uint32_t mask, int channels)
+	{
+		float mean[4];
+		float axis[4];
+		principal_axis(texels, mask, channels, mean, axis);
+		float error = 0.f;
+		for (int i = 0; i < 16; i++)
+		{
+			if (!(mask & (1u << i)))
+			{
+				continue;
+			}
+			float d[4];
+			float t = 0.f;
+			for (int c = 0; c < channels; c++)
+			{
+				d[c] = texels[i * 4 + c] - mean[c];
+				t += d[c] * axis[c];
+			}
+			for (int c = 0; c < channels; c++)
+			{
+				float r = d[c] - t * axis[c];
+				error += r * r;
+			}
+		}
+		return error;
+	}
+
+	// one channel set of mode 5: endpoints of n bits without p-bit and 2 bit indices,
+	// channels first .. first + count of the texels. Returns the squared error.
+	int bc7_encode_mode5_part(const uint8_t* texels, int first, int count, uint32_t n,
+		const float (*endpoints)[4], uint32_t (*q)[4], uint32_t* indices)
+	{
+		int endpoint[2][4] = {};
+		for (int e = 0; e < 2; e++)
+		{
+			for (int c = first; c < first + count; c++)
+			{
+				float scaled = endpoints[e][c] * ((1 << n) - 1) / 255.f;
+				q[e][c] = static_cast<uint32_t>(std::clamp(std::round(scaled), 0.f, float((1 << n) - 1)));
+				endpoint[e][c] = bc7_expand(q[e][c], n);
+			}
+		}
+		int total = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			int bestError = 0;
+			for (uint32_t p = 0; p < 4; p++)
+			{
+				int error = 0;
+				for (int c = first; c < first + count; c++)
+				{
+					int value = ((64 - BC7_WEIGHTS2[p]) * endpoint[0][c] + BC7_WEIGHTS2[p] * endpoint[1][c] + 32) >> 6;
+					error += (texels[i * 4 + c] - value) * (texels[i * 4 + c] - value);
+				}
+				if (p == 0 || error < bestError)
+				{
+					indices[i] = p;
+					bestError = error;
+				}
+			}
+			total += bestError;
+		}
+		return total;
+	}
+
+	// mode 5: rgb 7.7.7 and alpha 8 endpoints with their own 2 bit indices, no
+	// rotation. Alpha that does not follow the color line (cutouts) costs nothing
+	// here, unlike in modes 6 and 7. Returns the squared error.
+	int bc7_encode_mode5(const uint8_t* texels, uint8_t* out)
+	{
+		uint32_t q[2][4] = {};
+		uint32_t indices[2][16];
+		int error = 0;
+		// color then alpha, both fitted, then refined once by least squares
+		const int firsts[2] = { 0, 3 };
+		const int counts[2] = { 3, 1 };
+		const uint32_t bits[2] = { 7, 8 };
+		for (int part = 0; part < 2; part++)
+		{
+			float endpoints[2][4] = {};
+			if (part == 0)
+			{
+				fit_endpoints(texels, 3, endpoints[0], endpoints[1]);
+			}
+			else
+			{
+				endpoints[0][3] = 255.f;
+				endpoints[1][3] = 0.f;
+				for (int i = 0; i < 16; i++)
+				{
+					endpoints[0][3] = std::min<float>(endpoints[0][3], texels[i * 4 + 3]);
+					endpoints[1][3] = std::max<float>(endpoints[1][3], texels[i * 4 + 3]);
+				}
+			}
+			int partError = bc7_encode_mode5_part(texels, firsts[part], counts[part], bits[part], endpoints, q, indices[part]);
+
+			// same least squares as bc7_refit, on 2 bit weights
+			float aa = 0.f, ab = 0.f, bb = 0.f;
+			float ax[4] = {}, bx[4] = {};
+			for (int i = 0; i < 16; i++)
+			{
+				float b = BC7_WEIGHTS2[indices[part][i]] / 64.f;
+				float a = 1.f - b;
+				aa += a * a;
+				ab += a * b;
+				bb += b * b;
+				for (int c = firsts[part]; c < firsts[part] + counts[part]; c++)
+				{
+					ax[c] += a * texels[i * 4 + c];
+					bx[c] += b * texels[i * 4 + c];
+				}
+			}
+			float det = aa * bb - ab * ab;
+			if (std::abs(det) > 1e-6f)
+			{
+				float refined[2][4] = {};
+				for (int c = firsts[part]; c < firsts[part] + counts[part]; c++)
+				{
+					refined[0][c] = std::clamp((ax[c] * bb - bx[c] * ab) / det, 0.f, 255.f);
+					refined[1][c] = std::clamp((bx[c] * aa - ax[c] * ab) / det, 0.f, 255.f);
+				}
+				uint32_t refinedQ[2][4];
+				memcpy(refinedQ, q, sizeof(q));
+				uint32_t refinedIndices[16];
+				int refinedError = bc7_encode_mode5_part(texels, firsts[part], counts[part], bits[part],
+					refined, refinedQ, refinedIndices);
+				if (refinedError < partError)
+				{
+					memcpy(q, refinedQ, sizeof(q));
+					memcpy(indices[part], refinedIndices, sizeof(refinedIndices));
+					partError = refinedError;
+				}
+			}
+			error += partError;
+
+			// texel 0 is the anchor of both index sets
+			if (indices[part][0] & 2)
+			{
+				for (int c = firsts[part]; c < firsts[part] + counts[part]; c++)
+				{
+					std::swap(q[0][c], q[1][c]);
+				}
+				for (uint32_t& index : indices[part])
+				{
+					index = 3 - index;
+				}
+			}
+		}
+
+		memset(out, 0, 16);
+		BitWriter writer{ out };
+		writer.put(1u << 5, 6);
+		writer.put(0, 2);
+		for (int c = 0; c < 4; c++)
+		{
+			writer.put(q[0][c], c < 3 ? 7 : 8);
+			writer.put(q[1][c], c < 3 ? 7 : 8);
+		}
+		for (int part = 0; part < 2; part++)
+		{
+			for (int i = 0; i < 16; i++)
+			{
+				writer.put(indices[part][i], i == 0 ? 1 : 2);
+			}
+		}
+		return error;
+	}
+
+	void bc7_write(const Bc7Mode& mode, Bc7Block block, uint8_t* out)
+	{
+		// the msb of each subset's anchor index is implicit 0, swap its endpoints otherwise
+		uint32_t indexMax = (1u << mode.indexBits) - 1;
+		uint32_t highBit = 1u << (mode.indexBits - 1);
+		for (uint32_t s = 0; s < mode.subsets; s++)
+		{
+			uint32_t anchor = s == 0 ? 0 : BC7_ANCHORS2[block.partition];
+			if (!(block.indices[anchor] & highBit))
+			{
+				continue;
+			}
+			std::swap(block.q[s][0], block.q[s][1]);
+			std::swap(block.pbit[s][0], block.pbit[s][1]);
+			uint32_t mask = subset_mask(mode, block.partition, s);
+			for (int i = 0; i < 16; i++)
+			{
+				if (mask & (1u << i))
+				{
+					block.indices[i] = indexMax - block.indices[i];
+				}
+			}
+		}
+
+		memset(out, 0, 16);
+		BitWriter bits{ out };
+		bits.put(1u << mode.mode, mode.mode + 1);
+		if (mode.subsets == 2)
+		{
+			bits.put(block.partition, 6);
+		}
+		uint32_t channels = mode.alphaBits ? 4 : 3;
+		for (uint32_t c = 0; c < channels; c++)
+		{
+			for (uint32_t s = 0; s < mode.subsets; s++)
+			{
+				bits.put(block.q[s][0][c], c < 3 ? mode.colorBits : mode.alphaBits);
+				bits.put(block.q[s][1][c], c < 3 ? mode.colorBits : mode.alphaBits);
+			}
+		}
+		for (uint32_t s = 0; s < mode.subsets; s++)
+		{
+			bits.put(block.pbit[s][0], 1);
+			if (!mode.sharedPbit)
+			{
+				bits.put(block.pbit[s][1], 1);
+			}
+		}
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			bool anchor = i == 0 || (mode.subsets == 2 && i == BC7_ANCHORS2[block.partition]);
+			bits.put(block.indices[i], anchor ? mode.indexBits - 1 : mode.indexBits);
+		}
+	}
+}
+
+namespace bc {
+
+	size_t block_bytes(Format format)
+	{
+		return format == Format::BC1 ? 8 : 16;
+	}
+
+	void encode_bc1(const uint8_t* texels, uint8_t* out)
+	{
+		encode_color_block(texels, out);
+	}
+
+	void encode_bc3(const uint8_t* texels, uint8_t* out)
+	{
+		encode_alpha_block(texels, out);
+		encode_color_block(texels, out + 8);
+	}
+
+	void encode_bc7(const uint8_t* texels, uint8_t* out)
+	{
+		Bc7Block best;
+		bc7_encode_mode(BC7_MODE6, texels, 0, best);
+		const Bc7Mode* bestMode = &BC7_MODE6;
+		if (best.error > BC7_PARTITION_THRESHOLD)
+		{
+			// two lines fit blocks with several distinct colors far better than one,
+			// the partitions with the smallest residual get a full encode
+			bool opaque = true;
+			for (int i = 0; i < 16; i++)
+			{
+				opaque = opaque && texels[i * 4 + 3] == 255;
+			}
+			int channels = opaque ? 3 : 4;
+			uint32_t candidates[BC7_PARTITION_CANDIDATES];
+			float candidateErrors[BC7_PARTITION_CANDIDATES];
+			for (int c = 0; c < BC7_PARTITION_CANDIDATES; c++)
+			{
+				candidates[c] = 0;
+				candidateErrors[c] = 1e30f;
+			}
+			for (uint32_t partition = 0; partition < 64; partition++)
+			{
+				float error = bc7_line_error(texels, BC7_PARTITIONS2[partition], channels)
+					+ bc7_line_error(texels, 0xFFFFu & ~BC7_PARTITIONS2[partition], channels);
+				for (int c = 0; c < BC7_PARTITION_CANDIDATES; c++)
+				{
+					if (error < candidateErrors[c])
+					{
+						for (int m = BC7_PARTITION_CANDIDATES - 1; m > c; m--)
+						{
+							candidates[m] = candidates[m - 1];
+							candidateErrors[m] = candidateErrors[m - 1];
+						}
+						candidates[c] = partition;
+						candidateErrors[c] = error;
+						break;
+					}
+				}
+			}
+
+			// modes 1 and 3 trade endpoint for index precision, mode 7 keeps alpha
+			const Bc7Mode* modes[2] = { &BC7_MODE1, &BC7_MODE3 };
+			const Bc7Mode* alphaModes[1] = { &BC7_MODE7 };
+			const Bc7Mode* const* tried = opaque ? modes : alphaModes;
+			int triedCount = opaque ? 2 : 1;
+			for (uint32_t partition : candidates)
+			{
+				for (int m = 0; m < triedCount; m++)
+				{
+					Bc7Block candidate;
+					bc7_encode_mode(*tried[m], texels, partition, candidate);
+					if (candidate.error < best.error)
+					{
+						best = candidate;
+						bestMode = tried[m];
+					}
+				}
+			}
+		}
+		bc7_write(*bestMode, best, out);
+
+		if (best.error > BC7_PARTITION_THRESHOLD)
+		{
+			bool opaque = true;
+			for (int i = 0; i < 16; i++)
+			{
+				opaque = opaque && texels[i * 4 + 3] == 255;
+			}
+			uint8_t mode5[16];
+			if (!opaque && bc7_encode_mode5(texels, mode5) < best.error)
+			{
+				memcpy(out, mode5, 16);
+			}
+		}
+	}
+
+	std::vector<uint8_t> encode_image(Format format, const uint8_t* pixels, uint32_t width, uint32_t height,
+		unsigned threads)
+	{
+		uint32_t blocksX = (width + 3) / 4;
+		uint32_t blocksY = (height + 3) / 4;
+		size_t blockSize = block_bytes(format);
+		std::vector<uint8_t> out(static_cast<size_t>(blocksX) * blocksY * blockSize);
+
+		auto encode_rows = [&](uint32_t firstRow, uint32_t lastRow) {
+			uint8_t texels[64];
+			for (uint32_t by = firstRow; by < lastRow; by++)
+			{
+				for (uint32_t bx = 0; bx < blocksX; bx++)
+				{
+					for (uint32_t y = 0; y < 4; y++)
+					{
+						uint32_t sy = std::min(by * 4 + y, height - 1);
+						for (uint32_t x = 0; x < 4; x++)
+						{
+							uint32_t sx = std::min(bx * 4 + x, width - 1);
+							memcpy(texels + (y * 4 + x) * 4, pixels + (static_cast<size_t>(sy) * width + sx) * 4, 4);
+						}
+					}
+					uint8_t* block = out.data() + (static_cast<size_t>(by) * blocksX + bx) * blockSize;
+					switch (format)
+					{
+					case Format::BC1:
+						encode_bc1(texels, block);
+						break;
+					case Format::BC3:
+						encode_bc3(texels, block);
+						break;
+					case Format::BC7:
+						encode_bc7(texels, block);
+						break;
+					}
+				}
+			}
+		};
+
+		threads = std::max(1u, std::min(threads, blocksY));
+		std::vector<std::thread> workers;
+		uint32_t rowsPerThread = (blocksY + threads - 1) / threads;
+		for (uint32_t first = 0; first < blocksY; first += rowsPerThread)
+		{
+			workers.emplace_back(encode_rows, first, std::min(first + rowsPerThread, blocksY));
+		}
+		for (std::thread& worker : workers)
+		{
+			worker.join();
+		}
+		return out;
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Block compression for the offline texture converter. Endpoints come from
+// the principal axis of each 4x4 block, quality sits between the fast and
+// the normal presets of the usual encoders. Colors are encoded as stored
+// (srgb stays srgb), the _SRGB formats decode them the same way.
+namespace bc {
+
+	enum class Format { BC1, BC3, BC7 };
+
+	// bytes per 4x4 block
+	size_t block_bytes(Format format);
+
+	// one block from 16 rgba8 texels, row major
+	void encode_bc1(const uint8_t* texels, uint8_t* out);
+	void encode_bc3(const uint8_t* texels, uint8_t* out);
+	// mode 6 (one subset, rgba 7.7.7.7 with p-bits, 4 bit indices), and for blocks
+	// it fits badly the best of the two subset modes 1 and 3 (opaque), or 7 and 5
+	// (separate alpha endpoints and indices) when the block has alpha
+	void encode_bc7(const uint8_t* texels, uint8_t* out);
+
+	// a whole rgba8 image, edge blocks repeat the last row and column.
+	// Block rows are spread over threads.
+	std::vector<uint8_t> encode_image(Format format, const uint8_t* pixels, uint32_t width, uint32_t height,
+		unsigned threads);
+}
@@ -0,0 +1,125 @@
+// Compares the summaries of two benchmark reports written by
+// vulkan_guide --benchmark and flags every metric that got worse by more
+// than the threshold. Every metric is lower is better: times (gpu scopes
+// included), draws, triangles, binds and uploaded bytes.
+//
+// usage: bench_compare <baseline.json> <current.json> [threshold %] [noise ms]
+//
+// Time differences below the noise floor (0.05 ms by default) never count as
+// a regression. Exits with 1 when something regressed, 2 on bad input.
+#include <vk_benchmark.h>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+namespace {
+	bool load_report(const string& path, rapidjson::Document& document)
+	{
+		ifstream file(path, ios::binary);
+		if (!file.is_open())
+		{
+			cout << "cannot open " << path << endl;
+			return false;
+		}
+		stringstream buffer;
+		buffer << file.rdbuf();
+		document.Parse(buffer.str().c_str());
+		if (document.HasParseError() || !document.IsObject() || !document.HasMember("summary") || !document["summary"].IsObject())
+		{
+			cout << path << " is not a benchmark report" << endl;
+			return false;
+		}
+		return true;
+	}
+
+	string text(const rapidjson::Document& document, const char* member)
+	{
+		return document.HasMember(member) && document[member].IsString() ? document[member].GetString() : "?";
+	}
+
+	// frame_ms, cpu_ms, gpu_ms and the gpu_<scope>_ms columns
+	bool is_time(const string& name)
+	{
+		return name.size() > 3 && name.compare(name.size() - 3, 3, "_ms") == 0;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		cout << "usage: bench_compare <baseline.json> <current.json> [threshold %] [noise ms]" << endl;
+		return 2;
+	}
+	double threshold = argc > 3 ? atof(argv[3]) : 5.0;
+	double noiseMs = argc > 4 ? atof(argv[4]) : 0.05;
+
+	rapidjson::Document baseline, current;
+	if (!load_report(argv[1], baseline) || !load_report(argv[2], current))
+	{
+		return 2;
+	}
+	if (text(baseline, "scene") != text(current, "scene"))
+	{
+		cout << "warning: comparing scene " << text(baseline, "scene") << " with " << text(current, "scene") << endl;
+	}
+	if (text(baseline, "device") != text(current, "device"))
+	{
+		cout << "warning: baseline ran on " << text(baseline, "device") << ", current on " << text(current, "device") << endl;
+	}
+
+	const char* stats[] = { "avg", "p50", "p95", "p99" };
+	const rapidjson::Value& before = baseline["summary"];
+	const rapidjson::Value& after = current["summary"];
+
+	int regressions = 0;
+	cout << left << setw(22) << "metric" << setw(6) << "stat"
+		<< right << setw(14) << "baseline" << setw(14) << "current" << setw(10) << "change" << endl;
+	for (auto member = before.MemberBegin(); member != before.MemberEnd(); ++member)
+	{
+		string name = member->name.GetString();
+		if (!after.HasMember(name.c_str()))
+		{
+			cout << left << setw(22) << name << "missing from " << argv[2] << endl;
+			continue;
+		}
+		for (const char* stat : stats)
+		{
+			const rapidjson::Value& a = member->value;
+			const rapidjson::Value& b = after[name.c_str()];
+			if (!a.HasMember(stat) || !b.HasMember(stat))
+			{
+				continue;
+			}
+			double old_value = a[stat].GetDouble();
+			double new_value = b[stat].GetDouble();
+			double change = old_value != 0 ? (new_value - old_value) / old_value * 100.0 : (new_value != 0 ? 100.0 : 0.0);
+			bool regressed = change > threshold;
+			if (is_time(name) && new_value - old_value < noiseMs)
+			{
+				regressed = false;
+			}
+			regressions += regressed ? 1 : 0;
+
+			cout << left << setw(22) << name << setw(6) << stat
+				<< right << fixed << setprecision(3) << setw(14) << old_value << setw(14) << new_value
+				<< setprecision(1) << setw(9) << showpos << change << "%" << noshowpos
+				<< (regressed ? "  REGRESSION" : "") << endl;
+		}
+	}
+
+	if (regressions > 0)
+	{
+		cout << regressions << " values regressed by more than " << threshold << "%" << endl;
+		return 1;
+	}
+	cout << "no regression above " << threshold << "%" << endl;
+	return 0;
+}
@@ -0,0 +1,104 @@
+// Offline texture converter: decodes an image, builds its mip chain and
+// writes the levels block compressed into a KTX2 file the engine uploads
+// without decoding.
+//
+// usage: texture_compress <input image> <output.ktx2> [bc1|bc3|bc7|rgba8]
+//   bc1   opaque textures, 4 bits per texel
+//   bc3   textures with alpha, 8 bits per texel
+//   bc7   (default) best quality, 8 bits per texel
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#include <vk_ktx2.h>
+#include <vk_mipmaps.h>
+#include "bc_encoder.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		cout << "usage: texture_compress <input image> <output.ktx2> [bc1|bc3|bc7|rgba8]" << endl;
+		return 1;
+	}
+	const char* formatName = argc > 3 ? argv[3] : "bc7";
+
+	VkFormat format;
+	bc::Format blockFormat = bc::Format::BC7;
+	if (strcmp(formatName, "bc1") == 0)
+	{
+		format = VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+		blockFormat = bc::Format::BC1;
+	}
+	else if (strcmp(formatName, "bc3") == 0)
+	{
+		format = VK_FORMAT_BC3_SRGB_BLOCK;
+		blockFormat = bc::Format::BC3;
+	}
+	else if (strcmp(formatName, "bc7") == 0)
+	{
+		format = VK_FORMAT_BC7_SRGB_BLOCK;
+	}
+	else if (strcmp(formatName, "rgba8") == 0)
+	{
+		format = VK_FORMAT_R8G8B8A8_SRGB;
+	}
+	else
+	{
+		cout << "unknown format " << formatName << endl;
+		return 1;
+	}
+
+	auto start = chrono::steady_clock::now();
+	int width, height, channels;
+	stbi_uc* pixels = stbi_load(argv[1], &width, &height, &channels, STBI_rgb_alpha);
+	if (!pixels)
+	{
+		cout << "failed to load " << argv[1] << endl;
+		return 1;
+	}
+
+	vector<uint8_t> mipData;
+	vector<mipmaps::Level> mips;
+	mipmaps::build_chain(pixels, width, height, mipData, mips);
+
+	unsigned threads = max(1u, thread::hardware_concurrency());
+	vector<vector<uint8_t>> levels;
+	auto encode = [&](const uint8_t* level, uint32_t levelWidth, uint32_t levelHeight) {
+		if (format == VK_FORMAT_R8G8B8A8_SRGB)
+		{
+			levels.emplace_back(level, level + static_cast<size_t>(levelWidth) * levelHeight * 4);
+		}
+		else
+		{
+			levels.push_back(bc::encode_image(blockFormat, level, levelWidth, levelHeight, threads));
+		}
+	};
+	encode(pixels, width, height);
+	for (const mipmaps::Level& mip : mips)
+	{
+		encode(mipData.data() + mip.offset, mip.width, mip.height);
+	}
+	stbi_image_free(pixels);
+
+	if (!ktx2::write(argv[2], format, width, height, levels))
+	{
+		cout << "failed to write " << argv[2] << endl;
+		return 1;
+	}
+
+	size_t bytes = 0;
+	for (const vector<uint8_t>& level : levels)
+	{
+		bytes += level.size();
+	}
+	size_t rgbaBytes = static_cast<size_t>(width) * height * 4 + mipData.size();
+	cout << argv[2] << ": " << ktx2::format_name(format) << " " << width << "x" << height << ", "
+		<< levels.size() << " levels, " << bytes / 1024 << " KiB (rgba8 " << rgbaBytes / 1024 << " KiB), "
+		<< chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+	return 0;
+}